@@ -0,0 +1,97 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "util.h"
+#include "except.h"
+
+
+/*===========================================================================*
+ *                    Wrapper for utility functions                          *
+ *===========================================================================*/
+#define Amalloc(p0, p1)             ArenaAlloc (p0, p1,     __FILE__, __LINE__, __FUNCTION__)
+#define Acalloc(p0, p1, p2)         ArenaCalloc(p0, p1, p2, __FILE__, __LINE__, __FUNCTION__)
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define ARENA_CHUNK_SIZE                    (64 * 1024)     /* The payload size of a regular chunk. */
+#define ARENA_LARGE_THRESHOLD               (16 * 1024)     /* The request size served by a dedicated chunk. */
+#define ARENA_ALIGNMENT                     (16)            /* The alignment of each returned block. */
+
+
+/* Structure to record a chunk of memory carved by the bump pointer. */
+typedef struct _ArenaChunk {
+    struct _ArenaChunk  *pNext;
+    size_t              nSize, nUsed;
+} ArenaChunk;
+
+
+/* Structure to store the per-analysis memory pool. */
+typedef struct _Arena {
+    ArenaChunk  *pHead, *pCurr;
+    ArenaChunk  *pLarge;
+} Arena;
+
+
+/* Wrapper for Arena initialization. */
+#define Arena_init(p)           try {                                           \
+                                    p = (Arena*)Malloc(sizeof(Arena));          \
+                                    ArenaInit(p);                               \
+                                } catch (EXCEPT_MEM_ALLOC) {                    \
+                                    p = NULL;                                   \
+                                } end_try;
+
+
+/* Wrapper for Arena deinitialization. */
+#define Arena_deinit(p)         if (p != NULL) {                                \
+                                    ArenaDeinit(p);                             \
+                                    Free(p);                                    \
+                                    p = NULL;                                   \
+                                }
+
+
+/* Constructor for Arena structure. */
+void ArenaInit(Arena *self);
+
+
+/* Destructor for Arena structure. */
+void ArenaDeinit(Arena *self);
+
+
+/**
+ * This function allocates a block from the arena. The block lives until the
+ * arena is reset or released, and it must not be passed to Free().
+ *
+ * @param   self            The pointer to the Arena structure.
+ * @param   nLength         The requested size in bytes.
+ *
+ * @return                  The pointer to the allocated block.
+ *                          EXCEPT_MEM_ALLOC is thrown if the arena cannot grow.
+ */
+void* ArenaAlloc(Arena *self, size_t nLength, const char *cszPathSrc, const int iLineNo, const char *cszFunc);
+
+
+/**
+ * This function allocates a zero-filled array from the arena.
+ *
+ * @param   self            The pointer to the Arena structure.
+ * @param   nLength         The number of elements.
+ * @param   nSize           The size of each element.
+ *
+ * @return                  The pointer to the allocated array.
+ *                          EXCEPT_MEM_ALLOC is thrown if the arena cannot grow.
+ */
+void* ArenaCalloc(Arena *self, size_t nLength, size_t nSize, const char *cszPathSrc, const int iLineNo,
+                  const char *cszFunc);
+
+
+/**
+ * This function releases all the blocks at once. The regular chunks are kept
+ * for the next analysis while the dedicated chunks are returned to the system.
+ *
+ * @param   self            The pointer to the Arena structure.
+ */
+void ArenaReset(Arena *self);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "util.h"
+#include "except.h"
+#include "arena.h"
+#include "reader.h"
+#include "stats.h"
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define CACHE_MAGIC                         "PENGRAMC"      /* The signature of a cache entry. */
+#define CACHE_MAGIC_SIZE                    (8)
+#define CACHE_VERSION                       (1)             /* Bump it when the layout of a payload changes. */
+#define CACHE_HASH_CHUNK_SIZE               (256 * 1024)    /* The bytes hashed per read. It must be a multiple of 16. */
+
+/* The kinds of the cache entries. */
+#define CACHE_KIND_ENTROPY                  "entropy"       /* The entropy pyramid of a section. */
+#define CACHE_KIND_NGRAM                    "ngram_d%d"     /* The token histogram of a section per dimension. */
+
+
+/*
+ * Structure to identify the raw data of a section. The raw bytes are hashed into
+ * 128 bits, and the size is kept as well, so the entries of the sections with the
+ * same content are shared by all the samples.
+ */
+typedef struct _CacheKey {
+    ulong arrHash[2];
+    ulong ulSize;
+} CacheKey;
+
+
+/**
+ * This function hashes the specified range of the sample.
+ *
+ * @param   pKey            The pointer to the returned key.
+ * @param   pReader         The reader of the sample.
+ * @param   ulOstBgn        The starting file offset.
+ * @param   ulSize          The number of bytes to hash.
+ * @param   uszBuf          The buffer which can hold CACHE_HASH_CHUNK_SIZE bytes. It is
+ *                          not touched if the sample is loaded in memory.
+ *
+ * @return                  0: The range is hashed successfully.
+ *                        < 0: The range cannot be fully read.
+ */
+int CacheHashRange(CacheKey *pKey, Reader *pReader, ulong ulOstBgn, ulong ulSize, uchar *uszBuf);
+
+
+/**
+ * This function loads the payload of a cache entry.
+ *
+ * @param   cszDir          The path to the cache folder.
+ * @param   pKey            The pointer to the key of the section.
+ * @param   cszKind         The kind of the payload, which is a part of the file name.
+ * @param   pArena          The arena to allocate the payload.
+ * @param   nMaxSize        The largest payload size the caller accepts. A larger entry
+ *                          is rejected before its payload is allocated.
+ * @param   pnSize          The pointer to the returned payload size.
+ *
+ * @return                  The pointer to the payload.
+ *                          NULL if the entry does not exist or is broken.
+ *                          EXCEPT_MEM_ALLOC is thrown if the payload cannot be allocated.
+ */
+void* CacheLoad(const char *cszDir, const CacheKey *pKey, const char *cszKind, Arena *pArena, size_t nMaxSize,
+                size_t *pnSize);
+
+
+/**
+ * This function stores the payload of a cache entry. The entry is written to a
+ * temporary file and renamed, so the concurrent runs never see a partial entry.
+ *
+ * @param   cszDir          The path to the cache folder.
+ * @param   pKey            The pointer to the key of the section.
+ * @param   cszKind         The kind of the payload, which is a part of the file name.
+ * @param   vpData          The payload.
+ * @param   nSize           The payload size.
+ *
+ * @return                  0: The entry is stored successfully.
+ *                        < 0: The entry cannot be written.
+ */
+int CacheStore(const char *cszDir, const CacheKey *pKey, const char *cszKind, const void *vpData, size_t nSize);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _CARVE_H_
+#define _CARVE_H_
+
+#include "util.h"
+#include "except.h"
+#include "trace.h"
+
+#if defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    #define CARVE_ENABLE_SIMD
+    #include <immintrin.h>
+#endif
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define CARVE_MAX_PE_OFFSET                 (0x10000)   /* The maximum offset of the PE header from the MZ header. */
+#define CARVE_MAX_SECTIONS                  (96)        /* The maximum number of sections of a carved image. */
+#define CARVE_INIT_CAPACITY                 (64)        /* The initial capacity of the image array. */
+#define CARVE_MAX_WORKERS                   (16)        /* The maximum number of threads analyzing the images. */
+
+
+/* Structure to locate an image embedded in the input. */
+typedef struct _CarveImage {
+    ulong ulOffset, ulSize;
+} CarveImage;
+
+
+/*
+ * Structure to carve the PE images out of a large input such as a memory dump or
+ * a disk image. The input is mapped read-only and each image is a slice of the
+ * mapping, so the images are analyzed without being copied.
+ *
+ * An image spans from its MZ header to the end of its section table or of its
+ * furthest raw section data, clipped to the end of the input. The raw offsets are
+ * taken as file offsets, so the images are carved in their file layout.
+ */
+typedef struct _Carve {
+    int         fd;
+    uchar       *uszData;
+    ulong       ulSize;
+    ulong       ulNumImages, ulCapacity;
+    CarveImage  *arrImage;
+} Carve;
+
+
+/**
+ * This function maps the specified input for carving.
+ *
+ * @param   self            The pointer to the Carve structure.
+ * @param   cszPath         The path of the input.
+ *
+ * @return                  0: The input is successfully mapped.
+ *                        < 0: The input cannot be opened or mapped.
+ */
+int CarveOpen(Carve *self, const char *cszPath);
+
+
+/**
+ * This function scans the mapped input for the MZ signatures and records the
+ * candidates whose headers are valid. The images are kept in the order of their
+ * offsets, and the nested ones are recorded as well.
+ *
+ * @param   self            The pointer to the Carve structure.
+ *
+ * @return                  0: The input is scanned successfully.
+ *                        < 0: The image array cannot be allocated.
+ */
+int CarveScan(Carve *self);
+
+
+/**
+ * This function unmaps the input and releases the image array.
+ *
+ * @param   self            The pointer to the Carve structure.
+ */
+void CarveClose(Carve *self);
+
+#endif
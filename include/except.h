@@ -63,7 +63,8 @@
 #endif
 
 
-/* The buffer stors the destination of long jump when exception occurs. */
-extern jmp_buf bufExcept;
+/* The buffer stors the destination of long jump when exception occurs. Each thread
+   has its own, so the workers can catch the exceptions of their own samples. */
+extern __thread jmp_buf bufExcept;
             
 #endif
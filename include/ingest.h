@@ -0,0 +1,126 @@
+#ifndef _INGEST_H_
+#define _INGEST_H_
+
+#include "util.h"
+#include "except.h"
+#include "stats.h"
+#include "trace.h"
+
+#if defined(__linux__)
+    #include <stdint.h>
+    #include <sys/syscall.h>
+    #include <sys/mman.h>
+    #include <linux/io_uring.h>
+#endif
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define INGEST_QUEUE_DEPTH                  (64)            /* The maximum number of samples in flight. */
+#define INGEST_NUM_WORKERS                  (4)             /* The number of threads for the fallback loader. */
+#define INGEST_INIT_CAPACITY                (512 * 1024)    /* The initial buffer size of a sample. */
+
+/* The loaders of the ingestion layer. */
+#define INGEST_MODE_URING                   (1)
+#define INGEST_MODE_THREAD                  (2)
+
+/* The stages of a sample loaded by io_uring. */
+#define INGEST_STAGE_OPEN                   (1)
+#define INGEST_STAGE_READ                   (2)
+#define INGEST_STAGE_CLOSE                  (3)
+
+
+/* Structure to store a fully loaded sample. The fields after iErrno are private. */
+typedef struct _IngestSample {
+    char    szPath[BUF_SIZE_MID + 1];
+    char    *szName;
+    uchar   *uszData;
+    size_t  nSize;
+    int     iErrno;
+
+    int     fd, iStage;
+    size_t  nCapacity;
+    struct _IngestSample *pNext;
+} IngestSample;
+
+
+/* Structure to store the mapped submission and completion rings of io_uring. */
+typedef struct _IngestRing {
+    int     fd;
+    uint    uiNumQueued;
+    uint    *puiSqHead, *puiSqTail, *puiSqMask, *puiSqArray;
+    uint    *puiCqHead, *puiCqTail, *puiCqMask;
+    void    *pSqRing, *pCqRing, *pSqe;
+    size_t  nSqRing, nCqRing, nSqe;
+    #if defined(__linux__)
+        struct io_uring_sqe *arrSqe;
+        struct io_uring_cqe *arrCqe;
+    #endif
+} IngestRing;
+
+
+/*
+ * Structure to load the samples of a directory ahead of the analysis. At most
+ * INGEST_QUEUE_DEPTH samples are in flight or waiting for the caller, and the
+ * loaded samples are returned in completion order.
+ */
+typedef struct _Ingest {
+    int             iMode;
+    char            **arrPath;
+    ulong           ulNumPaths, ulIdxSubmit, ulNumDelivered, ulNumInFlight;
+    IngestSample    arrSlot[INGEST_QUEUE_DEPTH];
+    IngestSample    *pFree, *pReadyHead, *pReadyTail;
+    IngestRing      ring;
+
+    int             iNumWorkers;
+    bool            bStop;
+    pthread_t       arrWorker[INGEST_NUM_WORKERS];
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+} Ingest;
+
+
+/**
+ * This function collects the files of the specified directory and starts the
+ * loader. io_uring is used if the kernel supports it, otherwise a small pool of
+ * threads loads the samples with the blocking system calls.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ * @param   cszPathDir      The path of the sample directory.
+ *
+ * @return                  0: The loader is started successfully.
+ *                        < 0: The directory cannot be read or the loader cannot be started.
+ */
+int IngestOpen(Ingest *self, const char *cszPathDir);
+
+
+/**
+ * This function returns the next loaded sample. It blocks until a sample is ready.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ *
+ * @return                  The pointer to the loaded sample, or NULL if all the
+ *                          samples are returned. If the sample cannot be loaded,
+ *                          its iErrno is set and its buffer is NULL.
+ */
+IngestSample* IngestNext(Ingest *self);
+
+
+/**
+ * This function releases the sample buffer so that the slot can be reused.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ * @param   pSample         The pointer to the sample returned by IngestNext().
+ */
+void IngestRelease(Ingest *self, IngestSample *pSample);
+
+
+/**
+ * This function stops the loader and releases all the resources.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ */
+void IngestClose(Ingest *self);
+
+#endif
@@ -3,8 +3,17 @@
 
 #include "util.h"
 #include "except.h"
+#include "arena.h"
 #include "pe_info.h"
 #include "region.h"
+#include "stats.h"
+#include "trace.h"
+#include "cache.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    #define NGRAM_ENABLE_SIMD
+    #include <immintrin.h>
+#endif
 
 
 /* Structure to record the value and the appearance frequency of a specific n-gram token. */
@@ -13,18 +22,83 @@ typedef struct _Token {
 } Token;
 
 
-/* Structure to store the single record of n-gram model. */
-typedef struct _Slice {
-    Token  *pDenominator, *pNumerator;
-    double dScore;
-} Slice;
+/* Structure to carry the sliding window across the chunk boundaries. */
+typedef struct _NGramWindow {
+    ulong ulValue, ulNumBytes;
+} NGramWindow;
+
+
+/* Structure to record a distinct block of the deduplication table and the number of its repeats. */
+typedef struct _NGramBlock {
+    ulong ulHash, ulNumRepeats;
+    uchar *uszData;
+} NGramBlock;
+
+
+/* Structure to summarize the tokens of a window along the selected ranges. */
+typedef struct _NGramProfile {
+    ulong ulOstBgn, ulOstEnd;
+    ulong ulNumTokens, ulNumDistinct, ulNumTop;
+    Token arrTop[NGRAM_PROFILE_TOP];
+} NGramProfile;
+
+
+struct _NGram;
 
+/* The kernel to slide the token window over a chunk of binary. */
+typedef void (*NGramKernel) (struct _NGram*, NGramWindow*, const uchar*, size_t);
 
-/* Structure to store all the information of n-gram model for the input sample. */
+
+/*
+ * Structure to store all the information of n-gram model for the input sample.
+ *
+ * The token histogram is a dense array indexed by the token value. The model is
+ * stored as parallel arrays, so the i-th slice consists of arrSliceValue[i],
+ * arrSliceFrequency[i] and arrSliceScore[i]. All the slices share the single
+ * denominator token.
+ *
+ * The model only counts the tokens of the selected regions within the file offsets
+ * [ulOstBgn, ulOstEnd), which cover the entire file by default.
+ *
+ * The remaining members are the counting state of the model. The vector kernels
+ * write to arrHistogram, whose copy of bit offset k starts at arrHistogram +
+ * k * ulSubStride. With the radix partitions, the low 16 bits of each token are
+ * buffered in the partition of its high byte before being counted. With the block
+ * deduplication, the tokens within a repeated block are not slid but counted from
+ * its first copy, kept in the open addressing table arrBlock, after all the ranges.
+ *
+ * If the tokens of a model come from exactly the raw data of one section, the
+ * histogram is keyed by pCacheKey of the section in the result cache. A model
+ * loaded from the cache has bCached set and takes no part in the collection.
+ * If ulProfileSize is set, the windows of that size are also moved along the
+ * selected ranges by ulProfileStep bytes, and the token summary of each window
+ * is kept in arrProfile.
+ */
 typedef struct _NGram {
+    Arena   *pArena;
     ulong   ulNumTokens, ulNumSlices;
-    Token   **arrToken;
-    Slice   **arrSlice;
+    ulong   *arrFrequency;
+    Token   tokDenominator;
+    ulong   *arrSliceValue, *arrSliceFrequency;
+    double  *arrSliceScore;
+
+    uchar       ucDimension;
+    ulong       ulMaxValue, ulOstBgn, ulOstEnd;
+    NGramWindow window;
+    NGramKernel slideKernel, slideWindow;
+    bool        bVectorKernel, bPartition;
+    ulong       *arrHistogram, ulSubStride;
+    ushort      *arrPartition;
+    uint        *arrPartitionFill;
+    bool        bDedupBlocks;
+    NGramBlock  *arrBlock;
+    ulong       ulNumBlockSlots, ulNumBlocks;
+    uchar       *uszBlockPool;
+    const char  *cszCacheDir;
+    CacheKey    *pCacheKey;
+    bool        bCached;
+    ulong       ulProfileSize, ulProfileStep, ulNumProfiles;
+    NGramProfile *arrProfile;
 
     void *hdlePlug;
     int (*entryPlug) (struct _NGram*, ulong);
@@ -32,6 +106,7 @@ typedef struct _NGram {
     int  (*loadPlugin)    (struct _NGram*, const char*);
     int  (*unloadPlugin)  (struct _NGram*);
     void (*setDimension)  (struct _NGram*, uchar ucDimension);
+    void (*setRange)      (struct _NGram*, ulong ulOstBgn, ulong ulOstEnd);
     int  (*generateModel) (struct _NGram*, PEInfo*, RegionCollector*);
     void (*dump)          (struct _NGram*);
 } NGram;
@@ -93,6 +168,16 @@ int NGramUnloadPlugin(NGram *self);
 void NGramSetDimension(NGram *self, uchar ucDimension);
 
 
+/**
+ * This function restricts the model to the tokens within the specified file offsets.
+ *
+ * @param   self            The pointer to the NGram structure.
+ * @param   ulOstBgn        The starting file offset.
+ * @param   ulOstEnd        The ending file offset (exclusive).
+ */
+void NGramSetRange(NGram *self, ulong ulOstBgn, ulong ulOstEnd);
+
+
 /**
  * This function generates the n-gram model based on the specified method.
  *
@@ -106,6 +191,22 @@ void NGramSetDimension(NGram *self, uchar ucDimension);
 int NGramGenerateModel(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector);
 
 
+/**
+ * This function generates the n-gram models of several dimensions in one pass. The
+ * selected regions are read once, and the tokens of all the models are collected
+ * from the same chunks.
+ *
+ * @param   arrNGram            The array of the NGram structures with the dimensions set.
+ * @param   uiNumModels         The number of the NGram structures.
+ * @param   pPEInfo             The pointer to the to be analyzed PEInfo structure.
+ * @param   pRegionCollector    The pointer to the RegionCollector structure which stores all the selected features.
+ *
+ * @return                      0: The models are generated successfully.
+ *                            < 0: Exception occurs while memory allocation.
+ */
+int NGramGenerateModels(NGram **arrNGram, uint uiNumModels, PEInfo *pPEInfo, RegionCollector *pRegionCollector);
+
+
 /**
  * This function dumps the information recorded from the generated n-gram tokens.
  *
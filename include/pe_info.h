@@ -3,41 +3,89 @@
 
 #include "util.h"
 #include "except.h"
+#include "arena.h"
+#include "reader.h"
+#include "cache.h"
 
-/* Structure to store the PE header information. */
+/* Structure to record the RVA and the size of a data directory. */
+typedef struct _DataDirectory {
+    ulong   ulRva, ulSize;
+} DataDirectory;
+
+
+/*
+ * Structure to store the PE header information.
+ *
+ * The optional header fields stay zero if the header is too short to hold them or its
+ * magic is neither PE32 nor PE32+. Only the first ulNumDataDirs directories are valid.
+ */
 typedef struct _PEHeader {
-    ulong   ulHeaderOffset;
-    ushort  usNumSections;
+    ulong           ulHeaderOffset;
+    ushort          usNumSections;
+    ushort          usOptMagic;
+    ulong           ulEntryPoint, ulImageBase, ulImageSize;
+    ulong           ulNumDataDirs;
+    DataDirectory   arrDataDir[DATA_DIR_MAX_ENTRIES];
 } PEHeader;
 
 
-/* Structure to store the entroy data of a section. */
+/*
+ * Structure to store the entroy data of a section.
+ *
+ * The entropy pyramid records the entropies of the section at several block sizes.
+ * Level 0 is the array of the ENTROPY_BLK_SIZE blocks, and the last level holds the
+ * single entropy of the whole section. The blocks of the level l are
+ * arrLevelBlkSize[l] bytes long except the last one of the section.
+ *
+ * The optional sliding entropy profile records the entropy of the ENTROPY_BLK_SIZE
+ * window starting at each byte of the section, so arrSlideEntropy[k] covers the
+ * bytes [k, k + ENTROPY_BLK_SIZE) of the raw data.
+ *
+ * If bExact is false, the section is only estimated from ENTROPY_NUM_SAMPLES blocks
+ * spread evenly over it. The max, min and average entropies are those of the sampled
+ * blocks, and the entropy arrays stay NULL until the section is measured.
+ */
 typedef struct _EntropyInfo {
     ulong   ulNumBlks;
     double  *arrEntropy;
     double  dMaxEntropy, dAvgEntropy, dMinEntropy;
+    ulong   arrLevelBlkSize[ENTROPY_NUM_LEVELS];
+    ulong   arrNumLevelBlks[ENTROPY_NUM_LEVELS];
+    double  *arrLevelEntropy[ENTROPY_NUM_LEVELS];
+    ulong   ulNumSlides;
+    float   *arrSlideEntropy;
+    bool    bExact;
 } EntropyInfo;
 
 
-/* Structure to store the section information. */
+/* Structure to store the section information. The cache key of the raw data is
+   NULL unless the result cache is enabled. */
 typedef struct _SectionInfo {
     ulong       ulRawSize, ulRawOffset, ulCharacteristics;
+    ulong       ulVirtualSize, ulVirtualAddress;
     uchar       uszNormalizedName[SECTION_HEADER_SECTION_NAME_SIZE + 1];
     uchar       uszOriginalName[SECTION_HEADER_SECTION_NAME_SIZE + 1];
     EntropyInfo *pEntropyInfo;
+    CacheKey    *pCacheKey;
 } SectionInfo;
 
 
 /* Structure to store the complete analysis result for a PE file. */
 typedef struct _PEInfo {
+    Arena         *pArena;
+    bool          bPrefetch, bSlideEntropy, bLazyEntropy;
+    const char    *cszCacheDir;
     char          *szSampleName;
     FILE          *fpSample;
+    Reader        *pReader;
     PEHeader      *pPEHeader;
     SectionInfo   **arrSectionInfo;
 
     int     (*openSample)              (struct _PEInfo*, const char*);
+    int     (*openBuffer)              (struct _PEInfo*, const char*, uchar*, size_t);
     int     (*parseHeaders)            (struct _PEInfo*);
     int     (*calculateSectionEntropy) (struct _PEInfo*);
+    int     (*measureSection)          (struct _PEInfo*, ushort);
     void    (*dump)                    (struct _PEInfo*);
 } PEInfo;
 
@@ -79,6 +127,21 @@ void PEInfoDeinit(PEInfo *pPEInfo);
 int PEInfoOpenSample(PEInfo *self, const char *cszSamplePath);
 
 
+/**
+ * This function opens the sample already loaded in memory for analysis. The buffer
+ * must stay valid until the PEInfo structure is deinitialized.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   cszSamplePath   The path of the loaded sample.
+ * @param   uszData         The buffer of the loaded sample.
+ * @param   nSize           The size of the loaded sample.
+ *
+ * @return                  0: The sample is successfully opened.
+ *                        < 0: The sample cannot be opend.
+ */
+int PEInfoOpenBuffer(PEInfo *self, const char *cszSamplePath, uchar *uszData, size_t nSize);
+
+
 /**
  * This function collects the information from MZ header, PE header, PE option header,
  * and all the section headers.
@@ -92,7 +155,18 @@ int PEInfoParseHeaders(PEInfo *self);
 
 
 /**
- * This function calculates and collects the entropy data of each section.
+ * This function calculates and collects the entropy data of each section. The byte
+ * histogram of each block is merged upward into the blocks of the coarser levels, so
+ * the whole entropy pyramid is built in a single pass over the section. If bSlideEntropy
+ * is set, the sliding entropy profile is also built in the same pass.
+ *
+ * The sections are split into spans of ENTROPY_TASK_SIZE bytes, and the spans of all
+ * the sections are processed by a pool of threads with positional reads. Each task
+ * writes its blocks into the entropy arrays directly. The whole section entropy and
+ * the max, min and average block entropies are reduced after all the tasks finish.
+ *
+ * If bLazyEntropy is set, each section is only estimated from the sampled blocks, and
+ * the exact entropy data is left to PEInfoMeasureSection().
  *
  * @param   self            The pointer to the PEInfo structure.
  *
@@ -102,6 +176,20 @@ int PEInfoParseHeaders(PEInfo *self);
 int PEInfoCalculateSectionEntropy(PEInfo *self);
 
 
+/**
+ * This function calculates the exact entropy data of the specified section if it is
+ * only estimated. The region plugins and the reports which need the entropy arrays
+ * should call it for each section they refer to.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   usIdxSection    The index of the section.
+ *
+ * @return                  0: The entropy data is ready or the section is empty.
+ *                        < 0: Exception occurs while file accessing or memory allocation.
+ */
+int PEInfoMeasureSection(PEInfo *self, ushort usIdxSection);
+
+
 /**
  * This function dumps the information recorded from the input sample for debug.
  *
@@ -0,0 +1,85 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include "util.h"
+#include "stats.h"
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+/* The sampled hardware events. */
+#define PERF_COUNTER_CYCLES                 (0)
+#define PERF_COUNTER_INSTRUCTIONS           (1)
+#define PERF_COUNTER_L1D_MISSES             (2)
+#define PERF_COUNTER_LLC_MISSES             (3)
+#define PERF_COUNTER_BRANCH_MISSES          (4)
+#define PERF_COUNTER_COUNT                  (5)
+
+
+/* Structure to keep the raw reading of an event. The multiplexing ratio is applied
+   to the deltas of a phase, not to the absolute counts. */
+typedef struct _PerfReading {
+    ulong   ulValue;
+    ulong   ulTimeEnabled;
+    ulong   ulTimeRunning;
+} PerfReading;
+
+/* Structure to accumulate the hardware event counts of each phase for the current sample. */
+typedef struct _PerfSample {
+    bool        arrValid[PERF_COUNTER_COUNT];
+    PerfReading arrBgn[PERF_COUNTER_COUNT];
+    ulong       arrValue[STATS_PHASE_COUNT][PERF_COUNTER_COUNT];
+} PerfSample;
+
+
+/* The switch to activate the sampling. It is set only if the events can be opened. */
+extern bool _bPerfOn;
+
+
+/**
+ * This function opens the hardware event group for the calling thread with
+ * perf_event_open(). The threads created afterwards inherit the events, and their
+ * counts are included once they exit. Events which are not supported by the
+ * machine are skipped.
+ *
+ * @return                  0: At least one event is available.
+ *                        < 0: The events are unavailable. (e.g. No permission in containers,
+ *                             or the engine is built without ENABLE_STATS.)
+ */
+int PerfOpen();
+
+
+/**
+ * This function starts counting the events for a pipeline phase. The deltas are
+ * attributed to the phase by PerfEndPhase().
+ */
+void PerfBeginPhase();
+
+
+/**
+ * This function stops counting the events for the specified pipeline phase and
+ * accumulates the deltas. An event which can not be read is dumped as null from
+ * then on.
+ *
+ * @param   idxPhase        The index of the phase.
+ */
+void PerfEndPhase(int idxPhase);
+
+
+/**
+ * This function dumps the per-phase event counts of the current sample as a JSON
+ * object and then resets the accumulators for the next sample.
+ *
+ * @param   fp              The file pointer to the output stream.
+ * @param   cszSampleName   The name of the analyzed sample.
+ */
+void PerfDumpSample(FILE *fp, const char *cszSampleName);
+
+
+/**
+ * This function closes the hardware event group.
+ */
+void PerfClose();
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef _READER_H_
+#define _READER_H_
+
+#include "util.h"
+#include "except.h"
+#include "arena.h"
+#include "stats.h"
+#include "trace.h"
+
+
+/*===========================================================================*
+ *                    Wrapper for utility functions                          *
+ *===========================================================================*/
+#define ReaderFetch(p0, p1)         ReaderNext(p0, p1, __FILE__, __LINE__, __FUNCTION__)
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define READER_CHUNK_SIZE                   (256 * 1024)    /* The size of each buffer. It must be a multiple of ENTROPY_BLK_SIZE. */
+#define READER_NUM_BUFFERS                  (2)             /* The number of buffers filled in turn. */
+
+
+/*
+ * Structure to stream a range of the sample in large chunks. The chunks are read
+ * with pread(), so the reader does not disturb the position of the FILE stream.
+ * If the helper thread is running, the next chunk is filled in the background
+ * while the caller consumes the current one. If the sample is already loaded in
+ * memory, the chunks point into the sample buffer directly.
+ */
+typedef struct _Reader {
+    int     fd;
+    ulong   ulOstEnd, ulOstCur, ulOstFill;
+    uchar   *uszData;
+    ulong   ulSize;
+    uchar   *arrBuf[READER_NUM_BUFFERS];
+    ssize_t arrLen[READER_NUM_BUFFERS];
+    int     idxCur, idxFill, iErrno;
+
+    bool            bThread, bPending, bStop;
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+} Reader;
+
+
+/**
+ * This function initializes the reader for the opened sample.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   pArena          The arena to allocate the buffers.
+ * @param   fp              The file pointer of the opened sample.
+ * @param   bPrefetch       Whether to start the helper thread for prefetching.
+ *                          The reader falls back to the synchronous mode if the
+ *                          thread cannot be created.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the buffers cannot be allocated.
+ */
+void ReaderInit(Reader *self, Arena *pArena, FILE *fp, bool bPrefetch);
+
+
+/**
+ * This function initializes the reader for the sample loaded in memory. No buffer
+ * or helper thread is needed in this mode.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   uszData         The buffer of the loaded sample.
+ * @param   ulSize          The size of the loaded sample.
+ */
+void ReaderInitBuffer(Reader *self, uchar *uszData, ulong ulSize);
+
+
+/**
+ * This function stops the helper thread.
+ *
+ * @param   self            The pointer to the Reader structure.
+ */
+void ReaderDeinit(Reader *self);
+
+
+/**
+ * This function hints the kernel to read ahead the specified range.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   ulOstBgn        The starting file offset.
+ * @param   ulOstEnd        The ending file offset (exclusive).
+ */
+void ReaderAdvise(Reader *self, ulong ulOstBgn, ulong ulOstEnd);
+
+
+/**
+ * This function starts streaming the specified range. The pending prefetch of the
+ * previous range is discarded.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   ulOstBgn        The starting file offset.
+ * @param   ulOstEnd        The ending file offset (exclusive).
+ */
+void ReaderOpenRange(Reader *self, ulong ulOstBgn, ulong ulOstEnd);
+
+
+/**
+ * This function returns the next chunk of the current range. The chunk stays valid
+ * until the next call.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   ppBuf           The pointer to the returned chunk.
+ *
+ * @return                  The number of bytes in the chunk. It is less than the
+ *                          expected size if the end of file is reached, and it
+ *                          is 0 if the range is exhausted.
+ *                          EXCEPT_IO_FILE_READ is thrown if the read fails.
+ */
+size_t ReaderNext(Reader *self, uchar **ppBuf, const char *cszPathSrc, const int iLineNo, const char *cszFunc);
+
+
+/**
+ * This function reads the specified range at its file offset without touching the
+ * state of the current range, so it can be called by several threads at once.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   ulOstBgn        The starting file offset.
+ * @param   nLength         The number of bytes to read.
+ * @param   uszBuf          The caller buffer which can hold nLength bytes.
+ * @param   ppBuf           The pointer to the returned data. It points into the
+ *                          sample buffer if the sample is loaded in memory.
+ *
+ * @return                  The number of bytes read. It is less than nLength if the
+ *                          end of file is reached, and it is -1 with errno set if
+ *                          the read fails.
+ */
+ssize_t ReaderReadAt(Reader *self, ulong ulOstBgn, size_t nLength, uchar *uszBuf, uchar **ppBuf);
+
+#endif
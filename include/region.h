@@ -3,12 +3,18 @@
 
 #include "util.h"
 #include "except.h"
+#include "arena.h"
 #include "pe_info.h"
 
 
-/* Structure to record the range of binary. */
+/*
+ * Structure to record the range of binary. The range is given by the block indices
+ * [ulIdxBgn, ulIdxEnd), or by the byte offsets [ulOstBgn, ulOstEnd) within the section
+ * raw data if ulOstEnd is not zero.
+ */
 typedef struct _RangePair {
     ulong ulIdxBgn, ulIdxEnd;
+    ulong ulOstBgn, ulOstEnd;
 } RangePair;
 
 
@@ -20,15 +26,33 @@ typedef struct _Region {
 } Region;
 
 
+/*
+ * Structure to record a normalized span of file offsets. The adjacent ranges merged
+ * into the span are separated by the boundaries, where the token window restarts.
+ */
+typedef struct _Span {
+    ulong   ulOstBgn, ulOstEnd;
+    ulong   ulNumBounds;
+    ulong   *arrBound;
+} Span;
+
+
 /* Structure to store the features for n-gram analysis. */
 typedef struct _RegionCollector {
-    ushort  usNumRegions;
-    Region  **arrRegion;
+    Arena       *pArena;
+    const char  *cszPlugArg;
+    ushort      usNumRegions;
+    Region      **arrRegion;
+    bool        bSpanRanges;
+    ulong       ulNumSpans;
+    Span        *arrSpan;
 
     void *hdlePlug;
     int (*entryPlug) (struct _RegionCollector*, PEInfo*);
 
     int (*selectFeatures) (struct _RegionCollector*, PEInfo*);
+    int (*selectSections) (struct _RegionCollector*, PEInfo*);
+    int (*normalizeRanges) (struct _RegionCollector*, PEInfo*);
     int (*loadPlugin) (struct _RegionCollector*, const char*);
     int (*unloadPlugin) (struct _RegionCollector*);
 } RegionCollector;
@@ -93,4 +117,34 @@ int RCUnloadPlugin(RegionCollector *self);
 int RCSelectFeatures(RegionCollector *self, PEInfo *pPEInfo);
 
 
+/**
+ * This function selects the entire raw data of every non-empty section, one region
+ * per section in the order of the section table. It replaces the plugin when a model
+ * is generated for each section.
+ *
+ * @param   self        The pointer to the RegionCollector structure.
+ * @param   pPEInfo     The pointer to the to be analyzed PEInfo structure.
+ *
+ * @return              0: The sections are collected successfully.
+ *                    < 0: Exception occurs while memory allocation.
+ */
+int RCSelectSections(RegionCollector *self, PEInfo *pPEInfo);
+
+
+/**
+ * This function normalizes the selected ranges into the spans of file offsets.
+ * The ranges are clamped to the raw data of their sections, sorted by offset,
+ * and the overlapping or adjacent ones are merged, so that the spans can be read
+ * sequentially. The n-gram window does not cross the boundary between two merged
+ * adjacent ranges unless bSpanRanges is set.
+ *
+ * @param   self        The pointer to the RegionCollector structure.
+ * @param   pPEInfo     The pointer to the to be analyzed PEInfo structure.
+ *
+ * @return              0: The ranges are normalized successfully.
+ *                    < 0: Exception occurs while memory allocation.
+ */
+int RCNormalizeRanges(RegionCollector *self, PEInfo *pPEInfo);
+
+
 #endif
@@ -11,6 +11,7 @@ typedef struct _Report {
     int (*logEntropyDistribution) (struct _Report*, PEInfo*, const char*, const char*);
     int (*logNGramModel)          (struct _Report*, NGram*,  const char*, const char*);
     int (*plotNGramModel)         (struct _Report*, NGram*, const char*, const char*);
+    int (*logNGramWindows)        (struct _Report*, NGram*, const char*, const char*);
 } Report;
 
 
@@ -93,4 +94,18 @@ int ReportLogNGramModel(Report *self, NGram *pNGram, const char *cszDirPath, con
  */
 int ReportPlotNGramModel(Report *self, NGram *pNGram, const char *cszDirPath, const char *cszSampleName);
 
+
+/**
+ * This function logs the top-token summary of each profile window of n-gram model.
+ *
+ * @param   self            The pointer to the Report structure.
+ * @param   pNGram          The pointer to the NGram structure.
+ * @param   cszDirPath      The path to the output folder.
+ * @param   cszSampleName   The name of the input sample.
+ *
+ * @return              0: The report is generated successfully.
+ *                    < 0: Exception occurs while file creation or file writing.
+ */
+int ReportLogNGramWindows(Report *self, NGram *pNGram, const char *cszDirPath, const char *cszSampleName);
+
 #endif
@@ -0,0 +1,107 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "util.h"
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+/* The pipeline phases which are timed individually. */
+#define STATS_PHASE_PARSE_HEADERS           (0)
+#define STATS_PHASE_SECTION_ENTROPY         (1)
+#define STATS_PHASE_SELECT_FEATURES         (2)
+#define STATS_PHASE_COLLECT_TOKENS          (3)
+#define STATS_PHASE_GENERATE_MODEL          (4)
+#define STATS_PHASE_GENERATE_REPORT         (5)
+#define STATS_PHASE_COUNT                   (6)
+
+/* The engine counters. */
+#define STATS_COUNTER_BYTES_READ            (0)     /* The number of bytes read from samples. */
+#define STATS_COUNTER_READ_CALLS            (1)     /* The number of issued read requests. */
+#define STATS_COUNTER_SEEK_CALLS            (2)     /* The number of issued seek requests. */
+#define STATS_COUNTER_TOKENS                (3)     /* The number of emitted n-gram tokens. */
+#define STATS_COUNTER_DISTINCT_TOKENS       (4)     /* The number of distinct n-gram tokens. */
+#define STATS_COUNTER_ALLOCS                (5)     /* The number of heap allocation requests. */
+#define STATS_COUNTER_SKIPPED_BYTES         (6)     /* The number of constant bytes skipped by the token collection. */
+#define STATS_COUNTER_DEDUP_BYTES           (7)     /* The number of bytes in the repeated blocks counted by their copies. */
+#define STATS_COUNTER_CACHE_HITS            (8)     /* The number of entries loaded from the result cache. */
+#define STATS_COUNTER_CACHE_MISSES          (9)     /* The number of entries missing from the result cache. */
+#define STATS_COUNTER_COUNT                 (10)
+
+
+/*===========================================================================*
+ *                    Wrapper for instrumentation hooks                      *
+ *===========================================================================*/
+/*
+ * The hooks are compiled to nothing when the ENABLE_STATS build option is off,
+ * so the instrumented loops pay nothing for them.
+ */
+#if defined(ENABLE_STATS)
+    #define StatsCount(idx, val)        __atomic_fetch_add(&(_statsGlobal.arrCounter[idx]), (val), __ATOMIC_RELAXED)
+    #define StatsPhaseBegin(idx)        StatsBeginPhase(idx)
+    #define StatsPhaseEnd(idx)          StatsEndPhase(idx)
+    #define StatsSampleEnd()            StatsFinishSample()
+#else
+    #define StatsCount(idx, val)
+    #define StatsPhaseBegin(idx)
+    #define StatsPhaseEnd(idx)
+    #define StatsSampleEnd()
+#endif
+
+
+/* Structure to accumulate the counters and the phase timing of all the analyzed samples. */
+typedef struct _Stats {
+    ulong   ulNumSamples;
+    ulong   arrCounter[STATS_COUNTER_COUNT];
+    ulong   arrPhaseCalls[STATS_PHASE_COUNT];
+    ulong   arrPhaseNsec[STATS_PHASE_COUNT];
+} Stats;
+
+
+/* The global statistics shared by the engine and the plugins. */
+extern Stats _statsGlobal;
+
+/* The names of the pipeline phases. */
+extern const char *_arrStatsPhaseName[STATS_PHASE_COUNT];
+
+
+/**
+ * This function returns the current time of the monotonic clock.
+ *
+ * @return                  The timestamp in nanoseconds.
+ */
+ulong StatsNow();
+
+
+/**
+ * This function marks the beginning of the specified pipeline phase.
+ *
+ * @param   idxPhase        The index of the phase.
+ */
+void StatsBeginPhase(int idxPhase);
+
+
+/**
+ * This function marks the end of the specified pipeline phase and accumulates
+ * the elapsed time.
+ *
+ * @param   idxPhase        The index of the phase.
+ */
+void StatsEndPhase(int idxPhase);
+
+
+/**
+ * This function marks the end of the analysis for one sample.
+ */
+void StatsFinishSample();
+
+
+/**
+ * This function dumps the accumulated statistics as a JSON object.
+ *
+ * @param   fp              The file pointer to the output stream.
+ */
+void StatsDump(FILE *fp);
+
+#endif
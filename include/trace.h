@@ -0,0 +1,90 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "util.h"
+#include "stats.h"
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+/* The number of events kept by the ring buffer of each thread. */
+#define TRACE_RING_SIZE                     (1 << 16)
+
+/* The event types defined by the Chrome trace-event format. */
+#define TRACE_EVENT_BEGIN                   'B'
+#define TRACE_EVENT_END                     'E'
+
+
+/*===========================================================================*
+ *                    Wrapper for instrumentation hooks                      *
+ *===========================================================================*/
+/*
+ * The hooks cost a single branch when the recorder is not activated, and they
+ * are compiled to nothing when the ENABLE_TRACE build option is off. Each hook
+ * is a single statement, so it is safe inside an unbraced if/else.
+ */
+#if defined(ENABLE_TRACE)
+    #define TraceBegin(name)            do { if (_bTraceOn) TraceRecord(name, TRACE_EVENT_BEGIN); } while (0)
+    #define TraceEnd(name)              do { if (_bTraceOn) TraceRecord(name, TRACE_EVENT_END); } while (0)
+#else
+    #define TraceBegin(name)            do { } while (0)
+    #define TraceEnd(name)              do { } while (0)
+#endif
+
+
+/* Structure to record a single begin or end event. */
+typedef struct _TraceEvent {
+    const char  *cszName;
+    ulong       ulTimestamp;
+    char        cType;
+} TraceEvent;
+
+
+/* Structure to store the event ring of a thread. Only the owner thread writes it. */
+typedef struct _TraceBuffer {
+    ulong       ulTid;
+    ulong       ulNumEvents;
+    TraceEvent  *arrEvent;
+    struct _TraceBuffer *pNext;
+} TraceBuffer;
+
+
+/* The switch to activate the recorder. */
+extern bool _bTraceOn;
+
+
+/**
+ * This function activates the trace recorder.
+ */
+void TraceStart();
+
+
+/**
+ * This function records an event into the ring buffer of the calling thread.
+ * The buffer is created and registered at the first event of the thread.
+ *
+ * @param   cszName         The name of the traced task. It must be a static string.
+ * @param   cType           The event type.
+ */
+void TraceRecord(const char *cszName, char cType);
+
+
+/**
+ * This function dumps the recorded events of all the threads with the Chrome
+ * trace-event JSON format. It must be called after all the traced threads finish.
+ *
+ * @param   cszPath         The path to the output file.
+ *
+ * @return                  0: The trace is dumped successfully.
+ *                        < 0: Exception occurs while file accessing.
+ */
+int TraceDump(const char *cszPath);
+
+
+/**
+ * This function releases the ring buffers of all the threads.
+ */
+void TraceStop();
+
+#endif
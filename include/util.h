@@ -10,6 +10,8 @@
     #include <sys/stat.h>
     #include <dirent.h>
     #include <dlfcn.h>
+    #include <pthread.h>
+    #include <fcntl.h>
 #endif
 
 #include <stdio.h>
@@ -21,6 +23,8 @@
 #include <setjmp.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <stdint.h>
 #include <time.h>
 
 
@@ -44,6 +48,7 @@ typedef unsigned long   ulong;
 #define Free(p0)                    MemFree(p0)
 
 #define Fopen(p0, p1)               FileOpen (p0, p1,         __FILE__, __LINE__, __FUNCTION__)
+#define Fmemopen(p0, p1, p2)        FileMemOpen(p0, p1, p2,   __FILE__, __LINE__, __FUNCTION__)
 #define Fread(p0, p1, p2, p3)       FileRead (p0, p1, p2, p3, __FILE__, __LINE__, __FUNCTION__)
 #define Fwrite(p0, p1, p2, p3)      FileWrite(p0, p1, p2, p3, __FILE__, __LINE__, __FUNCTION__)
 #define Fseek(p0, p1, p2)           FileSeek (p0, p1, p2,     __FILE__, __LINE__, __FUNCTION__)
@@ -75,10 +80,14 @@ typedef unsigned long   ulong;
 #define BUF_SIZE_SMALL              (128)
 #define BUF_SIZE_TINY               (8)
 
+/* Maximum number of call sites tracked by the allocation accounting. */
+#define MEM_ACCOUNT_SITE_COUNT      (256)
+
 /* Maximum number of lines in a single file writing operation. */
 #define BATCH_WRITE_LINE_COUNT      (80)
 
 /* Number of bytes for each data unit. */
+#define DATATYPE_SIZE_QWORD         (8)
 #define DATATYPE_SIZE_DWORD         (4)
 #define DATATYPE_SIZE_WORD          (2)
 
@@ -95,24 +104,70 @@ typedef unsigned long   ulong;
 #define PE_HEADER_OFF_NUMBER_OF_SECTIONS    (0x6)   /* The number of sections. */
 #define PE_HEADER_OFF_SIZE_OF_OPT_HEADER    (0x14)  /* The size of PE optional header. */
 
+/* PE optional header related information. The offsets of the image base and the data
+   directories depend on the magic. */
+#define OPT_HEADER_MAX_SIZE                 (0xf0)  /* The size of PE32+ optional header with all the directories. */
+#define OPT_HEADER_OFF_MAGIC                (0x0)   /* The magic of PE32 or PE32+. */
+#define OPT_HEADER_OFF_ENTRY_POINT          (0x10)  /* The RVA of the entry point. */
+#define OPT_HEADER_OFF_IMAGE_BASE_PE32      (0x1c)  /* The preferred image base of PE32, a dword. */
+#define OPT_HEADER_OFF_IMAGE_BASE_PE32_PLUS (0x18)  /* The preferred image base of PE32+, a qword. */
+#define OPT_HEADER_OFF_SIZE_OF_IMAGE        (0x38)  /* The size of the mapped image. */
+#define OPT_HEADER_OFF_NUM_DIRS_PE32        (0x5c)  /* The number of data directories of PE32. */
+#define OPT_HEADER_OFF_NUM_DIRS_PE32_PLUS   (0x6c)  /* The number of data directories of PE32+. */
+#define OPT_HEADER_OFF_DIRS_PE32            (0x60)  /* The data directories of PE32. */
+#define OPT_HEADER_OFF_DIRS_PE32_PLUS       (0x70)  /* The data directories of PE32+. */
+#define OPT_HEADER_MAGIC_PE32               (0x10b)
+#define OPT_HEADER_MAGIC_PE32_PLUS          (0x20b)
+#define DATA_DIR_PER_ENTRY_SIZE             (0x8)   /* The RVA and the size of each data directory. */
+#define DATA_DIR_MAX_ENTRIES                (16)    /* The number of the defined data directories. */
+
 /* Section header related information. */
 #define SECTION_HEADER_PER_ENTRY_SIZE       (0x28)  /* The size of each section entry. */
+#define SECTION_HEADER_OFF_VIRTUAL_SIZE     (0x8)   /* The size of the section when mapped. */
+#define SECTION_HEADER_OFF_VIRTUAL_ADDRESS  (0xc)   /* The RVA of the section. */
 #define SECTION_HEADER_OFF_RAW_SIZE         (0x10)  /* The raw size of the section. */
 #define SECTION_HEADER_OFF_RAW_OFFSET       (0x14)  /* The raw offset of the section. */
 #define SECTION_HEADER_OFF_CHARS            (0x24)  /* The characteristics of the section*/
 #define SECTION_HEADER_SECTION_NAME_SIZE    (0x8)   /* The maximum length of the section name. */
+#define SECTION_CHARS_CNT_CODE              (0x00000020)    /* The section contains code. */
+#define SECTION_CHARS_MEM_EXECUTE           (0x20000000)    /* The section can be executed. */
 
 /* Criterions for section entroy calculation. */
 #define ENTROPY_BLK_SIZE                    (256)   /* The required number of bytes for entropy calculation. */
 #define ENTROPY_LOG_BASE                    (2)     /* The basis of logarithm for entropy calculation. */
+#define ENTROPY_NUM_LEVELS                  (5)     /* The number of levels of the entropy pyramid. */
+#define ENTROPY_PYRAMID_BLK_SIZES           {ENTROPY_BLK_SIZE, 1024, 4096, 65536, 0}
+                                                    /* The block size of each level, 0 for the whole section. */
+#define ENTROPY_TASK_SIZE                   (256 * 1024)
+                                                    /* The span of each entropy task. It must be a multiple of
+                                                       the pyramid block sizes except the whole section level. */
+#define ENTROPY_MAX_WORKERS                 (16)    /* The maximum number of entropy threads. */
+#define ENTROPY_PARALLEL_MIN_SIZE           (1024 * 1024)
+                                                    /* The minimum total raw size to start the entropy threads. */
+#define ENTROPY_NUM_SAMPLES                 (32)    /* The number of blocks sampled to estimate a section lazily. */
+#define ENTROPY_RANK_MARGIN                 (0.5)   /* The estimated sections within this margin of the best one
+                                                       are measured before the ranking is decided. */
 
 /* Criterions for n-gram calculation. */
 #define UNI_GRAM_MAX_VALUE                  (256)   /* The maximum value of n-gram with dimension one. */
+#define NGRAM_MAX_DIMENSION                 (4)     /* The maximum supported dimension. */
+#define NGRAM_NUM_SUB_HISTS                 (8)     /* The histogram copies of the vector kernels, one per bit offset. */
+#define NGRAM_SUB_HIST_MAX_DIMENSION        (1)     /* The maximum dimension whose replicated histograms fit in L1. */
+#define NGRAM_PARTITION_DIMENSION           (3)     /* The dimension counted through the radix partitions. */
+#define NGRAM_PARTITION_MIN_BYTES           (1024 * 1024)   /* The minimum selected bytes for the radix partitions. */
+#define NGRAM_NUM_PARTITIONS                (256)   /* The partitions, one per high byte of a token. */
+#define NGRAM_PARTITION_SIZE                (65536) /* The buffered tokens of each partition, as many as its slice. */
+#define NGRAM_DEDUP_BLK_SIZE                (256)   /* The size of the blocks compared by the deduplication. */
+#define NGRAM_DEDUP_MAX_SLOTS               (65536) /* The maximum slots of the deduplication table. At most 3/4
+                                                       of them keep a distinct block. */
+#define NGRAM_PROFILE_TOP                   (8)     /* The top tokens summarized for each window of the profile. */
+#define NGRAM_PROFILE_MAX_SIZE              (256 * 1024 * 1024) /* The maximum window size, so the token counts fit in 32 bits. */
 
 /* The names of each kinds of reports. */
 #define REPORT_POSTFIX_TXT_SECTION_ENTROPY   "_entropy.txt"
 #define REPORT_POSTFIX_TXT_NGRAM_MODEL       "_ngram_model.txt"
 #define REPORT_POSTFIX_PNG_NGRAM_MODEL       "_ngram_model.png"
+#define REPORT_POSTFIX_TXT_NGRAM_WINDOWS     "_ngram_windows.txt"
 #define REPORT_POSTFIX_GNU_PLOT_SCRIPT       "_plot_script.gnu"
 
 /* The bitmasks of each kinds of reports. */
@@ -150,6 +205,20 @@ typedef unsigned long   ulong;
 #define OPT_LONG_REPORT                     "report"
 #define OPT_LONG_REGION                     "region"
 #define OPT_LONG_MODEL                      "model"
+#define OPT_LONG_STATS                      "stats"
+#define OPT_LONG_TRACE                      "trace"
+#define OPT_LONG_PERF                       "perf-counters"
+#define OPT_LONG_REGION_ARG                 "region-arg"
+#define OPT_LONG_SPAN_RANGES                "span-ranges"
+#define OPT_LONG_PREFETCH                   "prefetch"
+#define OPT_LONG_PER_SECTION                "per-section"
+#define OPT_LONG_SLIDE_ENTROPY              "slide-entropy"
+#define OPT_LONG_LAZY_ENTROPY               "lazy-entropy"
+#define OPT_LONG_DEDUP_BLOCKS               "dedup-blocks"
+#define OPT_LONG_CACHE                      "cache"
+#define OPT_LONG_WINDOW                     "window"
+#define OPT_LONG_STEP                       "step"
+#define OPT_LONG_CARVE                      "carve"
 #define OPT_HELP                            'h'
 #define OPT_INPUT                           'i'
 #define OPT_OUTPUT                          'o'
@@ -157,6 +226,20 @@ typedef unsigned long   ulong;
 #define OPT_REPORT                          't'
 #define OPT_REGION                          'r'
 #define OPT_MODEL                           'm'
+#define OPT_STATS                           's'
+#define OPT_TRACE                           'c'
+#define OPT_PERF                            'p'
+#define OPT_REGION_ARG                      'a'
+#define OPT_SPAN_RANGES                     'g'
+#define OPT_PREFETCH                        'f'
+#define OPT_PER_SECTION                     'x'
+#define OPT_SLIDE_ENTROPY                   'l'
+#define OPT_LAZY_ENTROPY                    'z'
+#define OPT_DEDUP_BLOCKS                    'u'
+#define OPT_CACHE                           'k'
+#define OPT_WINDOW                          'w'
+#define OPT_STEP                            'j'
+#define OPT_CARVE                           'e'
 
 /* The names of default plugins. */
 #define LIB_DEFAULT_MAX_ENTROPY_SEC         "Region_MaxEntropySection"
@@ -194,8 +277,19 @@ void* MemRealloc(void*, size_t, const char*, const int, const char*);
 void MemFree(void*);
 
 
+/**
+ * This function dumps the allocation accounting (live bytes, peak bytes and the
+ * counts per call site) as a JSON object. It dumps null if the engine is built
+ * without the ENABLE_MEM_ACCOUNT option.
+ *
+ * @param   fp              The file pointer to the output stream.
+ */
+void MemAccountDump(FILE *fp);
+
+
 /* Wrapper for file manipulation utilities. */
 FILE* FileOpen(const char*, const char*, const char*, const int, const char*);
+FILE* FileMemOpen(void*, size_t, const char*, const char*, const int, const char*);
 size_t FileRead(void*, size_t, size_t, FILE*, const char*, const int, const char*);
 size_t FileWrite(void*, size_t, size_t, FILE*, const char*, const int, const char*);
 int FileSeek(FILE*, long, int, const char*, const int, const char*);
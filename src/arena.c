@@ -0,0 +1,137 @@
+#include "arena.h"
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/* The size of chunk header padded to keep the payload aligned. */
+#define ARENA_HEADER_SIZE   ((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+/* The starting address of the chunk payload. */
+#define ARENA_PAYLOAD(p)    ((uchar*)(p) + ARENA_HEADER_SIZE)
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+void ArenaInit(Arena *self) {
+
+    self->pHead = NULL;
+    self->pCurr = NULL;
+    self->pLarge = NULL;
+
+    return;
+}
+
+void ArenaDeinit(Arena *self) {
+    ArenaChunk *pChunk, *pNext;
+
+    ArenaReset(self);
+
+    pChunk = self->pHead;
+    while (pChunk != NULL) {
+        pNext = pChunk->pNext;
+        Free(pChunk);
+        pChunk = pNext;
+    }
+    self->pHead = NULL;
+    self->pCurr = NULL;
+
+    return;
+}
+
+void* ArenaAlloc(Arena *self, size_t nLength, const char *cszPathSrc, const int iLineNo, const char *cszFunc) {
+    void        *ptr;
+    ArenaChunk  *pChunk;
+
+    assert(nLength > 0);
+    nLength = (nLength + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+
+    /* Serve the large request with a dedicated chunk. */
+    if (nLength > ARENA_LARGE_THRESHOLD) {
+        pChunk = (ArenaChunk*)MemAlloc(ARENA_HEADER_SIZE + nLength, cszPathSrc, iLineNo, cszFunc);
+        pChunk->nSize = nLength;
+        pChunk->nUsed = nLength;
+        pChunk->pNext = self->pLarge;
+        self->pLarge = pChunk;
+        return ARENA_PAYLOAD(pChunk);
+    }
+
+    /* Bump the pointer of the current chunk, or move to the next retained one. */
+    pChunk = self->pCurr;
+    while ((pChunk != NULL) && ((pChunk->nSize - pChunk->nUsed) < nLength))
+        pChunk = pChunk->pNext;
+
+    /* Append a new regular chunk if all the retained ones are exhausted. */
+    if (pChunk == NULL) {
+        pChunk = (ArenaChunk*)MemAlloc(ARENA_HEADER_SIZE + ARENA_CHUNK_SIZE, cszPathSrc, iLineNo, cszFunc);
+        pChunk->nSize = ARENA_CHUNK_SIZE;
+        pChunk->nUsed = 0;
+        if (self->pCurr == NULL) {
+            pChunk->pNext = self->pHead;
+            self->pHead = pChunk;
+        } else {
+            pChunk->pNext = self->pCurr->pNext;
+            self->pCurr->pNext = pChunk;
+        }
+    }
+    self->pCurr = pChunk;
+
+    ptr = ARENA_PAYLOAD(pChunk) + pChunk->nUsed;
+    pChunk->nUsed += nLength;
+
+    return ptr;
+}
+
+void* ArenaCalloc(Arena *self, size_t nLength, size_t nSize, const char *cszPathSrc, const int iLineNo,
+                  const char *cszFunc) {
+    void        *ptr;
+    size_t      nTotal;
+    ArenaChunk  *pChunk;
+
+    assert(nLength > 0);
+
+    /* Reject the array whose size wraps around, including the alignment and the chunk header. */
+    if ((nSize != 0) && (nLength > (SIZE_MAX - ARENA_HEADER_SIZE - ARENA_ALIGNMENT) / nSize))
+        throw(EXCEPT_MEM_ALLOC);
+    nTotal = nLength * nSize;
+    nTotal = (nTotal + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+
+    /* Let the system provide the zero pages for the large array. */
+    if (nTotal > ARENA_LARGE_THRESHOLD) {
+        pChunk = (ArenaChunk*)MemCalloc(ARENA_HEADER_SIZE + nTotal, 1, cszPathSrc, iLineNo, cszFunc);
+        pChunk->nSize = nTotal;
+        pChunk->nUsed = nTotal;
+        pChunk->pNext = self->pLarge;
+        self->pLarge = pChunk;
+        return ARENA_PAYLOAD(pChunk);
+    }
+
+    ptr = ArenaAlloc(self, nTotal, cszPathSrc, iLineNo, cszFunc);
+    memset(ptr, 0, nTotal);
+
+    return ptr;
+}
+
+void ArenaReset(Arena *self) {
+    ArenaChunk *pChunk, *pNext;
+
+    /* Return the dedicated chunks. */
+    pChunk = self->pLarge;
+    while (pChunk != NULL) {
+        pNext = pChunk->pNext;
+        Free(pChunk);
+        pChunk = pNext;
+    }
+    self->pLarge = NULL;
+
+    /* Rewind the regular chunks. */
+    pChunk = self->pHead;
+    while (pChunk != NULL) {
+        pChunk->nUsed = 0;
+        pChunk = pChunk->pNext;
+    }
+    self->pCurr = self->pHead;
+
+    return;
+}
@@ -0,0 +1,194 @@
+#include "cache.h"
+
+
+/*===========================================================================*
+ *                  Simulation for private variables                         *
+ *===========================================================================*/
+/* Structure to record the header of a cache entry. The key is repeated, so an entry
+   renamed by hand or hit by a file name collision is rejected. */
+typedef struct _CacheHeader {
+    char    szMagic[CACHE_MAGIC_SIZE];
+    uint    uiVersion, uiReserved;
+    ulong   arrHash[2];
+    ulong   ulSize, ulPayload;
+} CacheHeader;
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function mixes the bits of a hash lane.
+ *
+ * @param   ulValue         The lane value.
+ *
+ * @return                  The mixed value.
+ */
+ulong _CacheMix(ulong ulValue);
+
+
+/**
+ * This function composes the path of a cache entry.
+ *
+ * @param   szPath          The buffer which can hold BUF_SIZE_MID + 1 characters.
+ * @param   cszDir          The path to the cache folder.
+ * @param   pKey            The pointer to the key of the section.
+ * @param   cszKind         The kind of the payload.
+ *
+ * @return                  0: The path is composed successfully.
+ *                        < 0: The path is too long.
+ */
+int _CacheComposePath(char *szPath, const char *cszDir, const CacheKey *pKey, const char *cszKind);
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+int CacheHashRange(CacheKey *pKey, Reader *pReader, ulong ulOstBgn, ulong ulSize, uchar *uszBuf) {
+    ulong   ulOst, ulWord, arrLane[2];
+    ssize_t nRead, i;
+    size_t  nExpt;
+    uchar   *uszChunk;
+    uchar   uszTail[2 * sizeof(ulong)];
+
+    arrLane[0] = 0x243F6A8885A308D3UL;
+    arrLane[1] = 0x13198A2E03707344UL;
+    for (ulOst = 0 ; ulOst < ulSize ; ulOst += nRead) {
+        nExpt = ((ulSize - ulOst) < CACHE_HASH_CHUNK_SIZE)? (ulSize - ulOst) : CACHE_HASH_CHUNK_SIZE;
+        nRead = ReaderReadAt(pReader, ulOstBgn + ulOst, nExpt, uszBuf, &uszChunk);
+        if (nRead != (ssize_t)nExpt)
+            return -1;
+
+        /* Each lane takes every other word. The last partial pair is padded with zeros. */
+        for (i = 0 ; i + (ssize_t)sizeof(uszTail) <= nRead ; i += sizeof(uszTail)) {
+            memcpy(&ulWord, uszChunk + i, sizeof(ulong));
+            arrLane[0] = ((arrLane[0] ^ ulWord) * 0x9E3779B97F4A7C15UL);
+            arrLane[0] = (arrLane[0] << 31) | (arrLane[0] >> 33);
+            memcpy(&ulWord, uszChunk + i + sizeof(ulong), sizeof(ulong));
+            arrLane[1] = ((arrLane[1] ^ ulWord) * 0xC2B2AE3D27D4EB4FUL);
+            arrLane[1] = (arrLane[1] << 29) | (arrLane[1] >> 35);
+        }
+        if (i < nRead) {
+            memset(uszTail, 0, sizeof(uszTail));
+            memcpy(uszTail, uszChunk + i, nRead - i);
+            memcpy(&ulWord, uszTail, sizeof(ulong));
+            arrLane[0] = ((arrLane[0] ^ ulWord) * 0x9E3779B97F4A7C15UL);
+            memcpy(&ulWord, uszTail + sizeof(ulong), sizeof(ulong));
+            arrLane[1] = ((arrLane[1] ^ ulWord) * 0xC2B2AE3D27D4EB4FUL);
+        }
+    }
+
+    /* Let each half of the key depend on both lanes and the size. */
+    arrLane[0] ^= ulSize;
+    arrLane[1] ^= ulSize * 0x9E3779B97F4A7C15UL;
+    pKey->arrHash[0] = _CacheMix(arrLane[0] + _CacheMix(arrLane[1]));
+    pKey->arrHash[1] = _CacheMix(arrLane[1] ^ pKey->arrHash[0]);
+    pKey->ulSize = ulSize;
+
+    return 0;
+}
+
+void* CacheLoad(const char *cszDir, const CacheKey *pKey, const char *cszKind, Arena *pArena, size_t nMaxSize,
+                size_t *pnSize) {
+    char        szPath[BUF_SIZE_MID + 1];
+    void        *vpData;
+    FILE        *fp;
+    CacheHeader header;
+
+    if (_CacheComposePath(szPath, cszDir, pKey, cszKind) != 0)
+        return NULL;
+
+    /* The entry is accessed without the throwing wrappers, since the callers are
+       already inside their own try blocks. A broken entry is just a miss. */
+    vpData = NULL;
+    fp = fopen(szPath, "rb");
+    if (fp == NULL)
+        goto EXIT;
+    if (fread(&header, sizeof(CacheHeader), 1, fp) != 1)
+        goto EXIT;
+    if ((memcmp(header.szMagic, CACHE_MAGIC, CACHE_MAGIC_SIZE) != 0) || (header.uiVersion != CACHE_VERSION) ||
+        (header.arrHash[0] != pKey->arrHash[0]) || (header.arrHash[1] != pKey->arrHash[1]) ||
+        (header.ulSize != pKey->ulSize) || (header.ulPayload > nMaxSize))
+        goto EXIT;
+
+    vpData = Amalloc(pArena, (header.ulPayload == 0)? 1 : header.ulPayload);
+    if (fread(vpData, 1, header.ulPayload, fp) != header.ulPayload) {
+        vpData = NULL;
+        goto EXIT;
+    }
+    *pnSize = header.ulPayload;
+
+EXIT:
+    if (fp != NULL)
+        fclose(fp);
+    StatsCount((vpData != NULL)? STATS_COUNTER_CACHE_HITS : STATS_COUNTER_CACHE_MISSES, 1);
+    return vpData;
+}
+
+int CacheStore(const char *cszDir, const CacheKey *pKey, const char *cszKind, const void *vpData, size_t nSize) {
+    int         rc;
+    char        szPath[BUF_SIZE_MID + 1], szPathTemp[BUF_SIZE_MID + 1];
+    FILE        *fp;
+    CacheHeader header;
+
+    if (_CacheComposePath(szPath, cszDir, pKey, cszKind) != 0)
+        return -1;
+    if (snprintf(szPathTemp, BUF_SIZE_MID + 1, "%s.%d.%lx.tmp", szPath, getpid(), (ulong)pthread_self()) > BUF_SIZE_MID)
+        return -1;
+
+    memset(&header, 0, sizeof(CacheHeader));
+    memcpy(header.szMagic, CACHE_MAGIC, CACHE_MAGIC_SIZE);
+    header.uiVersion = CACHE_VERSION;
+    header.arrHash[0] = pKey->arrHash[0];
+    header.arrHash[1] = pKey->arrHash[1];
+    header.ulSize = pKey->ulSize;
+    header.ulPayload = nSize;
+
+    /* The same as CacheLoad(), the entry is written without the throwing wrappers. */
+    rc = 0;
+    fp = fopen(szPathTemp, "wb");
+    if (fp == NULL)
+        rc = -1;
+    else {
+        if ((fwrite(&header, sizeof(CacheHeader), 1, fp) != 1) || (fwrite(vpData, 1, nSize, fp) != nSize))
+            rc = -1;
+        if (fclose(fp) != 0)
+            rc = -1;
+        if (rc == 0)
+            rc = rename(szPathTemp, szPath);
+        if (rc != 0)
+            unlink(szPathTemp);
+    }
+    if (rc != 0)
+        Log1("The cache entry cannot be stored (%s).\n", szPath);
+
+    return rc;
+}
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+ulong _CacheMix(ulong ulValue) {
+
+    ulValue ^= ulValue >> 33;
+    ulValue *= 0xFF51AFD7ED558CCDUL;
+    ulValue ^= ulValue >> 33;
+    ulValue *= 0xC4CEB9FE1A85EC53UL;
+    ulValue ^= ulValue >> 33;
+
+    return ulValue;
+}
+
+int _CacheComposePath(char *szPath, const char *cszDir, const CacheKey *pKey, const char *cszKind) {
+    int iLen;
+
+    if (cszDir[strlen(cszDir) - 1] == OS_PATH_SEPARATOR)
+        iLen = snprintf(szPath, BUF_SIZE_MID + 1, "%s%016lx%016lx_%lx.%s", cszDir,
+                        pKey->arrHash[0], pKey->arrHash[1], pKey->ulSize, cszKind);
+    else
+        iLen = snprintf(szPath, BUF_SIZE_MID + 1, "%s%c%016lx%016lx_%lx.%s", cszDir, OS_PATH_SEPARATOR,
+                        pKey->arrHash[0], pKey->arrHash[1], pKey->ulSize, cszKind);
+
+    return (iLen > BUF_SIZE_MID)? -1 : 0;
+}
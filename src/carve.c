@@ -0,0 +1,249 @@
+#include "carve.h"
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function reads a little-endian integer from the mapped input.
+ *
+ * @param   uszData         The pointer to the first byte.
+ * @param   iSize           The size of the integer in bytes.
+ *
+ * @return                  The integer value.
+ */
+ulong _CarveReadInt(const uchar *uszData, int iSize);
+
+
+/**
+ * This function validates the candidate image at the specified MZ signature and
+ * records it if its headers are sound.
+ *
+ * @param   self            The pointer to the Carve structure.
+ * @param   ulOffset        The offset of the MZ signature.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the image array cannot be grown.
+ */
+void _CarveCheckCandidate(Carve *self, ulong ulOffset);
+
+
+/**
+ * This function scans the input for the MZ signatures byte by byte.
+ *
+ * @param   self            The pointer to the Carve structure.
+ * @param   ulOstBgn        The offset to start the scan.
+ * @param   ulOstEnd        The offset behind the last candidate.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the image array cannot be grown.
+ */
+void _CarveScanScalar(Carve *self, ulong ulOstBgn, ulong ulOstEnd);
+
+
+#if defined(CARVE_ENABLE_SIMD)
+
+/**
+ * This function scans the input for the MZ signatures with AVX2. Each iteration
+ * compares 32 positions against 'M' and the positions behind them against 'Z', so
+ * only the matched pairs reach the header validation.
+ *
+ * @param   self            The pointer to the Carve structure.
+ * @param   ulOstEnd        The offset behind the last candidate.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the image array cannot be grown.
+ */
+void _CarveScanAvx2(Carve *self, ulong ulOstEnd);
+
+#endif
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+int CarveOpen(Carve *self, const char *cszPath) {
+    struct stat statInput;
+
+    memset(self, 0, sizeof(Carve));
+    self->fd = open(cszPath, O_RDONLY);
+    if (self->fd < 0) {
+        Log2("The input cannot be opened (%s: %s).\n", cszPath, strerror(errno));
+        return -1;
+    }
+    if (fstat(self->fd, &statInput) != 0) {
+        Log2("The input cannot be examined (%s: %s).\n", cszPath, strerror(errno));
+        return -1;
+    }
+
+    /* An empty input has nothing to map or carve. */
+    self->ulSize = statInput.st_size;
+    if (self->ulSize == 0)
+        return 0;
+    self->uszData = (uchar*)mmap(NULL, self->ulSize, PROT_READ, MAP_PRIVATE, self->fd, 0);
+    if (self->uszData == MAP_FAILED) {
+        Log2("The input cannot be mapped (%s: %s).\n", cszPath, strerror(errno));
+        self->uszData = NULL;
+        return -1;
+    }
+
+    /* The scan streams through the whole input once. */
+    madvise(self->uszData, self->ulSize, MADV_SEQUENTIAL);
+    return 0;
+}
+
+int CarveScan(Carve *self) {
+    int     rc;
+    ulong   ulOstEnd;
+
+    if (self->ulSize < DOS_HEADER_SIZE)
+        return 0;
+
+    rc = 0;
+    ulOstEnd = self->ulSize - DOS_HEADER_SIZE + 1;
+    try {
+        self->ulCapacity = CARVE_INIT_CAPACITY;
+        self->arrImage = (CarveImage*)Malloc(sizeof(CarveImage) * self->ulCapacity);
+
+        #if defined(CARVE_ENABLE_SIMD)
+            if (__builtin_cpu_supports("avx2"))
+                _CarveScanAvx2(self, ulOstEnd);
+            else
+                _CarveScanScalar(self, 0, ulOstEnd);
+        #else
+            _CarveScanScalar(self, 0, ulOstEnd);
+        #endif
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } end_try;
+
+    /* The images are analyzed in parallel, so the access is no longer sequential. */
+    madvise(self->uszData, self->ulSize, MADV_NORMAL);
+    return rc;
+}
+
+void CarveClose(Carve *self) {
+
+    if (self->arrImage != NULL)
+        Free(self->arrImage);
+    if (self->uszData != NULL)
+        munmap(self->uszData, self->ulSize);
+    if (self->fd >= 0)
+        close(self->fd);
+
+    self->arrImage = NULL;
+    self->uszData = NULL;
+    self->fd = -1;
+    return;
+}
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+ulong _CarveReadInt(const uchar *uszData, int iSize) {
+    int     i;
+    ulong   ulValue;
+
+    ulValue = 0;
+    for (i = 1 ; i <= iSize ; i++) {
+        ulValue <<= SHIFT_RANGE_8BIT;
+        ulValue += uszData[iSize - i];
+    }
+
+    return ulValue;
+}
+
+void _CarveCheckCandidate(Carve *self, ulong ulOffset) {
+    ushort  usNumSections, usOptSize, usMagic, i;
+    ulong   ulRemain, ulPEOffset, ulTableEnd, ulImageEnd, ulRawSize, ulRawEnd;
+    uchar   *uszImage, *uszEntry;
+
+    /* Check the PE header referred by the MZ header. */
+    uszImage = self->uszData + ulOffset;
+    ulRemain = self->ulSize - ulOffset;
+    ulPEOffset = _CarveReadInt(uszImage + DOS_HEADER_OFF_PE_HEADER_OFFSET, DATATYPE_SIZE_DWORD);
+    if ((ulPEOffset < DATATYPE_SIZE_DWORD) || (ulPEOffset > CARVE_MAX_PE_OFFSET) ||
+        ((ulPEOffset + PE_HEADER_SIZE + DATATYPE_SIZE_WORD) > ulRemain))
+        return;
+    if (memcmp(uszImage + ulPEOffset, "PE\0\0", DATATYPE_SIZE_DWORD) != 0)
+        return;
+
+    /* Check the section count and the magic of the optional header. */
+    usNumSections = _CarveReadInt(uszImage + ulPEOffset + PE_HEADER_OFF_NUMBER_OF_SECTIONS, DATATYPE_SIZE_WORD);
+    usOptSize = _CarveReadInt(uszImage + ulPEOffset + PE_HEADER_OFF_SIZE_OF_OPT_HEADER, DATATYPE_SIZE_WORD);
+    usMagic = _CarveReadInt(uszImage + ulPEOffset + PE_HEADER_SIZE, DATATYPE_SIZE_WORD);
+    if ((usNumSections == 0) || (usNumSections > CARVE_MAX_SECTIONS) || (usOptSize < DATATYPE_SIZE_WORD))
+        return;
+    if ((usMagic != OPT_HEADER_MAGIC_PE32) && (usMagic != OPT_HEADER_MAGIC_PE32_PLUS))
+        return;
+
+    /* The whole section table must be in the input. */
+    ulTableEnd = ulPEOffset + PE_HEADER_SIZE + usOptSize;
+    ulImageEnd = ulTableEnd + (ulong)usNumSections * SECTION_HEADER_PER_ENTRY_SIZE;
+    if (ulImageEnd > ulRemain)
+        return;
+
+    /* Extend the image over the raw data of its sections. */
+    for (i = 0 ; i < usNumSections ; i++) {
+        uszEntry = uszImage + ulTableEnd + (ulong)i * SECTION_HEADER_PER_ENTRY_SIZE;
+        ulRawSize = _CarveReadInt(uszEntry + SECTION_HEADER_OFF_RAW_SIZE, DATATYPE_SIZE_DWORD);
+        if (ulRawSize == 0)
+            continue;
+        ulRawEnd = _CarveReadInt(uszEntry + SECTION_HEADER_OFF_RAW_OFFSET, DATATYPE_SIZE_DWORD) + ulRawSize;
+        if (ulRawEnd > ulImageEnd)
+            ulImageEnd = ulRawEnd;
+    }
+    if (ulImageEnd > ulRemain)
+        ulImageEnd = ulRemain;
+
+    if (self->ulNumImages == self->ulCapacity) {
+        self->ulCapacity <<= 1;
+        self->arrImage = (CarveImage*)Realloc(self->arrImage, sizeof(CarveImage) * self->ulCapacity);
+    }
+    self->arrImage[self->ulNumImages].ulOffset = ulOffset;
+    self->arrImage[self->ulNumImages].ulSize = ulImageEnd;
+    self->ulNumImages++;
+
+    return;
+}
+
+void _CarveScanScalar(Carve *self, ulong ulOstBgn, ulong ulOstEnd) {
+    uchar   *uszHit;
+
+    while (ulOstBgn < ulOstEnd) {
+        uszHit = (uchar*)memchr(self->uszData + ulOstBgn, 'M', ulOstEnd - ulOstBgn);
+        if (uszHit == NULL)
+            break;
+        ulOstBgn = uszHit - self->uszData;
+        if (uszHit[1] == 'Z')
+            _CarveCheckCandidate(self, ulOstBgn);
+        ulOstBgn++;
+    }
+
+    return;
+}
+
+#if defined(CARVE_ENABLE_SIMD)
+
+__attribute__((target("avx2")))
+void _CarveScanAvx2(Carve *self, ulong ulOstEnd) {
+    uint    uiHits;
+    ulong   ulOst;
+    __m256i vM, vZ, vLo, vHi;
+
+    /* The vector loop stops where the byte behind the last lane leaves the input. */
+    vM = _mm256_set1_epi8('M');
+    vZ = _mm256_set1_epi8('Z');
+    for (ulOst = 0 ; (ulOst + sizeof(__m256i) < ulOstEnd) ; ulOst += sizeof(__m256i)) {
+        vLo = _mm256_loadu_si256((const __m256i*)(self->uszData + ulOst));
+        vHi = _mm256_loadu_si256((const __m256i*)(self->uszData + ulOst + 1));
+        uiHits = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(vLo, vM), _mm256_cmpeq_epi8(vHi, vZ)));
+        while (uiHits != 0) {
+            _CarveCheckCandidate(self, ulOst + __builtin_ctz(uiHits));
+            uiHits &= uiHits - 1;
+        }
+    }
+
+    _CarveScanScalar(self, ulOst, ulOstEnd);
+    return;
+}
+
+#endif
@@ -2,4 +2,4 @@
 #include "util.h"
 
 /* The buffer stors the destination of long jump when exception occurs. */
-jmp_buf bufExcept;
+__thread jmp_buf bufExcept;
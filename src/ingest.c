@@ -0,0 +1,680 @@
+#include "ingest.h"
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function maps the rings of a new io_uring instance.
+ *
+ * @param   pRing           The pointer to the IngestRing structure.
+ *
+ * @return                  0: The rings are mapped successfully.
+ *                        < 0: io_uring is unavailable.
+ */
+int _IngestRingSetup(IngestRing *pRing);
+
+
+/**
+ * This function checks whether the kernel supports every operation used by the
+ * loader. The opcodes appeared after io_uring itself, so an older kernel may set
+ * up the rings but fail each sample with -EINVAL.
+ *
+ * @param   fd              The file descriptor of the io_uring instance.
+ *
+ * @return                  0: All the operations are supported.
+ *                        < 0: The kernel cannot be probed or lacks an operation.
+ */
+int _IngestRingProbe(int fd);
+
+
+/**
+ * This function unmaps the rings and closes the io_uring instance.
+ *
+ * @param   pRing           The pointer to the IngestRing structure.
+ */
+void _IngestRingTeardown(IngestRing *pRing);
+
+
+/**
+ * This function queues the next operation of the sample according to its stage.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ * @param   pSample         The pointer to the sample in flight.
+ */
+void _IngestRingQueue(Ingest *self, IngestSample *pSample);
+
+
+/**
+ * This function submits the queued operations and reaps the completions. It
+ * waits for at least one completion if bWait is set.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ * @param   bWait           Whether to wait for a completion.
+ *
+ * @return                  0: The operations are submitted successfully.
+ *                        < 0: io_uring_enter() fails.
+ */
+int _IngestRingPoll(Ingest *self, bool bWait);
+
+
+/**
+ * This function advances the sample to its next stage with the completion result.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ * @param   pSample         The pointer to the completed sample.
+ * @param   iResult         The result of the completed operation.
+ */
+void _IngestRingAdvance(Ingest *self, IngestSample *pSample, int iResult);
+
+
+/**
+ * This function is the body of the fallback loader thread.
+ *
+ * @param   vpIngest        The pointer to the Ingest structure.
+ *
+ * @return                  Always NULL.
+ */
+void* _IngestWorker(void *vpIngest);
+
+
+/**
+ * This function assigns the next path to a free slot.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ *
+ * @return                  The pointer to the assigned slot, or NULL if there is
+ *                          no free slot or no remaining path.
+ */
+IngestSample* _IngestAssign(Ingest *self);
+
+
+/**
+ * This function appends the sample to the ready list.
+ *
+ * @param   self            The pointer to the Ingest structure.
+ * @param   pSample         The pointer to the loaded sample.
+ */
+void _IngestFinish(Ingest *self, IngestSample *pSample);
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+int IngestOpen(Ingest *self, const char *cszPathDir) {
+    int             rc, i, iLenPath;
+    ulong           ul, ulCapacity;
+    char            **arrPath;
+    DIR * volatile  dir;
+    struct dirent   *entry;
+
+    memset(self, 0, sizeof(Ingest));
+    self->ring.fd = -1;
+    for (i = 0 ; i < INGEST_QUEUE_DEPTH ; i++)
+        self->arrSlot[i].fd = -1;
+
+    /* The buffers are handled with the plain allocator because they are released
+       out of order and may be allocated by the loader threads. The directory handle
+       is volatile since it is still closed after Readdir() throws. */
+    rc = 0;
+    dir = NULL;
+    ulCapacity = 0;
+    iLenPath = strlen(cszPathDir);
+    try {
+        dir = Opendir(cszPathDir);
+        while ((entry = Readdir(dir)) != NULL) {
+            if ((entry->d_type != DT_REG) && (entry->d_type != DT_UNKNOWN))
+                continue;
+            if ((iLenPath + strlen(entry->d_name) + 1) > BUF_SIZE_MID) {
+                Log1("The sample path is too long (%s).\n", entry->d_name);
+                continue;
+            }
+
+            if (self->ulNumPaths == ulCapacity) {
+                ulCapacity = (ulCapacity == 0)? BUF_SIZE_SMALL : (ulCapacity * 2);
+                arrPath = (char**)realloc(self->arrPath, sizeof(char*) * ulCapacity);
+                if (arrPath == NULL) {
+                    rc = -1;
+                    break;
+                }
+                self->arrPath = arrPath;
+            }
+            self->arrPath[self->ulNumPaths] = (char*)malloc(BUF_SIZE_MID + 1);
+            if (self->arrPath[self->ulNumPaths] == NULL) {
+                rc = -1;
+                break;
+            }
+            if (cszPathDir[iLenPath - 1] == OS_PATH_SEPARATOR)
+                sprintf(self->arrPath[self->ulNumPaths], "%s%s", cszPathDir, entry->d_name);
+            else
+                sprintf(self->arrPath[self->ulNumPaths], "%s%c%s", cszPathDir, OS_PATH_SEPARATOR, entry->d_name);
+            self->ulNumPaths++;
+        }
+    } catch(EXCEPT_IO_DIR_OPEN) {
+        rc = -1;
+    } catch(EXCEPT_IO_DIR_READ) {
+        rc = -1;
+    } end_try;
+
+    if (dir != NULL)
+        Closedir(dir);
+    if (rc != 0) {
+        for (ul = 0 ; ul < self->ulNumPaths ; ul++)
+            free(self->arrPath[ul]);
+        if (self->arrPath != NULL)
+            free(self->arrPath);
+        self->arrPath = NULL;
+        self->ulNumPaths = 0;
+        return rc;
+    }
+
+    /* Chain all the slots to the free list. */
+    for (i = INGEST_QUEUE_DEPTH - 1 ; i >= 0 ; i--) {
+        self->arrSlot[i].pNext = self->pFree;
+        self->pFree = &(self->arrSlot[i]);
+    }
+
+    pthread_mutex_init(&(self->mutex), NULL);
+    pthread_cond_init(&(self->cond), NULL);
+
+    if (_IngestRingSetup(&(self->ring)) == 0) {
+        self->iMode = INGEST_MODE_URING;
+        return 0;
+    }
+
+    /* Fall back to the thread pool. */
+    self->iMode = INGEST_MODE_THREAD;
+    for (i = 0 ; i < INGEST_NUM_WORKERS ; i++) {
+        if (pthread_create(&(self->arrWorker[i]), NULL, _IngestWorker, self) != 0)
+            break;
+        self->iNumWorkers++;
+    }
+    if (self->iNumWorkers == 0) {
+        Log1("The sample loader cannot be started (%s).\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+IngestSample* IngestNext(Ingest *self) {
+    IngestSample *pSample;
+
+    pthread_mutex_lock(&(self->mutex));
+    while (true) {
+        /* Keep the queue full before handing out a ready sample. */
+        if (self->iMode == INGEST_MODE_URING) {
+            while ((pSample = _IngestAssign(self)) != NULL)
+                _IngestRingQueue(self, pSample);
+        }
+
+        if (self->pReadyHead != NULL)
+            break;
+        if (self->ulNumDelivered == self->ulNumPaths) {
+            pthread_mutex_unlock(&(self->mutex));
+            return NULL;
+        }
+
+        TraceBegin("ingest_wait");
+        if (self->iMode == INGEST_MODE_URING) {
+            if (_IngestRingPoll(self, true) != 0) {
+                TraceEnd("ingest_wait");
+                pthread_mutex_unlock(&(self->mutex));
+                return NULL;
+            }
+        } else
+            pthread_cond_wait(&(self->cond), &(self->mutex));
+        TraceEnd("ingest_wait");
+    }
+
+    pSample = self->pReadyHead;
+    self->pReadyHead = pSample->pNext;
+    if (self->pReadyHead == NULL)
+        self->pReadyTail = NULL;
+    self->ulNumDelivered++;
+
+    /* Let io_uring work on the queued operations while the caller analyzes the sample. */
+    if (self->iMode == INGEST_MODE_URING)
+        _IngestRingPoll(self, false);
+    pthread_mutex_unlock(&(self->mutex));
+
+    return pSample;
+}
+
+void IngestRelease(Ingest *self, IngestSample *pSample) {
+
+    if (pSample->uszData != NULL)
+        free(pSample->uszData);
+    pSample->uszData = NULL;
+    pSample->nSize = 0;
+    pSample->nCapacity = 0;
+
+    pthread_mutex_lock(&(self->mutex));
+    pSample->pNext = self->pFree;
+    self->pFree = pSample;
+    pthread_cond_broadcast(&(self->cond));
+    pthread_mutex_unlock(&(self->mutex));
+
+    return;
+}
+
+void IngestClose(Ingest *self) {
+    int             i;
+    ulong           ul;
+    IngestSample    *pSample;
+
+    if (self->iMode == INGEST_MODE_THREAD) {
+        pthread_mutex_lock(&(self->mutex));
+        self->bStop = true;
+        pthread_cond_broadcast(&(self->cond));
+        pthread_mutex_unlock(&(self->mutex));
+        for (i = 0 ; i < self->iNumWorkers ; i++)
+            pthread_join(self->arrWorker[i], NULL);
+    }
+
+    /* Drain the operations in flight before the slots are released. */
+    if (self->iMode == INGEST_MODE_URING) {
+        while (self->ulNumInFlight > 0) {
+            if (_IngestRingPoll(self, true) != 0)
+                break;
+        }
+        _IngestRingTeardown(&(self->ring));
+    }
+
+    for (i = 0 ; i < INGEST_QUEUE_DEPTH ; i++) {
+        pSample = &(self->arrSlot[i]);
+        if (pSample->uszData != NULL)
+            free(pSample->uszData);
+        if (pSample->fd >= 0)
+            close(pSample->fd);
+        pSample->uszData = NULL;
+        pSample->fd = -1;
+    }
+
+    for (ul = 0 ; ul < self->ulNumPaths ; ul++)
+        free(self->arrPath[ul]);
+    if (self->arrPath != NULL)
+        free(self->arrPath);
+    self->arrPath = NULL;
+    self->ulNumPaths = 0;
+
+    if (self->iMode != 0) {
+        pthread_cond_destroy(&(self->cond));
+        pthread_mutex_destroy(&(self->mutex));
+    }
+    self->iMode = 0;
+
+    return;
+}
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+IngestSample* _IngestAssign(Ingest *self) {
+    IngestSample *pSample;
+
+    if ((self->pFree == NULL) || (self->ulIdxSubmit == self->ulNumPaths))
+        return NULL;
+
+    pSample = self->pFree;
+    self->pFree = pSample->pNext;
+    pSample->pNext = NULL;
+
+    strcpy(pSample->szPath, self->arrPath[self->ulIdxSubmit++]);
+    pSample->szName = strrchr(pSample->szPath, OS_PATH_SEPARATOR);
+    pSample->szName = (pSample->szName == NULL)? pSample->szPath : (pSample->szName + 1);
+    pSample->uszData = NULL;
+    pSample->nSize = 0;
+    pSample->nCapacity = 0;
+    pSample->iErrno = 0;
+    pSample->fd = -1;
+    pSample->iStage = INGEST_STAGE_OPEN;
+    self->ulNumInFlight++;
+
+    return pSample;
+}
+
+void _IngestFinish(Ingest *self, IngestSample *pSample) {
+
+    /* The partially loaded buffer is useless for the analysis. */
+    if ((pSample->iErrno != 0) && (pSample->uszData != NULL)) {
+        free(pSample->uszData);
+        pSample->uszData = NULL;
+        pSample->nSize = 0;
+    }
+
+    pSample->pNext = NULL;
+    if (self->pReadyTail == NULL)
+        self->pReadyHead = pSample;
+    else
+        self->pReadyTail->pNext = pSample;
+    self->pReadyTail = pSample;
+    self->ulNumInFlight--;
+
+    return;
+}
+
+void* _IngestWorker(void *vpIngest) {
+    int             fd;
+    ssize_t         nRead;
+    uchar           *uszData;
+    Ingest          *self;
+    IngestSample    *pSample;
+
+    self = (Ingest*)vpIngest;
+    pthread_mutex_lock(&(self->mutex));
+    while (true) {
+        pSample = NULL;
+        while ((self->bStop == false) && ((pSample = _IngestAssign(self)) == NULL)) {
+            if (self->ulIdxSubmit == self->ulNumPaths)
+                break;
+            pthread_cond_wait(&(self->cond), &(self->mutex));
+        }
+        if ((self->bStop) || (pSample == NULL))
+            break;
+        pthread_mutex_unlock(&(self->mutex));
+
+        /* Load the whole sample with the blocking system calls. */
+        TraceBegin("ingest_load");
+        fd = open(pSample->szPath, O_RDONLY);
+        if (fd < 0)
+            pSample->iErrno = errno;
+        while (fd >= 0) {
+            if (pSample->nSize == pSample->nCapacity) {
+                pSample->nCapacity = (pSample->nCapacity == 0)? INGEST_INIT_CAPACITY : (pSample->nCapacity * 2);
+                uszData = (uchar*)realloc(pSample->uszData, pSample->nCapacity);
+                if (uszData == NULL) {
+                    pSample->iErrno = ENOMEM;
+                    break;
+                }
+                pSample->uszData = uszData;
+            }
+            nRead = read(fd, pSample->uszData + pSample->nSize, pSample->nCapacity - pSample->nSize);
+            StatsCount(STATS_COUNTER_READ_CALLS, 1);
+            if (nRead < 0) {
+                if (errno == EINTR)
+                    continue;
+                pSample->iErrno = errno;
+                break;
+            }
+            if (nRead == 0)
+                break;
+            pSample->nSize += nRead;
+            StatsCount(STATS_COUNTER_BYTES_READ, nRead);
+        }
+        if (fd >= 0)
+            close(fd);
+        TraceEnd("ingest_load");
+
+        pthread_mutex_lock(&(self->mutex));
+        _IngestFinish(self, pSample);
+        pthread_cond_broadcast(&(self->cond));
+    }
+    pthread_mutex_unlock(&(self->mutex));
+
+    return NULL;
+}
+
+
+#if defined(__linux__)
+
+int _IngestRingSetup(IngestRing *pRing) {
+    int                     fd;
+    struct io_uring_params  params;
+
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, INGEST_QUEUE_DEPTH * 2, &params);
+    if (fd < 0)
+        return -1;
+    if (_IngestRingProbe(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    pRing->fd = fd;
+    pRing->uiNumQueued = 0;
+    pRing->nSqRing = params.sq_off.array + params.sq_entries * sizeof(uint);
+    pRing->nCqRing = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    pRing->nSqe = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* The kernel may share a single mapping for both rings. */
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (pRing->nCqRing > pRing->nSqRing)
+            pRing->nSqRing = pRing->nCqRing;
+        pRing->nCqRing = pRing->nSqRing;
+    }
+
+    pRing->pSqRing = mmap(NULL, pRing->nSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQ_RING);
+    if (pRing->pSqRing == MAP_FAILED)
+        goto ERROR_SQ;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        pRing->pCqRing = pRing->pSqRing;
+    else {
+        pRing->pCqRing = mmap(NULL, pRing->nCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd, IORING_OFF_CQ_RING);
+        if (pRing->pCqRing == MAP_FAILED)
+            goto ERROR_CQ;
+    }
+    pRing->pSqe = mmap(NULL, pRing->nSqe, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQES);
+    if (pRing->pSqe == MAP_FAILED)
+        goto ERROR_SQE;
+
+    pRing->puiSqHead = (uint*)((uchar*)pRing->pSqRing + params.sq_off.head);
+    pRing->puiSqTail = (uint*)((uchar*)pRing->pSqRing + params.sq_off.tail);
+    pRing->puiSqMask = (uint*)((uchar*)pRing->pSqRing + params.sq_off.ring_mask);
+    pRing->puiSqArray = (uint*)((uchar*)pRing->pSqRing + params.sq_off.array);
+    pRing->puiCqHead = (uint*)((uchar*)pRing->pCqRing + params.cq_off.head);
+    pRing->puiCqTail = (uint*)((uchar*)pRing->pCqRing + params.cq_off.tail);
+    pRing->puiCqMask = (uint*)((uchar*)pRing->pCqRing + params.cq_off.ring_mask);
+    pRing->arrSqe = (struct io_uring_sqe*)pRing->pSqe;
+    pRing->arrCqe = (struct io_uring_cqe*)((uchar*)pRing->pCqRing + params.cq_off.cqes);
+
+    return 0;
+
+ERROR_SQE:
+    if (pRing->pCqRing != pRing->pSqRing)
+        munmap(pRing->pCqRing, pRing->nCqRing);
+ERROR_CQ:
+    munmap(pRing->pSqRing, pRing->nSqRing);
+ERROR_SQ:
+    close(fd);
+    pRing->fd = -1;
+    return -1;
+}
+
+int _IngestRingProbe(int fd) {
+    int                     rc;
+    size_t                  nSize;
+    struct io_uring_probe   *pProbe;
+
+    /* The kernels without the probe also lack the operations below, and READ is the latest of them. */
+    nSize = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    pProbe = (struct io_uring_probe*)calloc(1, nSize);
+    if (pProbe == NULL)
+        return -1;
+
+    rc = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, pProbe, IORING_OP_LAST);
+    if (rc == 0) {
+        if ((pProbe->last_op < IORING_OP_READ) ||
+            !(pProbe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) ||
+            !(pProbe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) ||
+            !(pProbe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED))
+            rc = -1;
+    }
+
+    free(pProbe);
+    return (rc == 0)? 0 : -1;
+}
+
+void _IngestRingTeardown(IngestRing *pRing) {
+
+    if (pRing->fd < 0)
+        return;
+
+    munmap(pRing->pSqe, pRing->nSqe);
+    if (pRing->pCqRing != pRing->pSqRing)
+        munmap(pRing->pCqRing, pRing->nCqRing);
+    munmap(pRing->pSqRing, pRing->nSqRing);
+    close(pRing->fd);
+    pRing->fd = -1;
+
+    return;
+}
+
+void _IngestRingQueue(Ingest *self, IngestSample *pSample) {
+    uint                uiTail, uiIdx;
+    uchar               *uszData;
+    IngestRing          *pRing;
+    struct io_uring_sqe *pSqe;
+
+    pRing = &(self->ring);
+
+    /* Grow the buffer before each read if it is full. */
+    if ((pSample->iStage == INGEST_STAGE_READ) && (pSample->nSize == pSample->nCapacity)) {
+        pSample->nCapacity = (pSample->nCapacity == 0)? INGEST_INIT_CAPACITY : (pSample->nCapacity * 2);
+        uszData = (uchar*)realloc(pSample->uszData, pSample->nCapacity);
+        if (uszData == NULL) {
+            pSample->iErrno = ENOMEM;
+            pSample->iStage = INGEST_STAGE_CLOSE;
+        } else
+            pSample->uszData = uszData;
+    }
+
+    /* The ring has twice the slots, so a free entry always exists. */
+    uiTail = *(pRing->puiSqTail);
+    uiIdx = uiTail & *(pRing->puiSqMask);
+    pSqe = &(pRing->arrSqe[uiIdx]);
+    memset(pSqe, 0, sizeof(struct io_uring_sqe));
+    pSqe->user_data = (__u64)(uintptr_t)pSample;
+
+    switch (pSample->iStage) {
+        case INGEST_STAGE_OPEN: {
+            pSqe->opcode = IORING_OP_OPENAT;
+            pSqe->fd = AT_FDCWD;
+            pSqe->addr = (__u64)(uintptr_t)pSample->szPath;
+            pSqe->open_flags = O_RDONLY;
+            break;
+        }
+        case INGEST_STAGE_READ: {
+            pSqe->opcode = IORING_OP_READ;
+            pSqe->fd = pSample->fd;
+            pSqe->addr = (__u64)(uintptr_t)(pSample->uszData + pSample->nSize);
+            pSqe->len = pSample->nCapacity - pSample->nSize;
+            pSqe->off = pSample->nSize;
+            break;
+        }
+        case INGEST_STAGE_CLOSE: {
+            pSqe->opcode = IORING_OP_CLOSE;
+            pSqe->fd = pSample->fd;
+            break;
+        }
+    }
+
+    pRing->puiSqArray[uiIdx] = uiIdx;
+    __atomic_store_n(pRing->puiSqTail, uiTail + 1, __ATOMIC_RELEASE);
+    pRing->uiNumQueued++;
+
+    return;
+}
+
+int _IngestRingPoll(Ingest *self, bool bWait) {
+    int                 rc;
+    uint                uiHead, uiTail;
+    IngestRing          *pRing;
+    struct io_uring_cqe *pCqe;
+
+    pRing = &(self->ring);
+    if ((pRing->uiNumQueued > 0) || bWait) {
+        rc = syscall(__NR_io_uring_enter, pRing->fd, pRing->uiNumQueued, (bWait)? 1 : 0,
+                     (bWait)? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc < 0) {
+            if (errno == EINTR)
+                return 0;
+            Log1("The sample loader fails (%s).\n", strerror(errno));
+            return -1;
+        }
+        pRing->uiNumQueued -= rc;
+    }
+
+    /* Advance the samples with the completed operations. */
+    uiHead = *(pRing->puiCqHead);
+    uiTail = __atomic_load_n(pRing->puiCqTail, __ATOMIC_ACQUIRE);
+    while (uiHead != uiTail) {
+        pCqe = &(pRing->arrCqe[uiHead & *(pRing->puiCqMask)]);
+        _IngestRingAdvance(self, (IngestSample*)(uintptr_t)pCqe->user_data, pCqe->res);
+        uiHead++;
+    }
+    __atomic_store_n(pRing->puiCqHead, uiHead, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void _IngestRingAdvance(Ingest *self, IngestSample *pSample, int iResult) {
+
+    switch (pSample->iStage) {
+        case INGEST_STAGE_OPEN: {
+            if (iResult < 0) {
+                pSample->iErrno = -iResult;
+                _IngestFinish(self, pSample);
+                return;
+            }
+            pSample->fd = iResult;
+            pSample->iStage = INGEST_STAGE_READ;
+            break;
+        }
+        case INGEST_STAGE_READ: {
+            StatsCount(STATS_COUNTER_READ_CALLS, 1);
+            if ((iResult == -EINTR) || (iResult == -EAGAIN))
+                break;
+            if (iResult < 0) {
+                pSample->iErrno = -iResult;
+                pSample->iStage = INGEST_STAGE_CLOSE;
+            } else if (iResult == 0)
+                pSample->iStage = INGEST_STAGE_CLOSE;
+            else {
+                pSample->nSize += iResult;
+                StatsCount(STATS_COUNTER_BYTES_READ, iResult);
+            }
+            break;
+        }
+        case INGEST_STAGE_CLOSE: {
+            pSample->fd = -1;
+            _IngestFinish(self, pSample);
+            return;
+        }
+    }
+
+    _IngestRingQueue(self, pSample);
+    return;
+}
+
+#else
+
+int _IngestRingSetup(IngestRing *pRing) {
+    return -1;
+}
+
+int _IngestRingProbe(int fd) {
+    return -1;
+}
+
+void _IngestRingTeardown(IngestRing *pRing) {
+    return;
+}
+
+void _IngestRingQueue(Ingest *self, IngestSample *pSample) {
+    return;
+}
+
+int _IngestRingPoll(Ingest *self, bool bWait) {
+    return -1;
+}
+
+void _IngestRingAdvance(Ingest *self, IngestSample *pSample, int iResult) {
+    return;
+}
+
+#endif
@@ -4,66 +4,141 @@
 #include "region.h"
 #include "ngram.h"
 #include "report.h"
+#include "stats.h"
+#include "trace.h"
+#include "perf.h"
+#include "ingest.h"
+#include "carve.h"
 
 
 typedef struct _Opt {
     const char *cszInput;
     const char *cszOutput;
     const char *cszLibRegion;
+    const char *cszRegionArg;
     const char *cszLibModel;
-    uchar ucDimension;
+    const char *cszCacheDir;
+    uchar arrDimension[NGRAM_MAX_DIMENSION];
+    uchar ucNumDimensions;
+    uint uiMask;
+    bool bSpanRanges;
+    bool bPrefetch;
+    bool bPerf;
+    bool bPerSection;
+    bool bSlideEntropy;
+    bool bLazyEntropy;
+    bool bDedupBlocks;
+    ulong ulWindowSize;
+    ulong ulWindowStep;
 } Opt;
 
 
+/* Structure to share the carved images among the analysis threads. */
+typedef struct _CarveJob {
+    Opt     *pOpt;
+    Carve   *pCarve;
+    ulong   ulIdxNext;
+    int     rc;
+} CarveJob;
+
+
 /* Print the program usage message. */
 void print_usage();
 
+/* Parse the comma separated list of n-gram dimensions. */
+int parse_dimensions(const char*, uchar*, uchar*);
+
+/* Parse the byte size of the profile window or step. */
+int parse_size(const char*, ulong*);
+
 /* Initialize the primary worker modules. */
-int init_modules(PEInfo**, RegionCollector**, NGram**, Report**, Opt*);
+int init_modules(Arena**, PEInfo**, RegionCollector**, Report**, Opt*);
 
 /* Deinitialize the primary worker modules. */
-int deinit_modules(PEInfo*, RegionCollector*, NGram*, Report*);
+int deinit_modules(Arena*, PEInfo*, RegionCollector*, Report*);
+
+/* Initialize the n-gram models for the selected features. */
+int init_models(NGram***, uint*, Arena*, RegionCollector*, Opt*);
+
+/* Deinitialize the n-gram models. */
+int deinit_models(NGram**, uint);
+
+/* Run the whole analysis pipeline for a sample. */
+int analyze_sample(Opt*, IngestSample*);
+
+/* Run the analysis pipeline for all the samples of a directory. */
+int analyze_batch(Opt*);
+
+/* Run the analysis pipeline for all the PE images carved out of a large input. */
+int analyze_carve(Opt*);
+
+/* Analyze the carved images taken one by one from the shared job. */
+void* analyze_carved_images(void*);
 
 /* Bundle the operations to parse input PE file. */
-int parse_pe_info(PEInfo*, const char*);
+int parse_pe_info(PEInfo*, const char*, IngestSample*);
 
 /* Bundle the operations to select the user-specified binary characteristics. */
-int select_features(RegionCollector*, PEInfo*);
+int select_features(RegionCollector*, PEInfo*, Opt*);
 
-/* Bundle the operations to generate the user-specified model. */
-int generate_model(NGram*, uchar, PEInfo*, RegionCollector*);
+/* Bundle the operations to generate the user-specified models. */
+int generate_model(NGram**, uint, Opt*, PEInfo*, RegionCollector*);
 
 /* Bundle the operations to generate the reports. */
-int generate_report(Report*, PEInfo*, NGram*, const char*, uint);
+int generate_report(Report*, PEInfo*, RegionCollector*, NGram**, uint, Opt*);
 
 
 int main(int argc, char **argv, char **envp) {
     int             opt, rc, idxOpt, i, iLen;
+    bool            bStats, bPerf, bSpanRanges, bPrefetch, bPerSection, bSlideEntropy;
+    bool            bLazyEntropy, bDedupBlocks, bCarve;
     uint            uiMask;
-    uchar           ucDimension;
-    const char      *cszInput, *cszOutput, *cszReportSeries, *cszLibRegion, *cszLibModel;
-    PEInfo          *pPEInfo;
-    RegionCollector *pRegionCollector;
-    NGram           *pNGram;
-    Report          *pReport;
+    ulong           ulWindowSize, ulWindowStep;
+    uchar           arrDimension[NGRAM_MAX_DIMENSION], ucNumDimensions;
+    const char      *cszInput, *cszOutput, *cszReportSeries, *cszLibRegion, *cszLibModel, *cszTrace;
+    const char      *cszRegionArg, *cszCacheDir, *cszWindowSize, *cszWindowStep;
     char            szOrder[BUF_SIZE_SMALL];
     Opt             bundleOpt;
+    struct stat     statInput;
 
     /* Craft the structure to store command line options. */
     static struct option Options[] = {
-        {OPT_LONG_HELP     , required_argument, 0, OPT_HELP     },
-        {OPT_LONG_INPUT    , required_argument, 0, OPT_INPUT    },
-        {OPT_LONG_OUTPUT   , required_argument, 0, OPT_OUTPUT   },
-        {OPT_LONG_DIMENSION, required_argument, 0, OPT_DIMENSION},
-        {OPT_LONG_REPORT   , required_argument, 0, OPT_REPORT   },
-        {OPT_LONG_REGION   , required_argument, 0, OPT_REGION   },
-        {OPT_LONG_MODEL    , required_argument, 0, OPT_MODEL    },
+        {OPT_LONG_HELP       , required_argument, 0, OPT_HELP       },
+        {OPT_LONG_INPUT      , required_argument, 0, OPT_INPUT      },
+        {OPT_LONG_OUTPUT     , required_argument, 0, OPT_OUTPUT     },
+        {OPT_LONG_DIMENSION  , required_argument, 0, OPT_DIMENSION  },
+        {OPT_LONG_REPORT     , required_argument, 0, OPT_REPORT     },
+        {OPT_LONG_REGION     , required_argument, 0, OPT_REGION     },
+        {OPT_LONG_MODEL      , required_argument, 0, OPT_MODEL      },
+        {OPT_LONG_STATS      , no_argument      , 0, OPT_STATS      },
+        {OPT_LONG_TRACE      , required_argument, 0, OPT_TRACE      },
+        {OPT_LONG_PERF       , no_argument      , 0, OPT_PERF       },
+        {OPT_LONG_REGION_ARG , required_argument, 0, OPT_REGION_ARG },
+        {OPT_LONG_SPAN_RANGES, no_argument      , 0, OPT_SPAN_RANGES},
+        {OPT_LONG_PREFETCH   , no_argument      , 0, OPT_PREFETCH   },
+        {OPT_LONG_PER_SECTION, no_argument      , 0, OPT_PER_SECTION},
+        {OPT_LONG_SLIDE_ENTROPY, no_argument    , 0, OPT_SLIDE_ENTROPY},
+        {OPT_LONG_LAZY_ENTROPY, no_argument     , 0, OPT_LAZY_ENTROPY},
+        {OPT_LONG_DEDUP_BLOCKS, no_argument     , 0, OPT_DEDUP_BLOCKS},
+        {OPT_LONG_CACHE      , required_argument, 0, OPT_CACHE      },
+        {OPT_LONG_WINDOW     , required_argument, 0, OPT_WINDOW     },
+        {OPT_LONG_STEP       , required_argument, 0, OPT_STEP       },
+        {OPT_LONG_CARVE      , no_argument      , 0, OPT_CARVE      },
+        {0                   , 0                , 0, 0              },
     };
 
     memset(szOrder, 0, sizeof(char) * BUF_SIZE_SMALL);
-    sprintf(szOrder, "%c%c:%c:%c:%c:%c:%c:", OPT_HELP, OPT_INPUT, OPT_OUTPUT, OPT_DIMENSION,
-                                             OPT_REPORT, OPT_REGION, OPT_MODEL);
-    cszInput = cszOutput = cszReportSeries = cszLibRegion = cszLibModel = NULL;
+    sprintf(szOrder, "%c%c:%c:%c:%c:%c:%c:%c%c:%c%c:%c%c%c%c%c%c%c:%c:%c:%c", OPT_HELP, OPT_INPUT, OPT_OUTPUT, OPT_DIMENSION,
+                                                                        OPT_REPORT, OPT_REGION, OPT_MODEL, OPT_STATS, OPT_TRACE,
+                                                                        OPT_PERF, OPT_REGION_ARG, OPT_SPAN_RANGES, OPT_PREFETCH,
+                                                                        OPT_PER_SECTION, OPT_SLIDE_ENTROPY, OPT_LAZY_ENTROPY,
+                                                                        OPT_DEDUP_BLOCKS, OPT_CACHE, OPT_WINDOW, OPT_STEP,
+                                                                        OPT_CARVE);
+    cszInput = cszOutput = cszReportSeries = cszLibRegion = cszLibModel = cszTrace = NULL;
+    cszRegionArg = cszCacheDir = cszWindowSize = cszWindowStep = NULL;
+    ucNumDimensions = 0;
+    bStats = bPerf = bSpanRanges = bPrefetch = bPerSection = bSlideEntropy = bLazyEntropy = false;
+    bDedupBlocks = bCarve = false;
     rc = 0;
 
     /* Get the command line options. */
@@ -86,12 +161,69 @@ int main(int argc, char **argv, char **envp) {
                 cszLibRegion = optarg;
                 break;
             }
+            case OPT_REGION_ARG: {
+                cszRegionArg = optarg;
+                break;
+            }
             case OPT_MODEL: {
                 cszLibModel = optarg;
                 break;
             }
             case OPT_DIMENSION: {
-                ucDimension = atoi(optarg);
+                if (parse_dimensions(optarg, arrDimension, &ucNumDimensions) != 0)
+                    ucNumDimensions = 0;
+                break;
+            }
+            case OPT_STATS: {
+                bStats = true;
+                break;
+            }
+            case OPT_TRACE: {
+                cszTrace = optarg;
+                break;
+            }
+            case OPT_PERF: {
+                bPerf = true;
+                break;
+            }
+            case OPT_SPAN_RANGES: {
+                bSpanRanges = true;
+                break;
+            }
+            case OPT_PREFETCH: {
+                bPrefetch = true;
+                break;
+            }
+            case OPT_PER_SECTION: {
+                bPerSection = true;
+                break;
+            }
+            case OPT_SLIDE_ENTROPY: {
+                bSlideEntropy = true;
+                break;
+            }
+            case OPT_LAZY_ENTROPY: {
+                bLazyEntropy = true;
+                break;
+            }
+            case OPT_DEDUP_BLOCKS: {
+                bDedupBlocks = true;
+                break;
+            }
+            case OPT_CACHE: {
+                cszCacheDir = optarg;
+                break;
+            }
+            case OPT_WINDOW: {
+                cszWindowSize = optarg;
+                break;
+            }
+            case OPT_STEP: {
+                cszWindowStep = optarg;
+                break;
+            }
+            case OPT_CARVE: {
+                bCarve = true;
                 break;
             }
             default: {
@@ -115,8 +247,8 @@ int main(int argc, char **argv, char **envp) {
         goto EXIT;
     }
 
-    /* Check the dimension. */
-    if ((ucDimension == 0) || (ucDimension > 4)) {
+    /* Check the dimensions. */
+    if (ucNumDimensions == 0) {
         print_usage();
         rc = -1;
         goto EXIT;
@@ -151,36 +283,89 @@ int main(int argc, char **argv, char **envp) {
         goto EXIT;
     }
 
-    bundleOpt.ucDimension = ucDimension;
+    /* Check the profile windows. The step defaults to the window size. */
+    ulWindowSize = ulWindowStep = 0;
+    if ((cszWindowSize == NULL) && (cszWindowStep != NULL)) {
+        print_usage();
+        rc = -1;
+        goto EXIT;
+    }
+    if (cszWindowSize != NULL) {
+        if (parse_size(cszWindowSize, &ulWindowSize) != 0) {
+            print_usage();
+            rc = -1;
+            goto EXIT;
+        }
+        ulWindowStep = ulWindowSize;
+        if ((cszWindowStep != NULL) && (parse_size(cszWindowStep, &ulWindowStep) != 0)) {
+            print_usage();
+            rc = -1;
+            goto EXIT;
+        }
+    }
+
+    /* Prepare the folder of the result cache. */
+    if ((cszCacheDir != NULL) && (strlen(cszCacheDir) == 0)) {
+        print_usage();
+        rc = -1;
+        goto EXIT;
+    }
+    if (cszCacheDir != NULL) {
+        try {
+            Mkdir(cszCacheDir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+        } catch(EXCEPT_IO_DIR_MAKE) {
+            Log1("The cache folder cannot be created (%s).\n", cszCacheDir);
+            rc = -1;
+        } end_try;
+        if (rc != 0)
+            goto EXIT;
+    }
+
+    memcpy(bundleOpt.arrDimension, arrDimension, sizeof(uchar) * ucNumDimensions);
+    bundleOpt.ucNumDimensions = ucNumDimensions;
     bundleOpt.cszInput = cszInput;
     bundleOpt.cszOutput = cszOutput;
     bundleOpt.cszLibRegion = cszLibRegion;
+    bundleOpt.cszRegionArg = cszRegionArg;
     bundleOpt.cszLibModel = cszLibModel;
-
-    rc = init_modules(&pPEInfo, &pRegionCollector, &pNGram, &pReport, &bundleOpt);
-    if (rc != 0)
-        goto DEINIT;
-
-    /* Prepare the basic PE features. */
-    rc = parse_pe_info(pPEInfo, cszInput);
-    if (rc != 0)
-        goto DEINIT;
-
-    /* Select the features for n-gram model generation. */
-    rc = select_features(pRegionCollector, pPEInfo);
-    if (rc != 0)
-        goto DEINIT;
-
-    /* Generate the model with the selected features. */
-    rc = generate_model(pNGram, ucDimension, pPEInfo, pRegionCollector);
-    if (rc != 0)
-        goto DEINIT;
-
-    /* Generate the relevant reports for the model. */
-    rc = generate_report(pReport, pPEInfo, pNGram, cszOutput, uiMask);
-
-DEINIT:
-    deinit_modules(pPEInfo, pRegionCollector, pNGram, pReport);
+    bundleOpt.cszCacheDir = cszCacheDir;
+    bundleOpt.bSpanRanges = bSpanRanges;
+    bundleOpt.bPrefetch = bPrefetch;
+    bundleOpt.bPerf = bPerf;
+    bundleOpt.bPerSection = bPerSection;
+    bundleOpt.bSlideEntropy = bSlideEntropy;
+    bundleOpt.bLazyEntropy = bLazyEntropy;
+    bundleOpt.bDedupBlocks = bDedupBlocks;
+    bundleOpt.ulWindowSize = ulWindowSize;
+    bundleOpt.ulWindowStep = ulWindowStep;
+    bundleOpt.uiMask = uiMask;
+
+    /* Activate the timeline recorder. */
+    if (cszTrace != NULL)
+        TraceStart();
+
+    /* Open the hardware event counters. The sampling is skipped if they are unavailable. */
+    if (bPerf == true)
+        PerfOpen();
+
+    /* A directory input is analyzed as a batch of samples, and a carved input as a
+       batch of its embedded images. */
+    if (bCarve == true)
+        rc = analyze_carve(&bundleOpt);
+    else if ((stat(cszInput, &statInput) == 0) && S_ISDIR(statInput.st_mode))
+        rc = analyze_batch(&bundleOpt);
+    else
+        rc = analyze_sample(&bundleOpt, NULL);
+
+    /* Dump the instrumentation data of the analysis. */
+    if (bStats == true)
+        StatsDump(stdout);
+    if (cszTrace != NULL) {
+        TraceDump(cszTrace);
+        TraceStop();
+    }
+    if (bPerf == true)
+        PerfClose();
 
 EXIT:
     return rc;
@@ -189,31 +374,126 @@ EXIT:
 
 void print_usage() {
 
-    const char *cszMsg = "Usage: pe_ngram --input path_input --output path_output --dimension num --report flags.\n"
-                         "       pe_ngram -i      path_input -o       path_output -d          num -t       flags.\n\n"
+    const char *cszMsg = "Usage: pe_ngram --input path_input --output path_output --dimension num --report flags [--stats] [--trace path_trace] [--perf-counters]\n"
+                         "                [--region plugin] [--region-arg arg] [--span-ranges] [--prefetch] [--per-section] [--slide-entropy]\n"
+                         "                [--lazy-entropy] [--dedup-blocks] [--cache path_cache] [--window size [--step step]] [--carve].\n"
+                         "       pe_ngram -i      path_input -o       path_output -d          num -t       flags [-s]      [-c      path_trace] [-p]\n"
+                         "                [-r       plugin] [-a           arg] [-g]            [-f]         [-x]            [-l]\n"
+                         "                [-z]             [-u]             [-k      path_cache] [-w     size [-j   step]] [-e].\n\n"
                          "       path_input : The path to the input sample.\n"
+                         "                    (For a directory, each sample is reported to path_output/file_name.)\n"
+                         "                    (With --carve, each embedded image is reported to path_output/input_name_0xoffset.)\n"
                          "       path_output: The path to the output report folder.\n"
                          "                    (Only accpet absolute paths.)\n"
-                         "       dimension  : The dimension of n-gram model.\n"
+                         "       dimension  : The dimension of n-gram model, or a comma separated list of dimensions.\n"
                          "                    (Dimension must be larger than 0 and be less than 5.)\n"
+                         "                    (e.g. : 2, 1,2,3 ; The models of a list are collected in one pass.)\n"
                          "       flags      : The set of control flags for report types.\n"
                          "                    (flag 'e' : For text dump of entropy distribution.)\n"
                          "                    (flag 't' : For text dump of n-gram model.)\n"
                          "                    (flag 'i' : For visualized image of n-gram model.)\n"
                          "                    (The 'i' flag must be after the 't' flag.)\n"
-                         "                    (e.g. : e, t, i, et, eti)\n\n"
+                         "                    (e.g. : e, t, i, et, eti)\n"
+                         "       stats      : Dump the per-phase timing and the engine counters as a JSON object.\n"
+                         "       path_trace : The path to the Chrome trace-event JSON file recording the phase timeline.\n"
+                         "                    (The file can be viewed with Perfetto or chrome://tracing.)\n"
+                         "       perf-counters: Dump the hardware event counts of each phase as a JSON object per sample.\n"
+                         "                    (The main thread and the entropy workers are counted.)\n"
+                         "                    (It requires the engine built with ENABLE_STATS.)\n"
+                         "       plugin     : The name of the region collector plugin.\n"
+                         "                    (e.g. : Region_MaxEntropySection, Region_Plateaus, Region_EntryCode)\n"
+                         "       arg        : The argument string passed to the region collector plugin.\n"
+                         "                    (e.g. : threshold=6.5,run=4 for Region_Plateaus)\n"
+                         "                    (e.g. : scope=entry for Region_EntryCode)\n"
+                         "       span-ranges: Let the n-grams span the adjacent selected ranges.\n"
+                         "       prefetch   : Read the next chunk of the sample on a helper thread.\n"
+                         "       per-section: Generate a model for every non-empty section in one scan instead of the plugin regions.\n"
+                         "                    (The reports are named sample_secN, where N is the section number.)\n"
+                         "       slide-entropy: Record the entropy of the window starting at each byte, which lets the\n"
+                         "                    region plugin place the range edges at byte offsets.\n"
+                         "       lazy-entropy: Rank the sections by the entropy of the sampled blocks, and measure the block\n"
+                         "                    entropy only for the sections requested by the plugin or the entropy report.\n"
+                         "       dedup-blocks: Tokenize each distinct 256-byte block once and count its repeats by the copy.\n"
+                         "       path_cache : The path to the folder caching the entropy data and the n-gram histograms\n"
+                         "                    of each section, keyed by the hash of the section raw data.\n"
+                         "       size       : The byte size of the windows moved along the selected ranges. The top tokens\n"
+                         "                    of each window are reported to sample_ngram_windows.txt.\n"
+                         "       step       : The bytes between the starts of two windows. (Default: the window size)\n"
+                         "       carve      : Scan the input, such as a memory dump or a disk image, for the embedded PE images\n"
+                         "                    and analyze each of them in parallel.\n\n"
                          "Example: pe_ngram --input /repo/sample/a.exe --output /repo/analysis/a --dimension 2 --report eti\n"
-                         "         pe_ngram -i /repo/sample/a.exe -o /repo/sample/a -d 2 -t eti\n\n";
+                         "         pe_ngram -i /repo/sample/a.exe -o /repo/sample/a -d 2 -t eti\n"
+                         "         pe_ngram -i /repo/sample/a.exe -o /repo/sample/a -d 1,2,3 -t et\n\n";
     printf("%s", cszMsg);
     return;
 }
 
 
-int init_modules(PEInfo **ppPEInfo, RegionCollector **ppRegionCollector,
-                 NGram **ppNGram, Report **ppReport, Opt *pOpt) {
+int parse_dimensions(const char *cszList, uchar *arrDimension, uchar *pucNumDimensions) {
+    long  lDimension;
+    uchar i, ucNumDimensions;
+    char  *szEnd;
+
+    ucNumDimensions = 0;
+    while (true) {
+        lDimension = strtol(cszList, &szEnd, 10);
+        if ((szEnd == cszList) || (lDimension <= 0) || (lDimension > NGRAM_MAX_DIMENSION))
+            return -1;
+
+        /* Each dimension is modeled once even if it is listed repeatedly. */
+        for (i = 0 ; i < ucNumDimensions ; i++) {
+            if (arrDimension[i] == lDimension)
+                break;
+        }
+        if (i == ucNumDimensions)
+            arrDimension[ucNumDimensions++] = (uchar)lDimension;
+
+        if (*szEnd == 0)
+            break;
+        if (*szEnd != ',')
+            return -1;
+        cszList = szEnd + 1;
+    }
+
+    *pucNumDimensions = ucNumDimensions;
+    return 0;
+}
+
+
+int parse_size(const char *cszSize, ulong *pulSize) {
+    ulong ulSize;
+    char  *szEnd;
+
+    /* Accept a decimal or hexadecimal number of bytes with an optional K or M suffix. */
+    errno = 0;
+    ulSize = strtoul(cszSize, &szEnd, 0);
+    if ((szEnd == cszSize) || (errno != 0) || (cszSize[0] == '-'))
+        return -1;
+    if ((*szEnd == 'K') || (*szEnd == 'k')) {
+        ulSize *= 1024;
+        szEnd++;
+    } else if ((*szEnd == 'M') || (*szEnd == 'm')) {
+        ulSize *= 1024 * 1024;
+        szEnd++;
+    }
+    if ((*szEnd != 0) || (ulSize == 0) || (ulSize > NGRAM_PROFILE_MAX_SIZE))
+        return -1;
+
+    *pulSize = ulSize;
+    return 0;
+}
+
+
+int init_modules(Arena **ppArena, PEInfo **ppPEInfo, RegionCollector **ppRegionCollector,
+                 Report **ppReport, Opt *pOpt) {
     int rc;
 
     rc = 0;
+    Arena_init(*ppArena);
+    if (*ppArena == NULL) {
+        rc = -1;
+        goto EXIT;
+    }
     PEInfo_init(*ppPEInfo);
     if (*ppPEInfo == NULL) {
         rc = -1;
@@ -224,23 +504,32 @@ int init_modules(PEInfo **ppPEInfo, RegionCollector **ppRegionCollector,
         rc = -1;
         goto EXIT;
     }
-    NGram_init(*ppNGram);
-    if (*ppNGram == NULL) {
-        rc = -1;
-        goto EXIT;
-    }
     Report_init(*ppReport);
     if (*ppReport == NULL) {
         rc = -1;
         goto EXIT;
     }
 
-    rc = (*ppRegionCollector)->loadPlugin(*ppRegionCollector, pOpt->cszLibRegion);
-    if (rc != 0)
-        goto EXIT;
-    rc = (*ppNGram)->loadPlugin(*ppNGram, pOpt->cszLibModel);
-    if (rc != 0)
-        goto EXIT;
+    /* Let the modules and plugins share the per-analysis arena. */
+    (*ppPEInfo)->pArena = *ppArena;
+    (*ppRegionCollector)->pArena = *ppArena;
+    (*ppRegionCollector)->cszPlugArg = pOpt->cszRegionArg;
+    (*ppRegionCollector)->bSpanRanges = pOpt->bSpanRanges;
+    (*ppPEInfo)->bPrefetch = pOpt->bPrefetch;
+    (*ppPEInfo)->bSlideEntropy = pOpt->bSlideEntropy;
+    (*ppPEInfo)->bLazyEntropy = pOpt->bLazyEntropy;
+    (*ppPEInfo)->cszCacheDir = pOpt->cszCacheDir;
+
+    /* The entropy report needs the block entropy of every section anyway. */
+    if (pOpt->uiMask & MASK_REPORT_SECTION_ENTROPY)
+        (*ppPEInfo)->bLazyEntropy = false;
+
+    /* The region plugin is not used if every section is modeled. */
+    if (pOpt->bPerSection == false) {
+        rc = (*ppRegionCollector)->loadPlugin(*ppRegionCollector, pOpt->cszLibRegion);
+        if (rc != 0)
+            goto EXIT;
+    }
     rc = (*ppReport)->generateFolder(*ppReport, pOpt->cszOutput);
 
 EXIT:
@@ -248,39 +537,334 @@ EXIT:
 }
 
 
-int deinit_modules(PEInfo *pPEInfo, RegionCollector *pRegionCollector,
-                   NGram *pNGram, Report *pReport) {
+int deinit_modules(Arena *pArena, PEInfo *pPEInfo, RegionCollector *pRegionCollector,
+                   Report *pReport) {
     if (pPEInfo != NULL)
         PEInfo_deinit(pPEInfo);
     if (pRegionCollector != NULL) {
         pRegionCollector->unloadPlugin(pRegionCollector);
         RegionCollector_deinit(pRegionCollector);
     }
-    if (pNGram != NULL) {
-        pNGram->unloadPlugin(pNGram);
-        NGram_deinit(pNGram);
-    }
     if (pReport != NULL)
         Report_deinit(pReport);
+
+    /* Release all the per-analysis structures at once. */
+    if (pArena != NULL)
+        Arena_deinit(pArena);
+    return 0;
+}
+
+
+int init_models(NGram ***parrNGram, uint *puiNumModels, Arena *pArena,
+                RegionCollector *pRegionCollector, Opt *pOpt) {
+    int   rc;
+    uint  i, uiNumModels;
+    NGram **arrNGram;
+
+    /* A model per dimension, or a model per dimension for each selected section. */
+    rc = 0;
+    uiNumModels = pOpt->ucNumDimensions;
+    if (pOpt->bPerSection == true)
+        uiNumModels *= pRegionCollector->usNumRegions;
+    *parrNGram = NULL;
+    *puiNumModels = 0;
+    if (uiNumModels == 0)
+        goto EXIT;
+
+    try {
+        arrNGram = (NGram**)Acalloc(pArena, uiNumModels, sizeof(NGram*));
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } end_try;
+    if (rc != 0)
+        goto EXIT;
+    *parrNGram = arrNGram;
+    *puiNumModels = uiNumModels;
+
+    for (i = 0 ; i < uiNumModels ; i++) {
+        NGram_init(arrNGram[i]);
+        if (arrNGram[i] == NULL) {
+            rc = -1;
+            goto EXIT;
+        }
+        arrNGram[i]->pArena = pArena;
+        arrNGram[i]->bDedupBlocks = pOpt->bDedupBlocks;
+        arrNGram[i]->cszCacheDir = pOpt->cszCacheDir;
+        arrNGram[i]->ulProfileSize = pOpt->ulWindowSize;
+        arrNGram[i]->ulProfileStep = pOpt->ulWindowStep;
+        rc = arrNGram[i]->loadPlugin(arrNGram[i], pOpt->cszLibModel);
+        if (rc != 0)
+            goto EXIT;
+    }
+
+EXIT:
+    return rc;
+}
+
+
+int deinit_models(NGram **arrNGram, uint uiNumModels) {
+    uint i;
+
+    for (i = 0 ; i < uiNumModels ; i++) {
+        if (arrNGram[i] != NULL) {
+            arrNGram[i]->unloadPlugin(arrNGram[i]);
+            NGram_deinit(arrNGram[i]);
+        }
+    }
     return 0;
 }
 
 
-int parse_pe_info(PEInfo *pPEInfo, const char *cszInput) {
+int analyze_sample(Opt *pOpt, IngestSample *pSample) {
+    int             rc;
+    Arena           *pArena;
+    PEInfo          *pPEInfo;
+    RegionCollector *pRegionCollector;
+    NGram           **arrNGram;
+    uint            uiNumModels;
+    Report          *pReport;
+
+    TraceBegin("sample");
+    pArena = NULL;
+    pPEInfo = NULL;
+    pRegionCollector = NULL;
+    arrNGram = NULL;
+    uiNumModels = 0;
+    pReport = NULL;
+    rc = init_modules(&pArena, &pPEInfo, &pRegionCollector, &pReport, pOpt);
+    if (rc != 0)
+        goto DEINIT;
+
+    /* Prepare the basic PE features. */
+    rc = parse_pe_info(pPEInfo, pOpt->cszInput, pSample);
+    if (rc != 0)
+        goto DEINIT;
+
+    /* Select the features for n-gram model generation. */
+    rc = select_features(pRegionCollector, pPEInfo, pOpt);
+    if (rc != 0)
+        goto DEINIT;
+
+    /* Generate the models with the selected features. */
+    rc = init_models(&arrNGram, &uiNumModels, pArena, pRegionCollector, pOpt);
+    if (rc != 0)
+        goto DEINIT;
+    rc = generate_model(arrNGram, uiNumModels, pOpt, pPEInfo, pRegionCollector);
+    if (rc != 0)
+        goto DEINIT;
+
+    /* Generate the relevant reports for the model. */
+    rc = generate_report(pReport, pPEInfo, pRegionCollector, arrNGram, uiNumModels, pOpt);
+    if (rc != 0)
+        goto DEINIT;
+
+DEINIT:
+    StatsSampleEnd();
+    /* The events of a failed sample are dumped as well, so they are not carried over to the next one. */
+    if (pOpt->bPerf == true)
+        PerfDumpSample(stdout, (pPEInfo != NULL)? pPEInfo->szSampleName : NULL);
+    TraceEnd("sample");
+    deinit_models(arrNGram, uiNumModels);
+    deinit_modules(pArena, pPEInfo, pRegionCollector, pReport);
+    return rc;
+}
+
+
+int analyze_batch(Opt *pOpt) {
+    int             rc, rcSample;
+    const char      *cszOutRoot;
+    char            szPathOut[BUF_SIZE_MID + 1];
+    Ingest          ingest;
+    IngestSample    *pSample;
+    Opt             optSample;
+
+    /* The reports of each sample are placed in its own folder under the output root. */
+    rc = 0;
+    cszOutRoot = pOpt->cszOutput;
+    try {
+        Mkdir(cszOutRoot, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    } catch(EXCEPT_IO_DIR_MAKE) {
+        rc = -1;
+    } end_try;
+    if (rc != 0)
+        return rc;
+
+    /* Let the loader read the following samples while the current one is analyzed. */
+    rc = IngestOpen(&ingest, pOpt->cszInput);
+    if (rc != 0) {
+        IngestClose(&ingest);
+        return rc;
+    }
+
+    optSample = *pOpt;
+    while ((pSample = IngestNext(&ingest)) != NULL) {
+        if (pSample->iErrno != 0) {
+            Log2("The sample cannot be loaded (%s: %s).\n", pSample->szPath, strerror(pSample->iErrno));
+            IngestRelease(&ingest, pSample);
+            rc = -1;
+            continue;
+        }
+        if ((strlen(cszOutRoot) + strlen(pSample->szName) + 1) > BUF_SIZE_MID) {
+            Log1("The output path is too long (%s).\n", pSample->szName);
+            IngestRelease(&ingest, pSample);
+            rc = -1;
+            continue;
+        }
+
+        memset(szPathOut, 0, sizeof(char) * (BUF_SIZE_MID + 1));
+        if (cszOutRoot[strlen(cszOutRoot) - 1] == OS_PATH_SEPARATOR)
+            sprintf(szPathOut, "%s%s", cszOutRoot, pSample->szName);
+        else
+            sprintf(szPathOut, "%s%c%s", cszOutRoot, OS_PATH_SEPARATOR, pSample->szName);
+        optSample.cszInput = pSample->szPath;
+        optSample.cszOutput = szPathOut;
+
+        /* A broken sample should not stop the rest of the batch. */
+        rcSample = analyze_sample(&optSample, pSample);
+        if (rcSample != 0)
+            rc = rcSample;
+        IngestRelease(&ingest, pSample);
+    }
+    IngestClose(&ingest);
+
+    return rc;
+}
+
+
+int analyze_carve(Opt *pOpt) {
+    int         rc, i, iNumThreads;
+    long        lNumCpus;
+    Carve       carve;
+    CarveJob    job;
+    pthread_t   arrThread[CARVE_MAX_WORKERS];
+
+    /* The reports of each image are placed in its own folder under the output root. */
+    rc = 0;
+    try {
+        Mkdir(pOpt->cszOutput, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    } catch(EXCEPT_IO_DIR_MAKE) {
+        rc = -1;
+    } end_try;
+    if (rc != 0)
+        return rc;
+
+    /* Locate all the images before any of them is analyzed. */
+    rc = CarveOpen(&carve, pOpt->cszInput);
+    if (rc != 0)
+        goto EXIT;
+    TraceBegin("carve_scan");
+    rc = CarveScan(&carve);
+    TraceEnd("carve_scan");
+    if (rc != 0)
+        goto EXIT;
+
+    /* The hardware event counters only follow the calling thread. */
+    iNumThreads = 0;
+    if (pOpt->bPerf == false) {
+        lNumCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (lNumCpus > CARVE_MAX_WORKERS)
+            lNumCpus = CARVE_MAX_WORKERS;
+        if (lNumCpus > (long)carve.ulNumImages)
+            lNumCpus = carve.ulNumImages;
+        if (lNumCpus > 1)
+            iNumThreads = lNumCpus - 1;
+    }
+
+    /* The calling thread takes the images along with the helper threads. */
+    job.pOpt = pOpt;
+    job.pCarve = &carve;
+    job.ulIdxNext = 0;
+    job.rc = 0;
+    for (i = 0 ; i < iNumThreads ; i++) {
+        if (pthread_create(&(arrThread[i]), NULL, analyze_carved_images, &job) != 0)
+            break;
+    }
+    iNumThreads = i;
+    analyze_carved_images(&job);
+    for (i = 0 ; i < iNumThreads ; i++)
+        pthread_join(arrThread[i], NULL);
+    rc = job.rc;
+
+EXIT:
+    CarveClose(&carve);
+    return rc;
+}
+
+
+void* analyze_carved_images(void *vpJob) {
+    int             rc, iLenImage, iLenOut;
+    ulong           ulIdx;
+    const char      *cszOutRoot, *cszDumpName;
+    char            szPathImage[BUF_SIZE_MID + 1], szPathOut[BUF_SIZE_MID + 1];
+    CarveJob        *pJob;
+    CarveImage      *pImage;
+    IngestSample    sample;
+    Opt             optImage;
+
+    /* The images are named after the input and their offsets in it. */
+    pJob = (CarveJob*)vpJob;
+    cszOutRoot = pJob->pOpt->cszOutput;
+    cszDumpName = strrchr(pJob->pOpt->cszInput, OS_PATH_SEPARATOR);
+    cszDumpName = (cszDumpName == NULL)? pJob->pOpt->cszInput : (cszDumpName + 1);
+    optImage = *(pJob->pOpt);
+
+    while ((ulIdx = __atomic_fetch_add(&(pJob->ulIdxNext), 1, __ATOMIC_RELAXED)) < pJob->pCarve->ulNumImages) {
+        pImage = pJob->pCarve->arrImage + ulIdx;
+        iLenImage = snprintf(szPathImage, BUF_SIZE_MID + 1, "%s_0x%08lx.pe", pJob->pOpt->cszInput, pImage->ulOffset);
+        if (cszOutRoot[strlen(cszOutRoot) - 1] == OS_PATH_SEPARATOR)
+            iLenOut = snprintf(szPathOut, BUF_SIZE_MID + 1, "%s%s_0x%08lx", cszOutRoot, cszDumpName, pImage->ulOffset);
+        else
+            iLenOut = snprintf(szPathOut, BUF_SIZE_MID + 1, "%s%c%s_0x%08lx", cszOutRoot, OS_PATH_SEPARATOR,
+                               cszDumpName, pImage->ulOffset);
+        if ((iLenImage > BUF_SIZE_MID) || (iLenOut > BUF_SIZE_MID)) {
+            Log1("The output path is too long (0x%08lx).\n", pImage->ulOffset);
+            __atomic_store_n(&(pJob->rc), -1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* The image is a slice of the mapped input, so it is analyzed in place. */
+        memset(&sample, 0, sizeof(IngestSample));
+        sample.uszData = pJob->pCarve->uszData + pImage->ulOffset;
+        sample.nSize = pImage->ulSize;
+        optImage.cszInput = szPathImage;
+        optImage.cszOutput = szPathOut;
+
+        /* A broken image should not stop the rest of the input. */
+        rc = analyze_sample(&optImage, &sample);
+        if (rc != 0)
+            __atomic_store_n(&(pJob->rc), rc, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+
+int parse_pe_info(PEInfo *pPEInfo, const char *cszInput, IngestSample *pSample) {
     int rc;
 
     /* Open the input sample for analysis. */
-    rc = pPEInfo->openSample(pPEInfo, cszInput);
+    if (pSample != NULL)
+        rc = pPEInfo->openBuffer(pPEInfo, cszInput, pSample->uszData, pSample->nSize);
+    else
+        rc = pPEInfo->openSample(pPEInfo, cszInput);
     if (rc != 0)
         goto EXIT;
 
     /* Collect the header information of the input sample. */
+    StatsPhaseBegin(STATS_PHASE_PARSE_HEADERS);
+    TraceBegin("parse_headers");
     rc = pPEInfo->parseHeaders(pPEInfo);
+    TraceEnd("parse_headers");
+    StatsPhaseEnd(STATS_PHASE_PARSE_HEADERS);
     if (rc != 0)
         goto EXIT;
 
     /* Calculate and collect entropy data for each section. */
+    StatsPhaseBegin(STATS_PHASE_SECTION_ENTROPY);
+    TraceBegin("section_entropy");
     rc = pPEInfo->calculateSectionEntropy(pPEInfo);
+    TraceEnd("section_entropy");
+    StatsPhaseEnd(STATS_PHASE_SECTION_ENTROPY);
     if (rc != 0)
         goto EXIT;
 
@@ -289,49 +873,103 @@ EXIT:
 }
 
 
-int select_features(RegionCollector *pRegionCollector, PEInfo *pPEInfo) {
-    return pRegionCollector->selectFeatures(pRegionCollector, pPEInfo);
+int select_features(RegionCollector *pRegionCollector, PEInfo *pPEInfo, Opt *pOpt) {
+    int rc;
+
+    StatsPhaseBegin(STATS_PHASE_SELECT_FEATURES);
+    TraceBegin("select_features");
+    if (pOpt->bPerSection == true)
+        rc = pRegionCollector->selectSections(pRegionCollector, pPEInfo);
+    else
+        rc = pRegionCollector->selectFeatures(pRegionCollector, pPEInfo);
+    if (rc == 0)
+        rc = pRegionCollector->normalizeRanges(pRegionCollector, pPEInfo);
+    TraceEnd("select_features");
+    StatsPhaseEnd(STATS_PHASE_SELECT_FEATURES);
+
+    return rc;
 }
 
 
-int generate_model(NGram *pNGram, uchar ucDimension, PEInfo *pPEInfo,
+int generate_model(NGram **arrNGram, uint uiNumModels, Opt *pOpt, PEInfo *pPEInfo,
                    RegionCollector *pRegionCollector) {
-    /* Set the maximum value of a n-gram token. */
-    pNGram->setDimension(pNGram, ucDimension);
-    /* Generate the model. */
-    return pNGram->generateModel(pNGram, pPEInfo, pRegionCollector);
+    uint        i;
+    NGram       *pNGram;
+    SectionInfo *pSection;
+
+    for (i = 0 ; i < uiNumModels ; i++) {
+        /* Set the maximum value of a n-gram token. */
+        pNGram = arrNGram[i];
+        pNGram->setDimension(pNGram, pOpt->arrDimension[i % pOpt->ucNumDimensions]);
+
+        /* Restrict the model to the raw data of its section. */
+        if (pOpt->bPerSection == true) {
+            pSection = pPEInfo->arrSectionInfo[pRegionCollector->arrRegion[i / pOpt->ucNumDimensions]->usIdxSection];
+            pNGram->setRange(pNGram, pSection->ulRawOffset, pSection->ulRawOffset + pSection->ulRawSize);
+        }
+    }
+
+    /* Generate all the models in one pass over the selected features. */
+    return NGramGenerateModels(arrNGram, uiNumModels, pPEInfo, pRegionCollector);
 }
 
 
-int generate_report(Report *pReport, PEInfo *pPEInfo, NGram *pNGram, const char *cszOutDir, uint uiMask) {
-    int rc;
-    const char *cszSampleName;
+int generate_report(Report *pReport, PEInfo *pPEInfo, RegionCollector *pRegionCollector,
+                    NGram **arrNGram, uint uiNumModels, Opt *pOpt) {
+    int rc, iLen;
+    uint i;
+    const char *cszSampleName, *cszOutDir;
+    char szModelName[BUF_SIZE_MID + 1];
 
     /* Retrieve the sample name. */
+    rc = 0;
     cszSampleName = pPEInfo->szSampleName;
+    cszOutDir = pOpt->cszOutput;
+    StatsPhaseBegin(STATS_PHASE_GENERATE_REPORT);
+    TraceBegin("generate_report");
 
     /* Generate the entropy distribution report. */
-    if (uiMask & MASK_REPORT_SECTION_ENTROPY) {
+    if (pOpt->uiMask & MASK_REPORT_SECTION_ENTROPY) {
         rc = pReport->logEntropyDistribution(pReport, pPEInfo, cszOutDir, cszSampleName);
         if (rc != 0)
             goto EXIT;
     }
 
-    /* Generate the full n-gram model report. */
-    if (uiMask & MASK_REPORT_TXT_NGRAM) {
-        rc = pReport->logNGramModel(pReport, pNGram, cszOutDir, cszSampleName);
-        if (rc != 0)
-            goto EXIT;
-    }
+    for (i = 0 ; i < uiNumModels ; i++) {
+        /* The reports of each model are tagged with its section and its dimension. */
+        memset(szModelName, 0, sizeof(char) * (BUF_SIZE_MID + 1));
+        iLen = snprintf(szModelName, BUF_SIZE_MID, "%s", cszSampleName);
+        if (pOpt->bPerSection == true)
+            iLen += snprintf(szModelName + iLen, BUF_SIZE_MID - iLen, "_sec%d",
+                             pRegionCollector->arrRegion[i / pOpt->ucNumDimensions]->usIdxSection);
+        if (pOpt->ucNumDimensions > 1)
+            snprintf(szModelName + iLen, BUF_SIZE_MID - iLen, "_d%d",
+                     pOpt->arrDimension[i % pOpt->ucNumDimensions]);
+
+        /* Generate the full n-gram model report. */
+        if (pOpt->uiMask & MASK_REPORT_TXT_NGRAM) {
+            rc = pReport->logNGramModel(pReport, arrNGram[i], cszOutDir, szModelName);
+            if (rc != 0)
+                goto EXIT;
+        }
 
-    /* Generate the visualized n-gram model. */
-    if (uiMask & MASK_REPORT_PNG_NGRAM) {
-        rc = pReport->plotNGramModel(pReport, pNGram, cszOutDir, cszSampleName);
-        if (rc != 0)
-            goto EXIT;
+        /* Generate the visualized n-gram model. */
+        if (pOpt->uiMask & MASK_REPORT_PNG_NGRAM) {
+            rc = pReport->plotNGramModel(pReport, arrNGram[i], cszOutDir, szModelName);
+            if (rc != 0)
+                goto EXIT;
+        }
+
+        /* Generate the summary of the profile windows. */
+        if (pOpt->ulWindowSize != 0) {
+            rc = pReport->logNGramWindows(pReport, arrNGram[i], cszOutDir, szModelName);
+            if (rc != 0)
+                goto EXIT;
+        }
     }
 
 EXIT:
+    TraceEnd("generate_report");
+    StatsPhaseEnd(STATS_PHASE_GENERATE_REPORT);
     return rc;
 }
-
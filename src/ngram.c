@@ -4,25 +4,456 @@
 /*===========================================================================*
  *                  Simulation for private variables                         *
  *===========================================================================*/
-/* The maximum value of the n-gram token with the specified dimension. */
-uchar _ucDimension;
-ulong _ulMaxValue;
+/* Structure to record a run of the constant blocks found by the entropy profile. The
+   blocks may hold different byte values, so the value can change only at the block
+   boundaries ulOstGrid + k * ENTROPY_BLK_SIZE. */
+typedef struct _NGramRun {
+    ulong   ulOstBgn, ulOstEnd, ulOstGrid;
+} NGramRun;
+
+
+/* Structure to rank the tokens of the current profile window. The live tokens are
+   kept in arrLive in the descending order of their counts, and arrFirst[c] is the
+   index of the first live token whose count is at most c. A count then changes by
+   one with a single swap at the edge of its block, and the top tokens are always
+   the head of arrLive. The count and the index of a token share an entry of arrRank,
+   so each update touches one line of it. */
+typedef struct _NGramRank {
+    uint    uiCount, uiPos;
+} NGramRank;
+
+typedef struct _NGramRanking {
+    NGramRank   *arrRank;
+    uint        *arrLive, *arrFirst;
+    ulong   ulNumLive, ulNumTokens;
+} NGramRanking;
+
+
+/* Structure to read the bytes of a piece at the increasing file offsets. */
+typedef struct _NGramCursor {
+    ulong   ulOstBuf, ulOstEnd;
+    size_t  nLength;
+    uchar   *uszBuf, *uszData;
+} NGramCursor;
 
 
 /*===========================================================================*
  *                  Definition for internal functions                        *
  *===========================================================================*/
 /**
- * This function collects the n-gram tokens from the specified binary regions.
+ * This function collects the n-gram tokens from the specified binary regions for
+ * all the given models. Each chunk of the regions is read once and tokenized by the
+ * kernel of every model while it is still in cache.
  *
- * @param   self                The pointer to the NGram structure.
+ * @param   arrNGram            The array of the NGram structures.
+ * @param   uiNumModels         The number of the NGram structures.
  * @param   pPEInfo             The pointer to the to be analyzed PEInfo structure.
  * @param   pRegionCollector    The pointer to the RegionCollector structure which stores all the selected features.
  *
  * @return                      0: The tokens are collected successfully.
- *                            < 0: Exception occurs while memory allocation.
+ *                            < 0: Exception occurs while memory allocation or file access.
+ */
+int _NGramCollectTokens(NGram **arrNGram, uint uiNumModels, PEInfo *pPEInfo, RegionCollector *pRegionCollector);
+
+
+/**
+ * This function prepares the histogram and picks the counting strategy of a model
+ * for the selected regions.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   ulNumBytes          The total size of the selected regions.
+ *
+ * @return                      EXCEPT_MEM_ALLOC is thrown if the histogram cannot be allocated.
+ */
+void _NGramPrepareHistogram(NGram *self, ulong ulNumBytes);
+
+
+/**
+ * This function collects the runs of the blocks whose entropy is 0 from the measured
+ * sections. The runs are sorted by file offset, and the part of a run overlapped by
+ * the previous one is trimmed.
+ *
+ * @param   pPEInfo             The pointer to the to be analyzed PEInfo structure.
+ * @param   pArena              The arena to allocate the runs.
+ * @param   parrRun             The pointer to the returned array of runs.
+ *
+ * @return                      The number of runs.
+ *                              EXCEPT_MEM_ALLOC is thrown if the runs cannot be allocated.
+ */
+ulong _NGramCollectRuns(PEInfo *pPEInfo, Arena *pArena, NGramRun **parrRun);
+
+
+/**
+ * This function compares two runs by their starting offsets.
+ *
+ * @param   vpSrc               The pointer to the source run.
+ * @param   vpTge               The pointer to the target run.
+ *
+ * @return                      The comparison result for qsort().
+ */
+int _NGramCompareRun(const void *vpSrc, const void *vpTge);
+
+
+/**
+ * This function counts the tokens of the bytes repeating a single value without
+ * sliding over them. Each of these bytes adds the same 8 tokens, so the counts are
+ * added at once, and the window is left as if the bytes were fed.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   ucValue             The repeated byte value.
+ * @param   ulNumBytes          The number of the skipped bytes.
+ */
+void _NGramSkipRepeat(NGram *self, uchar ucValue, ulong ulNumBytes);
+
+
+/**
+ * This function adds the count of a token to the histogram used by the counting
+ * strategy of the model.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   ulTokenVal          The token value.
+ * @param   ulCount             The count to add.
+ */
+static inline __attribute__((always_inline))
+void _NGramCountToken(NGram *self, ulong ulTokenVal, ulong ulCount);
+
+
+/**
+ * This function hashes a block for the deduplication table.
+ *
+ * @param   uszBlock            The block of NGRAM_DEDUP_BLK_SIZE bytes.
+ *
+ * @return                      The hash value.
+ */
+ulong _NGramHashBlock(const uchar *uszBlock);
+
+
+/**
+ * This function looks up a block in the deduplication table. A block seen for the
+ * first time is copied into the table if there is still room.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   uszBlock            The block of NGRAM_DEDUP_BLK_SIZE bytes.
+ *
+ * @return                      The pointer to the recorded copy of the block.
+ *                              NULL if the block is not recorded before.
+ */
+NGramBlock* _NGramLookupBlock(NGram *self, const uchar *uszBlock);
+
+
+/**
+ * This function slides the token window over a part of a chunk. With the block
+ * deduplication, only the first ucDimension bytes of a repeated block are slid,
+ * which complete the tokens crossing into it, and the rest of its tokens are left
+ * to _NGramFlushBlocks().
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   buf                 The chunk of binary.
+ * @param   ulOstBuf            The file offset of the chunk.
+ * @param   ulOstBgn            The file offset to start the tokenization.
+ * @param   ulOstEnd            The file offset to stop the tokenization.
+ */
+void _NGramFeedBlocks(NGram *self, const uchar *buf, ulong ulOstBuf, ulong ulOstBgn, ulong ulOstEnd);
+
+
+/**
+ * This function counts the tokens within each recorded block once, weighted by the
+ * number of its repeats.
+ *
+ * @param   self                The pointer to the NGram structure.
+ */
+void _NGramFlushBlocks(NGram *self);
+
+
+/**
+ * This function finds the cache key of the model. The model is cacheable only if
+ * its tokens come from the raw data of a single section without a restart inside.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pPEInfo             The pointer to the to be analyzed PEInfo structure.
+ * @param   pRegionCollector    The pointer to the RegionCollector structure.
+ *
+ * @return                      The pointer to the cache key of the section.
+ *                              NULL if the model is not cacheable.
+ */
+CacheKey* _NGramFindCacheKey(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector);
+
+
+/**
+ * This function loads the token histogram of the model from the result cache.
+ *
+ * @param   self                The pointer to the NGram structure with the cache key.
+ *
+ * @return                      0: The histogram is loaded.
+ *                            < 0: The entry does not exist or does not fit the model.
+ *                              EXCEPT_MEM_ALLOC is thrown if the histogram cannot be allocated.
+ */
+int _NGramLoadHistogram(NGram *self);
+
+
+/**
+ * This function stores the token histogram of the model into the result cache as
+ * the pairs of the token value and the frequency.
+ *
+ * @param   self                The pointer to the NGram structure with the cache key.
+ *
+ * @return                      EXCEPT_MEM_ALLOC is thrown if the entry cannot be allocated.
+ */
+void _NGramStoreHistogram(NGram *self);
+
+
+/**
+ * This function moves the profile windows of the model along the selected ranges.
+ * The ranges are cut at the restarts of the token window, and the windows of each
+ * piece start ulProfileStep bytes apart. The tokens are counted as if each window
+ * were modeled on its own, but only the tokens entering and leaving a window are
+ * updated, so the cost is linear in the selected bytes.
+ *
+ * @param   self                The pointer to the NGram structure with the window size and step.
+ * @param   pPEInfo             The pointer to the to be analyzed PEInfo structure.
+ * @param   pRegionCollector    The pointer to the RegionCollector structure which stores all the selected features.
+ *
+ * @return                      0: The windows are profiled successfully.
+ *                            < 0: Exception occurs while memory allocation or file access.
+ */
+int _NGramProfileWindows(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector);
+
+
+/**
+ * This function profiles the windows of a piece and appends their summaries to the model.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pReader             The reader of the sample.
+ * @param   pRank               The pointer to the empty ranking.
+ * @param   arrCursor           The 4 cursors, for the entering and the leaving byte-aligned and shifted tokens.
+ * @param   ulOstBgn            The starting file offset of the piece.
+ * @param   ulOstEnd            The ending file offset of the piece (exclusive).
+ *
+ * @return                      0: The piece is profiled successfully and the ranking is emptied.
+ *                            < 0: The piece can not be fully read.
+ */
+int _NGramProfilePiece(NGram *self, Reader *pReader, NGramRanking *pRank, NGramCursor *arrCursor,
+                       ulong ulOstBgn, ulong ulOstEnd);
+
+
+/**
+ * This function moves the starting positions of one kind of tokens in the window to
+ * [ulOstBgn, ulOstEnd). The positions leaving the window are subtracted first, and
+ * then the entering ones are added, so the positions between two distant windows are
+ * never read.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pReader             The reader of the sample.
+ * @param   pRank               The pointer to the ranking.
+ * @param   pHead               The cursor of the entering positions.
+ * @param   pTail               The cursor of the leaving positions.
+ * @param   pulOstLow           The pointer to the first position in the window.
+ * @param   pulOstHigh          The pointer to the position past the last one in the window.
+ * @param   ulOstBgn            The new first position.
+ * @param   ulOstEnd            The new position past the last one.
+ * @param   bShifted            Whether the positions start the 7 tokens at the bit offsets,
+ *                              or the single byte-aligned token.
+ *
+ * @return                      0: The positions are moved successfully.
+ *                            < 0: The bytes can not be read.
  */
-int _NGramCollectTokens(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector);
+int _NGramMoveProfile(NGram *self, Reader *pReader, NGramRanking *pRank, NGramCursor *pHead, NGramCursor *pTail,
+                      ulong *pulOstLow, ulong *pulOstHigh, ulong ulOstBgn, ulong ulOstEnd, bool bShifted);
+
+
+/**
+ * This function returns the bytes of the piece starting at the specified offset.
+ * The cursor only moves forward, and it reads the next chunk when the bytes run out.
+ *
+ * @param   pCursor             The pointer to the cursor.
+ * @param   pReader             The reader of the sample.
+ * @param   ulOst               The file offset, which is not less than the previous one.
+ * @param   nNeed               The number of bytes needed, which are within the piece.
+ *
+ * @return                      The pointer to the bytes.
+ *                              NULL if the bytes can not be read.
+ */
+const uchar* _NGramFetchCursor(NGramCursor *pCursor, Reader *pReader, ulong ulOst, size_t nNeed);
+
+
+/**
+ * This function adds or subtracts the tokens starting at a position of the ranking.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pRank               The pointer to the ranking.
+ * @param   uszData             The bytes starting at the position.
+ * @param   bShifted            Whether to rank the 7 tokens at the bit offsets, or the
+ *                              single byte-aligned token.
+ * @param   bEnter              Whether the tokens enter or leave the window.
+ */
+static inline __attribute__((always_inline))
+void _NGramRankPosition(NGram *self, NGramRanking *pRank, const uchar *uszData, bool bShifted, bool bEnter);
+
+
+/**
+ * This function adds or subtracts a token of the ranking. The dummy tokens are ignored
+ * as the model does.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pRank               The pointer to the ranking.
+ * @param   ulTokenVal          The token value.
+ * @param   bEnter              Whether the token enters or leaves the window.
+ */
+static inline __attribute__((always_inline))
+void _NGramRankToken(NGram *self, NGramRanking *pRank, ulong ulTokenVal, bool bEnter);
+
+
+/**
+ * This function summarizes the ranking of the current window. The top tokens are
+ * listed in the descending order of the frequency, and then the ascending order of
+ * the value. Among the tokens tied at the cut, the listed ones are arbitrary.
+ *
+ * @param   pRank               The pointer to the ranking.
+ * @param   pProfile            The pointer to the returned summary.
+ */
+void _NGramSummarizeProfile(NGramRanking *pRank, NGramProfile *pProfile);
+
+
+/**
+ * This function slides the token window over a chunk of binary. For each byte
+ * entering the window, the tokens starting at the 8 bit positions of the oldest
+ * byte are counted. It is inlined into the kernel of each dimension, so the masks
+ * become constants and the loop over the 8 bit positions is fully unrolled.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pWindow             The pointer to the window state of the current range.
+ * @param   buf                 The chunk of binary.
+ * @param   nLength             The chunk size.
+ * @param   ucDimension         The dimension of the kernel.
+ */
+static inline __attribute__((always_inline))
+void _NGramSlideWindow(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength,
+                       const uchar ucDimension);
+
+
+/* Kernels of _NGramSlideWindow() specialized for each dimension. */
+#define NGRAM_DEFINE_KERNEL(d)                                                          \
+    void _NGramSlideWindowD##d(NGram *self, NGramWindow *pWindow, const uchar *buf,     \
+                               size_t nLength) {                                        \
+        _NGramSlideWindow(self, pWindow, buf, nLength, d);                              \
+    }
+
+void _NGramSlideWindowD1(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+void _NGramSlideWindowD2(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+void _NGramSlideWindowD3(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+void _NGramSlideWindowD4(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+
+
+/* The dispatch table indexed by the dimension. */
+static const NGramKernel _arrKernel[NGRAM_MAX_DIMENSION + 1] = {
+    NULL,
+    _NGramSlideWindowD1,
+    _NGramSlideWindowD2,
+    _NGramSlideWindowD3,
+    _NGramSlideWindowD4,
+};
+
+
+#if defined(NGRAM_ENABLE_SIMD)
+
+/**
+ * This function slides the token window over a chunk of binary with AVX2. The 8
+ * tokens of each byte are extracted with the variable shifts of two vectors and
+ * counted into the histogram copies of their bit offsets. The dummy tokens are
+ * counted too and dropped by _NGramMergeHistogram().
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pWindow             The pointer to the window state of the current range.
+ * @param   buf                 The chunk of binary.
+ * @param   nLength             The chunk size.
+ */
+void _NGramSlideWindowAvx2(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+
+
+/**
+ * This function slides the token window over a chunk of binary with AVX-512. The 8
+ * tokens of each byte are extracted with a single variable shift, and the lanes
+ * are counted with gather and scatter. It requires the replicated histograms, so
+ * the lanes of a vector never hit the same counter.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pWindow             The pointer to the window state of the current range.
+ * @param   buf                 The chunk of binary.
+ * @param   nLength             The chunk size.
+ */
+void _NGramSlideWindowAvx512(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+
+#endif
+
+
+/**
+ * This function slides the token window over a chunk of binary and buffers the
+ * tokens in the radix partitions instead of counting them in place. The dummy
+ * tokens are buffered too and dropped by _NGramMergeHistogram().
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pWindow             The pointer to the window state of the current range.
+ * @param   buf                 The chunk of binary.
+ * @param   nLength             The chunk size.
+ */
+void _NGramSlideWindowPartition(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength);
+
+
+/**
+ * This function counts the buffered tokens of a partition into its slice of the
+ * token histogram and empties the partition.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   uiPartition         The index of the partition.
+ */
+void _NGramFlushPartition(NGram *self, uint uiPartition);
+
+
+/**
+ * This function buffers a token in its radix partition.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   ulTokenVal          The token value.
+ */
+static inline __attribute__((always_inline))
+void _NGramPushPartition(NGram *self, ulong ulTokenVal);
+
+
+/**
+ * This function folds the histogram copies of the vector kernels into the token
+ * histogram, drops the dummy tokens and counts the distinct tokens. The result is
+ * identical to the one of the scalar kernels.
+ *
+ * @param   self                The pointer to the NGram structure.
+ */
+void _NGramMergeHistogram(NGram *self);
+
+
+/**
+ * This function slides the token window of a model over the part of a chunk within
+ * the file range of the model. Within a run of constant blocks, only the first bytes
+ * of each value are slid, which still complete the tokens crossing into the run, and
+ * the rest is counted by _NGramSkipRepeat().
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   buf                 The chunk of binary.
+ * @param   ulOstBuf            The file offset of the chunk.
+ * @param   ulOstBgn            The file offset to start the tokenization.
+ * @param   ulOstEnd            The file offset to stop the tokenization.
+ * @param   arrRun              The sorted runs of constant blocks.
+ * @param   ulNumRuns           The number of runs.
+ */
+void _NGramFeedWindow(NGram *self, const uchar *buf, ulong ulOstBuf, ulong ulOstBgn, ulong ulOstEnd,
+                      const NGramRun *arrRun, ulong ulNumRuns);
+
+
+/**
+ * This function counts the last token of the current range and resets the window.
+ *
+ * @param   self                The pointer to the NGram structure.
+ * @param   pWindow             The pointer to the window state of the current range.
+ */
+void _NGramFlushWindow(NGram *self, NGramWindow *pWindow);
 
 
 /*===========================================================================*
@@ -30,12 +461,41 @@ int _NGramCollectTokens(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCo
  *===========================================================================*/
 void NGramInit(NGram *self) {
     /* Initialize member variables. */
-    _ucDimension = 0;
-    _ulMaxValue = 0;
+    self->ucDimension = 0;
+    self->ulMaxValue = 0;
+    self->window.ulValue = 0;
+    self->window.ulNumBytes = 0;
+    self->bVectorKernel = false;
+    self->bPartition = false;
+    self->arrHistogram = NULL;
+    self->ulSubStride = 0;
+    self->arrPartition = NULL;
+    self->arrPartitionFill = NULL;
+    self->bDedupBlocks = false;
+    self->arrBlock = NULL;
+    self->ulNumBlockSlots = 0;
+    self->ulNumBlocks = 0;
+    self->uszBlockPool = NULL;
+    self->cszCacheDir = NULL;
+    self->pCacheKey = NULL;
+    self->bCached = false;
+    self->ulProfileSize = 0;
+    self->ulProfileStep = 0;
+    self->ulNumProfiles = 0;
+    self->arrProfile = NULL;
+    self->slideKernel = NULL;
+    self->slideWindow = NULL;
+    self->ulOstBgn = 0;
+    self->ulOstEnd = ULONG_MAX;
+    self->pArena = NULL;
     self->ulNumTokens = 0;
     self->ulNumSlices = 0;
-    self->arrToken = NULL;
-    self->arrSlice = NULL;
+    self->arrFrequency = NULL;
+    self->tokDenominator.ulValue = 0;
+    self->tokDenominator.ulFrequency = 0;
+    self->arrSliceValue = NULL;
+    self->arrSliceFrequency = NULL;
+    self->arrSliceScore = NULL;
     self->hdlePlug = NULL;
     self->entryPlug = NULL;
 
@@ -43,6 +503,7 @@ void NGramInit(NGram *self) {
     self->loadPlugin = NGramLoadPlugin;
     self->unloadPlugin = NGramUnloadPlugin;
     self->setDimension = NGramSetDimension;
+    self->setRange = NGramSetRange;
     self->generateModel = NGramGenerateModel;
     self->dump = NGramDump;
 
@@ -50,31 +511,14 @@ void NGramInit(NGram *self) {
 }
 
 void NGramDeinit(NGram *self) {
-    int     i;
-    Token   *pToken;
-    Slice   *pSlice;
-
-    if (self->arrToken != NULL) {
-        /* Free the array of Token structures. */
-        for (i = 0 ; i < self->ulNumTokens ; i++) {
-            pToken = self->arrToken[i];
-            if (pToken != NULL) {
-                Free(pToken);
-            }
-        }
-        Free(self->arrToken);
-    }
 
-    if (self->arrSlice != NULL) {
-        /* Free the array of Slice structures. */
-        for (i = 0 ; i < self->ulNumSlices ; i++) {
-            pSlice = self->arrSlice[i];
-            if (pSlice != NULL) {
-                Free(pSlice);
-            }
-        }
-        Free(self->arrSlice);
-    }
+    /* The histogram and the model arrays are released with the arena. */
+    self->ulNumTokens = 0;
+    self->ulNumSlices = 0;
+    self->arrFrequency = NULL;
+    self->arrSliceValue = NULL;
+    self->arrSliceFrequency = NULL;
+    self->arrSliceScore = NULL;
 
     return;
 }
@@ -109,30 +553,91 @@ int NGramUnloadPlugin(NGram *self) {
 }
 
 void NGramSetDimension(NGram *self, uchar ucDimension) {
-    _ucDimension = ucDimension;
-    _ulMaxValue = pow(UNI_GRAM_MAX_VALUE, ucDimension);
+    self->ucDimension = ucDimension;
+    self->ulMaxValue = pow(UNI_GRAM_MAX_VALUE, ucDimension);
+    self->slideKernel = (ucDimension <= NGRAM_MAX_DIMENSION)? _arrKernel[ucDimension] : NULL;
+    self->bVectorKernel = false;
+    if (self->slideKernel == NULL)
+        return;
+
+    /* Pick the widest vector kernel supported by the processor. */
+    #if defined(NGRAM_ENABLE_SIMD)
+        if ((ucDimension <= NGRAM_SUB_HIST_MAX_DIMENSION) && __builtin_cpu_supports("avx512f")) {
+            self->slideKernel = _NGramSlideWindowAvx512;
+            self->bVectorKernel = true;
+        } else if (__builtin_cpu_supports("avx2")) {
+            self->slideKernel = _NGramSlideWindowAvx2;
+            self->bVectorKernel = true;
+        }
+    #endif
+
+    return;
+}
+
+void NGramSetRange(NGram *self, ulong ulOstBgn, ulong ulOstEnd) {
+    self->ulOstBgn = ulOstBgn;
+    self->ulOstEnd = ulOstEnd;
     return;
 }
 
 int NGramGenerateModel(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector) {
-    /* First, collect tokens from the specified binary regions. */
-    int rc = _NGramCollectTokens(self, pPEInfo, pRegionCollector);
+    return NGramGenerateModels(&self, 1, pPEInfo, pRegionCollector);
+}
+
+int NGramGenerateModels(NGram **arrNGram, uint uiNumModels, PEInfo *pPEInfo, RegionCollector *pRegionCollector) {
+    int   rc;
+    uint  i;
+    NGram *self;
+
+    /* First, collect tokens of all the models from the specified binary regions. */
+    StatsPhaseBegin(STATS_PHASE_COLLECT_TOKENS);
+    TraceBegin("collect_tokens");
+    rc = _NGramCollectTokens(arrNGram, uiNumModels, pPEInfo, pRegionCollector);
+    TraceEnd("collect_tokens");
+    StatsPhaseEnd(STATS_PHASE_COLLECT_TOKENS);
     if (rc != 0)
         return rc;
 
-    /* Second, generate model using the specified method. */
-    return self->entryPlug(self, _ulMaxValue);
+    /* Then, profile the windows along the regions for the models asking for them. */
+    for (i = 0 ; i < uiNumModels ; i++) {
+        self = arrNGram[i];
+        if (self->ulProfileSize == 0)
+            continue;
+        StatsPhaseBegin(STATS_PHASE_COLLECT_TOKENS);
+        TraceBegin("profile_windows");
+        rc = _NGramProfileWindows(self, pPEInfo, pRegionCollector);
+        TraceEnd("profile_windows");
+        StatsPhaseEnd(STATS_PHASE_COLLECT_TOKENS);
+        if (rc != 0)
+            return rc;
+    }
+
+    /* Second, generate each model using the specified method. */
+    for (i = 0 ; i < uiNumModels ; i++) {
+        self = arrNGram[i];
+        StatsCount(STATS_COUNTER_DISTINCT_TOKENS, self->ulNumTokens);
+
+        StatsPhaseBegin(STATS_PHASE_GENERATE_MODEL);
+        TraceBegin("generate_model");
+        rc = self->entryPlug(self, self->ulMaxValue);
+        TraceEnd("generate_model");
+        StatsPhaseEnd(STATS_PHASE_GENERATE_MODEL);
+        if (rc != 0)
+            break;
+    }
+
+    return rc;
 }
 
 void NGramDump(NGram *self) {
-    int     i;
-    Token   *pToken;
+    ulong   i, j;
 
     /* Dump the n-gram tokens. */
-    for (i = 0 ; i < self->ulNumTokens ; i++) {
-        pToken = self->arrToken[i];
-        if (pToken != NULL)
-            printf("%d\t%04lx\t%lu\n", i, pToken->ulValue, pToken->ulFrequency);
+    if (self->arrFrequency == NULL)
+        return;
+    for (i = 0, j = 0 ; i < self->ulMaxValue ; i++) {
+        if (self->arrFrequency[i] != 0)
+            printf("%lu\t%04lx\t%lu\n", j++, i, self->arrFrequency[i]);
     }
 
     return;
@@ -142,148 +647,1041 @@ void NGramDump(NGram *self) {
 /*===========================================================================*
  *                Implementation for internal functions                      *
  *===========================================================================*/
-int _NGramCollectTokens(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector) {
-    int         rc, i, j, k;
-    char        cIdxBitVF, cIdxBitVT, cIdxBitCur;
-    uchar       ucBitVal, ucMask;
-    ushort      usNumRegions, usShiftPos, usIdxSection;
-    ulong       ulSecRawSize, ulSecRawOffset, ulIdxBgn, ulIdxEnd, ulOstBgn, ulOstEnd, ulRegionSize;
-    ulong       ulIdxByteRF, ulIdxByteVF, ulIdxByteVT, ulIdxByteCur, ulTokenVal;
+int _NGramCollectTokens(NGram **arrNGram, uint uiNumModels, PEInfo *pPEInfo, RegionCollector *pRegionCollector) {
+    int         rc;
+    uint        m;
+    ulong       i, j, ulOstRead, ulOstFed, ulOstStop, ulOstBgn, ulOstEnd, ulNumBytes, ulNumRuns;
     size_t      nExptRead, nRealRead;
-    Region      *pRegion;
-    RangePair   **arrRangePair;
-    uchar       buf[BUF_SIZE_LARGE];
+    Span        *pSpan;
+    Reader      *pReader;
+    NGram       *self;
+    NGramRun    *arrRun;
+    uchar       *buf;
 
     rc = 0;
     try {
-        usNumRegions = pRegionCollector->usNumRegions;
-        if (usNumRegions == 0)
+        if (pRegionCollector->ulNumSpans == 0)
             goto EXIT;
 
-        if (_ucDimension == 0)
-            goto EXIT;
+        for (m = 0 ; m < uiNumModels ; m++) {
+            if (arrNGram[m]->slideKernel == NULL)
+                goto EXIT;
+        }
 
-        self->arrToken = (Token**)Calloc(_ulMaxValue, sizeof(Token*));
-        for (i = 0 ; i < _ulMaxValue ; i++)
-            self->arrToken[i] = NULL;
-
-        usShiftPos = _ucDimension * SHIFT_RANGE_8BIT;
-
-        for (i = 0 ; i < usNumRegions ; i++) {
-            /* Collect the n-gram tokens block by block within the current region(section). */
-            pRegion = pRegionCollector->arrRegion[i];
-            usIdxSection = pRegion->usIdxSection;
-            ulSecRawSize = pPEInfo->arrSectionInfo[usIdxSection]->ulRawSize;
-            ulSecRawOffset = pPEInfo->arrSectionInfo[usIdxSection]->ulRawOffset;
-
-            arrRangePair = pRegion->arrRangePair;
-            for (j = 0 ; j < pRegion->ulNumPairs ; j++) {
-                ulIdxBgn = arrRangePair[j]->ulIdxBgn;
-                ulIdxEnd = arrRangePair[j]->ulIdxEnd;
-
-                /* Transform the data block index to the raw binary offset. */
-                ulOstBgn = ulSecRawOffset + ulIdxBgn * ENTROPY_BLK_SIZE;
-                ulOstEnd = ulSecRawOffset + ulIdxEnd * ENTROPY_BLK_SIZE;
-                ulRegionSize = ulOstEnd - ulOstBgn;
-
-                /*---------------------------------------------------*
-                 * Main algorithm for the n-gram token collection.   *
-                 *---------------------------------------------------*/
-                /* Preload a chunk of binary. */
-                Fseek(pPEInfo->fpSample, ulOstBgn, SEEK_SET);
-                nExptRead = (ulRegionSize < BUF_SIZE_LARGE)? ulRegionSize : BUF_SIZE_LARGE;
-                nRealRead = Fread(buf, sizeof(uchar), nExptRead, pPEInfo->fpSample);
-
-                ulIdxByteRF = _ucDimension - 1;
-                ulIdxByteVF = ulIdxByteRF;
-                ulIdxByteVT = 0;
-                cIdxBitVF = 0;
-                cIdxBitVT = BIT_MOST_SIGNIFICANT;
-                while (true) {
-                    /* Generate token using the binary within the sliding window. */
-                    cIdxBitCur = cIdxBitVT;
-                    ulIdxByteCur = ulIdxByteVT;
-                    ulTokenVal = 0;
-                    for (k = 0 ; k < usShiftPos ; k++) {
-                        ucMask = 1;
-                        ucMask <<= cIdxBitCur;
-                        ucBitVal = buf[ulIdxByteCur] & ucMask;
-                        ucBitVal >>= cIdxBitCur;
-                        ulTokenVal = (ulTokenVal << 1) + ucBitVal;
-
-                        cIdxBitCur--;
-                        if (cIdxBitCur < 0) {
-                            cIdxBitCur = BIT_MOST_SIGNIFICANT;
-                            ulIdxByteCur++;
-                            if (ulIdxByteCur == BUF_SIZE_LARGE)
-                                ulIdxByteCur = 0;
-                        }
-                    }
+        pReader = pPEInfo->pReader;
 
-                    /* Ignore the dummy tokens: (ff)+ and (00)+. */
-                    if ((ulTokenVal != 0) && (ulTokenVal != (_ulMaxValue - 1))) {
-                        if (self->arrToken[ulTokenVal] == NULL) {
-                            self->arrToken[ulTokenVal] = (Token*)Malloc(sizeof(Token));
-                            self->arrToken[ulTokenVal]->ulValue = ulTokenVal;
-                            self->arrToken[ulTokenVal]->ulFrequency = 0;
-                            self->ulNumTokens++;
-                        }
-                        self->arrToken[ulTokenVal]->ulFrequency++;
-                    }
+        /* Let the kernel read ahead all the spans while the first one is tokenized. */
+        for (i = 0 ; i < pRegionCollector->ulNumSpans ; i++) {
+            pSpan = &(pRegionCollector->arrSpan[i]);
+            ReaderAdvise(pReader, pSpan->ulOstBgn, pSpan->ulOstEnd);
+        }
 
-                    /* Adjust the front-end location pointers. */
-                    cIdxBitVF--;
-                    if(cIdxBitVF < 0) {
-                        cIdxBitVF = BIT_MOST_SIGNIFICANT;
-
-                        /* Check the condition to terminate the algorithm. */
-                        ulIdxByteRF++;
-                        if(ulIdxByteRF == ulRegionSize)
-                            break;
-
-                        ulIdxByteVF++;
-                        if(ulIdxByteVF == BUF_SIZE_LARGE) {
-                            ulIdxByteVF = 0;
-
-                            /* Put a new chunk of data to the buffer with offset
-                               from 0 to (nExptRead - 1). */
-                            nExptRead = BUF_SIZE_LARGE - _ucDimension;
-                            if (nExptRead > (ulRegionSize - ulIdxByteRF))
-                                nExptRead = ulRegionSize - ulIdxByteRF;
-                            nRealRead = Fread(buf, sizeof(uchar), nExptRead, pPEInfo->fpSample);
-                        }
-                    }
+        /* Take the models of the unchanged sections from the result cache. */
+        for (m = 0 ; m < uiNumModels ; m++) {
+            self = arrNGram[m];
+            self->pCacheKey = NULL;
+            self->bCached = false;
+            if (self->cszCacheDir != NULL)
+                self->pCacheKey = _NGramFindCacheKey(self, pPEInfo, pRegionCollector);
+            if ((self->pCacheKey != NULL) && (_NGramLoadHistogram(self) == 0))
+                self->bCached = true;
+        }
+
+        /* Size the counting strategy of each model by the bytes within its file range. */
+        for (m = 0 ; m < uiNumModels ; m++) {
+            self = arrNGram[m];
+            if (self->bCached)
+                continue;
+            ulNumBytes = 0;
+            for (i = 0 ; i < pRegionCollector->ulNumSpans ; i++) {
+                pSpan = &(pRegionCollector->arrSpan[i]);
+                ulOstBgn = (pSpan->ulOstBgn > self->ulOstBgn)? pSpan->ulOstBgn : self->ulOstBgn;
+                ulOstEnd = (pSpan->ulOstEnd < self->ulOstEnd)? pSpan->ulOstEnd : self->ulOstEnd;
+                if (ulOstBgn < ulOstEnd)
+                    ulNumBytes += ulOstEnd - ulOstBgn;
+            }
+            _NGramPrepareHistogram(self, ulNumBytes);
+        }
 
-                    /* Adjust the tail-end location pointer. */
-                    cIdxBitVT--;
-                    if(cIdxBitVT < 0) {
-                        cIdxBitVT = BIT_MOST_SIGNIFICANT;
-
-                        ulIdxByteVT++;
-                        if(ulIdxByteVT == BUF_SIZE_LARGE) {
-                            ulIdxByteVT = 0;
-
-                            /* Put a new chunk of data to the buffer with offset
-                               from (BUF_SIZE_LARGE - _ucDimension) to (BUF_SIZE_LARGE - 1 - _ucDimension + nExptRead). */
-                            nExptRead = _ucDimension;
-                            if (nExptRead > (ulRegionSize - ulIdxByteRF))
-                                nExptRead = ulRegionSize - ulIdxByteRF;
-                            nRealRead = Fread(buf + BUF_SIZE_LARGE - _ucDimension, sizeof(uchar), nExptRead, pPEInfo->fpSample);
-                        }
+        /* The padding blocks are located by the entropy profile instead of the tokenization. */
+        ulNumRuns = _NGramCollectRuns(pPEInfo, arrNGram[0]->pArena, &arrRun);
+
+        /* The spans are sorted by offset, so the file is read forward only. The span
+           left only to the cached models is not read at all. */
+        for (i = 0 ; i < pRegionCollector->ulNumSpans ; i++) {
+            pSpan = &(pRegionCollector->arrSpan[i]);
+            for (m = 0 ; m < uiNumModels ; m++) {
+                self = arrNGram[m];
+                if ((self->bCached == false) && (self->ulOstBgn < pSpan->ulOstEnd) && (pSpan->ulOstBgn < self->ulOstEnd))
+                    break;
+            }
+            if (m == uiNumModels)
+                continue;
+            TraceBegin("collect_range");
+            ReaderOpenRange(pReader, pSpan->ulOstBgn, pSpan->ulOstEnd);
+
+            ulOstRead = pSpan->ulOstBgn;
+            j = 0;
+            while (ulOstRead < pSpan->ulOstEnd) {
+                nExptRead = pSpan->ulOstEnd - ulOstRead;
+                if (nExptRead > READER_CHUNK_SIZE)
+                    nExptRead = READER_CHUNK_SIZE;
+                TraceBegin("collect_chunk");
+                nRealRead = ReaderFetch(pReader, &buf);
+                if (nRealRead != nExptRead) {
+                    TraceEnd("collect_chunk");
+                    TraceEnd("collect_range");
+                    Log0("Invalid PE file (The selected range can not be reached).\n");
+                    rc = -1;
+                    goto EXIT;
+                }
+
+                /* Restart the windows at each boundary inside the chunk. */
+                ulOstStop = ulOstRead + nRealRead;
+                ulOstFed = ulOstRead;
+                while ((j < pSpan->ulNumBounds) && (pSpan->arrBound[j] < ulOstStop)) {
+                    for (m = 0 ; m < uiNumModels ; m++) {
+                        self = arrNGram[m];
+                        if (self->bCached)
+                            continue;
+                        _NGramFeedWindow(self, buf, ulOstRead, ulOstFed, pSpan->arrBound[j], arrRun, ulNumRuns);
+                        _NGramFlushWindow(self, &(self->window));
                     }
+                    ulOstFed = pSpan->arrBound[j++];
+                }
+                for (m = 0 ; m < uiNumModels ; m++) {
+                    if (arrNGram[m]->bCached == false)
+                        _NGramFeedWindow(arrNGram[m], buf, ulOstRead, ulOstFed, ulOstStop, arrRun, ulNumRuns);
                 }
-                /* End of one binary region. */
+                ulOstRead = ulOstStop;
+                TraceEnd("collect_chunk");
+            }
+            for (m = 0 ; m < uiNumModels ; m++) {
+                if (arrNGram[m]->bCached == false)
+                    _NGramFlushWindow(arrNGram[m], &(arrNGram[m]->window));
             }
-            /* End of one section. */
+            TraceEnd("collect_range");
+        }
+
+        for (m = 0 ; m < uiNumModels ; m++) {
+            self = arrNGram[m];
+            if (self->bCached)
+                continue;
+            if (self->bDedupBlocks)
+                _NGramFlushBlocks(self);
+            if (self->bVectorKernel || self->bPartition)
+                _NGramMergeHistogram(self);
+            if (self->pCacheKey != NULL)
+                _NGramStoreHistogram(self);
         }
     } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
     } catch(EXCEPT_IO_FILE_READ) {
         rc = -1;
-    } catch(EXCEPT_IO_FILE_SEEK) {
+    } end_try;
+
+EXIT:
+    return rc;
+}
+
+void _NGramPrepareHistogram(NGram *self, ulong ulNumBytes) {
+
+    self->arrFrequency = (ulong*)Acalloc(self->pArena, self->ulMaxValue, sizeof(ulong));
+    self->ulNumTokens = 0;
+    self->window.ulValue = 0;
+    self->window.ulNumBytes = 0;
+
+    /* Replicate the small histograms, so the repeated tokens of adjacent bit
+       offsets do not serialize on the same counter. */
+    self->arrHistogram = self->arrFrequency;
+    self->ulSubStride = 0;
+    if (self->bVectorKernel && (self->ucDimension <= NGRAM_SUB_HIST_MAX_DIMENSION)) {
+        self->arrHistogram = (ulong*)Acalloc(self->pArena, self->ulMaxValue * NGRAM_NUM_SUB_HISTS, sizeof(ulong));
+        self->ulSubStride = self->ulMaxValue;
+    }
+
+    /* The dense histogram of dimension 3 is far larger than the cache. For a large
+       input, sort the tokens into the partitions of their high bytes first, so
+       each flush writes to a cache-sized slice of the histogram. */
+    self->bPartition = (self->ucDimension == NGRAM_PARTITION_DIMENSION) && (ulNumBytes >= NGRAM_PARTITION_MIN_BYTES);
+    if (self->bPartition) {
+        self->arrPartition = (ushort*)Amalloc(self->pArena,
+                                              sizeof(ushort) * NGRAM_NUM_PARTITIONS * NGRAM_PARTITION_SIZE);
+        self->arrPartitionFill = (uint*)Acalloc(self->pArena, NGRAM_NUM_PARTITIONS, sizeof(uint));
+    }
+    self->slideWindow = (self->bPartition)? _NGramSlideWindowPartition : self->slideKernel;
+
+    /* Size the deduplication table to twice the blocks of the input. */
+    if (self->bDedupBlocks) {
+        self->ulNumBlockSlots = 16;
+        while ((self->ulNumBlockSlots < NGRAM_DEDUP_MAX_SLOTS) &&
+               (self->ulNumBlockSlots < (ulNumBytes / NGRAM_DEDUP_BLK_SIZE) * 2))
+            self->ulNumBlockSlots <<= 1;
+        self->ulNumBlocks = 0;
+        self->arrBlock = (NGramBlock*)Acalloc(self->pArena, self->ulNumBlockSlots, sizeof(NGramBlock));
+        self->uszBlockPool = (uchar*)Amalloc(self->pArena,
+                                             (self->ulNumBlockSlots / 4 * 3) * NGRAM_DEDUP_BLK_SIZE);
+    }
+
+    return;
+}
+
+static inline __attribute__((always_inline))
+void _NGramSlideWindow(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength,
+                       const uchar ucDimension) {
+    int     k;
+    size_t  i;
+    ulong   ulWindow, ulNumBytes, ulMaskWide, ulMaskToken, ulTokenVal;
+
+    /* The window holds (ucDimension + 1) bytes, so each of the 8 tokens starting
+       in the oldest byte can be extracted with a single shift. */
+    ulMaskWide = (1UL << ((ucDimension + 1) * SHIFT_RANGE_8BIT)) - 1;
+    ulMaskToken = (1UL << (ucDimension * SHIFT_RANGE_8BIT)) - 1;
+    ulWindow = pWindow->ulValue;
+    ulNumBytes = pWindow->ulNumBytes;
+
+    /* Fill the window with the first bytes of the range. */
+    for (i = 0 ; (i < nLength) && (ulNumBytes < ucDimension) ; i++, ulNumBytes++)
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+    ulNumBytes += nLength - i;
+
+    for ( ; i < nLength ; i++) {
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+
+        #pragma GCC unroll 8
+        for (k = 0 ; k < SHIFT_RANGE_8BIT ; k++) {
+            ulTokenVal = (ulWindow >> (SHIFT_RANGE_8BIT - k)) & ulMaskToken;
+
+            /* Ignore the dummy tokens: (ff)+ and (00)+. */
+            if ((ulTokenVal != 0) && (ulTokenVal != ulMaskToken)) {
+                if (self->arrFrequency[ulTokenVal] == 0)
+                    self->ulNumTokens++;
+                self->arrFrequency[ulTokenVal]++;
+            }
+        }
+    }
+
+    pWindow->ulValue = ulWindow;
+    pWindow->ulNumBytes = ulNumBytes;
+    return;
+}
+
+NGRAM_DEFINE_KERNEL(1)
+NGRAM_DEFINE_KERNEL(2)
+NGRAM_DEFINE_KERNEL(3)
+NGRAM_DEFINE_KERNEL(4)
+
+#if defined(NGRAM_ENABLE_SIMD)
+
+__attribute__((target("avx2")))
+void _NGramSlideWindowAvx2(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength) {
+    int     k;
+    size_t  i;
+    ulong   ulWindow, ulNumBytes, ulMaskWide, ulMaskToken, *arrHist;
+    __m256i vShiftLo, vShiftHi, vMask, vBaseLo, vBaseHi, vWindow, vTokenLo, vTokenHi;
+    ulong   arrIdx[SHIFT_RANGE_8BIT] __attribute__((aligned(32)));
+
+    ulMaskWide = (1UL << ((self->ucDimension + 1) * SHIFT_RANGE_8BIT)) - 1;
+    ulMaskToken = self->ulMaxValue - 1;
+    ulWindow = pWindow->ulValue;
+    ulNumBytes = pWindow->ulNumBytes;
+    arrHist = self->arrHistogram;
+
+    /* Lane k extracts the token at bit offset k and points into its histogram copy. */
+    vShiftLo = _mm256_set_epi64x(5, 6, 7, 8);
+    vShiftHi = _mm256_set_epi64x(1, 2, 3, 4);
+    vMask = _mm256_set1_epi64x(ulMaskToken);
+    vBaseLo = _mm256_set_epi64x(3 * self->ulSubStride, 2 * self->ulSubStride, self->ulSubStride, 0);
+    vBaseHi = _mm256_add_epi64(vBaseLo, _mm256_set1_epi64x(4 * self->ulSubStride));
+
+    for (i = 0 ; (i < nLength) && (ulNumBytes < self->ucDimension) ; i++, ulNumBytes++)
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+    ulNumBytes += nLength - i;
+
+    for ( ; i < nLength ; i++) {
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+
+        vWindow = _mm256_set1_epi64x(ulWindow);
+        vTokenLo = _mm256_and_si256(_mm256_srlv_epi64(vWindow, vShiftLo), vMask);
+        vTokenHi = _mm256_and_si256(_mm256_srlv_epi64(vWindow, vShiftHi), vMask);
+        _mm256_store_si256((__m256i*)arrIdx, _mm256_add_epi64(vTokenLo, vBaseLo));
+        _mm256_store_si256((__m256i*)(arrIdx + 4), _mm256_add_epi64(vTokenHi, vBaseHi));
+
+        #pragma GCC unroll 8
+        for (k = 0 ; k < SHIFT_RANGE_8BIT ; k++)
+            arrHist[arrIdx[k]]++;
+    }
+
+    pWindow->ulValue = ulWindow;
+    pWindow->ulNumBytes = ulNumBytes;
+    return;
+}
+
+__attribute__((target("avx512f")))
+void _NGramSlideWindowAvx512(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength) {
+    size_t  i;
+    ulong   ulWindow, ulNumBytes, ulMaskWide, ulMaskToken;
+    __m512i vShift, vMask, vBase, vOne, vIdx, vCount;
+
+    ulMaskWide = (1UL << ((self->ucDimension + 1) * SHIFT_RANGE_8BIT)) - 1;
+    ulMaskToken = self->ulMaxValue - 1;
+    ulWindow = pWindow->ulValue;
+    ulNumBytes = pWindow->ulNumBytes;
+
+    vShift = _mm512_set_epi64(1, 2, 3, 4, 5, 6, 7, 8);
+    vMask = _mm512_set1_epi64(ulMaskToken);
+    vBase = _mm512_set_epi64(7 * self->ulSubStride, 6 * self->ulSubStride, 5 * self->ulSubStride, 4 * self->ulSubStride,
+                             3 * self->ulSubStride, 2 * self->ulSubStride, self->ulSubStride, 0);
+    vOne = _mm512_set1_epi64(1);
+
+    for (i = 0 ; (i < nLength) && (ulNumBytes < self->ucDimension) ; i++, ulNumBytes++)
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+    ulNumBytes += nLength - i;
+
+    for ( ; i < nLength ; i++) {
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+
+        vIdx = _mm512_and_si512(_mm512_srlv_epi64(_mm512_set1_epi64(ulWindow), vShift), vMask);
+        vIdx = _mm512_add_epi64(vIdx, vBase);
+        vCount = _mm512_i64gather_epi64(vIdx, (const void*)self->arrHistogram, sizeof(ulong));
+        _mm512_i64scatter_epi64((void*)self->arrHistogram, vIdx, _mm512_add_epi64(vCount, vOne), sizeof(ulong));
+    }
+
+    pWindow->ulValue = ulWindow;
+    pWindow->ulNumBytes = ulNumBytes;
+    return;
+}
+
+#endif
+
+void _NGramSlideWindowPartition(NGram *self, NGramWindow *pWindow, const uchar *buf, size_t nLength) {
+    int     k;
+    size_t  i;
+    ulong   ulWindow, ulNumBytes, ulMaskWide, ulMaskToken;
+
+    ulMaskWide = (1UL << ((NGRAM_PARTITION_DIMENSION + 1) * SHIFT_RANGE_8BIT)) - 1;
+    ulMaskToken = (1UL << (NGRAM_PARTITION_DIMENSION * SHIFT_RANGE_8BIT)) - 1;
+    ulWindow = pWindow->ulValue;
+    ulNumBytes = pWindow->ulNumBytes;
+
+    for (i = 0 ; (i < nLength) && (ulNumBytes < NGRAM_PARTITION_DIMENSION) ; i++, ulNumBytes++)
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+    ulNumBytes += nLength - i;
+
+    for ( ; i < nLength ; i++) {
+        ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | buf[i]) & ulMaskWide;
+
+        #pragma GCC unroll 8
+        for (k = 0 ; k < SHIFT_RANGE_8BIT ; k++)
+            _NGramPushPartition(self, (ulWindow >> (SHIFT_RANGE_8BIT - k)) & ulMaskToken);
+    }
+
+    pWindow->ulValue = ulWindow;
+    pWindow->ulNumBytes = ulNumBytes;
+    return;
+}
+
+static inline __attribute__((always_inline))
+void _NGramPushPartition(NGram *self, ulong ulTokenVal) {
+    uint uiPartition, uiFill;
+
+    uiPartition = ulTokenVal >> (SHIFT_RANGE_8BIT * 2);
+    uiFill = self->arrPartitionFill[uiPartition];
+    self->arrPartition[uiPartition * NGRAM_PARTITION_SIZE + uiFill] = (ushort)ulTokenVal;
+    if (++uiFill == NGRAM_PARTITION_SIZE) {
+        self->arrPartitionFill[uiPartition] = uiFill;
+        _NGramFlushPartition(self, uiPartition);
+        return;
+    }
+    self->arrPartitionFill[uiPartition] = uiFill;
+
+    return;
+}
+
+void _NGramFlushPartition(NGram *self, uint uiPartition) {
+    uint    i, uiFill;
+    ushort  *arrToken;
+    ulong   *arrSlice;
+
+    uiFill = self->arrPartitionFill[uiPartition];
+    arrToken = self->arrPartition + uiPartition * NGRAM_PARTITION_SIZE;
+    arrSlice = self->arrHistogram + ((ulong)uiPartition << (SHIFT_RANGE_8BIT * 2));
+    for (i = 0 ; i < uiFill ; i++)
+        arrSlice[arrToken[i]]++;
+    self->arrPartitionFill[uiPartition] = 0;
+
+    return;
+}
+
+void _NGramMergeHistogram(NGram *self) {
+    ulong i, k, ulSum;
+
+    if (self->bPartition) {
+        for (i = 0 ; i < NGRAM_NUM_PARTITIONS ; i++)
+            _NGramFlushPartition(self, i);
+    }
+
+    if (self->ulSubStride != 0) {
+        for (i = 0 ; i < self->ulMaxValue ; i++) {
+            ulSum = 0;
+            for (k = 0 ; k < NGRAM_NUM_SUB_HISTS ; k++)
+                ulSum += self->arrHistogram[k * self->ulSubStride + i];
+            self->arrFrequency[i] = ulSum;
+        }
+    }
+
+    /* Ignore the dummy tokens: (ff)+ and (00)+. */
+    self->arrFrequency[0] = 0;
+    self->arrFrequency[self->ulMaxValue - 1] = 0;
+
+    self->ulNumTokens = 0;
+    for (i = 0 ; i < self->ulMaxValue ; i++) {
+        if (self->arrFrequency[i] != 0)
+            self->ulNumTokens++;
+    }
+
+    return;
+}
+
+void _NGramFeedWindow(NGram *self, const uchar *buf, ulong ulOstBuf, ulong ulOstBgn, ulong ulOstEnd,
+                      const NGramRun *arrRun, ulong ulNumRuns) {
+    ulong           ulLow, ulHigh, ulMid, ulOstRun, ulOstStop, ulOstNext;
+    uchar           ucValue;
+    const NGramRun  *pRun;
+
+    if (ulOstBgn < self->ulOstBgn)
+        ulOstBgn = self->ulOstBgn;
+    if (ulOstEnd > self->ulOstEnd)
+        ulOstEnd = self->ulOstEnd;
+    if (ulOstBgn >= ulOstEnd)
+        return;
+
+    /* Find the first run ending after the starting offset. */
+    ulLow = 0;
+    ulHigh = ulNumRuns;
+    while (ulLow < ulHigh) {
+        ulMid = (ulLow + ulHigh) / 2;
+        if (arrRun[ulMid].ulOstEnd <= ulOstBgn)
+            ulLow = ulMid + 1;
+        else
+            ulHigh = ulMid;
+    }
+
+    for ( ; (ulLow < ulNumRuns) && (arrRun[ulLow].ulOstBgn < ulOstEnd) ; ulLow++) {
+        pRun = &(arrRun[ulLow]);
+        ulOstRun = (pRun->ulOstBgn > ulOstBgn)? pRun->ulOstBgn : ulOstBgn;
+        ulOstStop = (pRun->ulOstEnd < ulOstEnd)? pRun->ulOstEnd : ulOstEnd;
+
+        /* Split the run at the blocks where the byte value changes. */
+        while (ulOstRun < ulOstStop) {
+            ucValue = buf[ulOstRun - ulOstBuf];
+            ulOstNext = pRun->ulOstGrid + ((ulOstRun - pRun->ulOstGrid) / ENTROPY_BLK_SIZE + 1) * ENTROPY_BLK_SIZE;
+            while ((ulOstNext < ulOstStop) && (buf[ulOstNext - ulOstBuf] == ucValue))
+                ulOstNext += ENTROPY_BLK_SIZE;
+            if (ulOstNext > ulOstStop)
+                ulOstNext = ulOstStop;
+
+            /* The first bytes of the value complete the tokens crossing into it. */
+            if ((ulOstNext - ulOstRun) > self->ucDimension) {
+                _NGramFeedBlocks(self, buf, ulOstBuf, ulOstBgn, ulOstRun + self->ucDimension);
+                _NGramSkipRepeat(self, ucValue, ulOstNext - ulOstRun - self->ucDimension);
+                ulOstBgn = ulOstNext;
+            }
+            ulOstRun = ulOstNext;
+        }
+    }
+
+    if (ulOstBgn < ulOstEnd)
+        _NGramFeedBlocks(self, buf, ulOstBuf, ulOstBgn, ulOstEnd);
+
+    return;
+}
+
+ulong _NGramCollectRuns(PEInfo *pPEInfo, Arena *pArena, NGramRun **parrRun) {
+    int         iPass;
+    ushort      i;
+    ulong       j, k, ulNumRuns, ulOstBlk, ulOstBlkEnd, ulRawEnd;
+    bool        bOpen;
+    SectionInfo *pSection;
+    EntropyInfo *pEntropyInfo;
+    NGramRun    *arrRun, *pRun;
+
+    /* Count the runs in the first pass, and record them in the second one. */
+    *parrRun = NULL;
+    arrRun = NULL;
+    pRun = NULL;
+    ulNumRuns = 0;
+    for (iPass = 0 ; iPass < 2 ; iPass++) {
+        ulNumRuns = 0;
+        for (i = 0 ; i < pPEInfo->pPEHeader->usNumSections ; i++) {
+            pSection = pPEInfo->arrSectionInfo[i];
+            if ((pSection == NULL) || (pSection->ulRawSize == 0))
+                continue;
+            pEntropyInfo = pSection->pEntropyInfo;
+            if ((pEntropyInfo == NULL) || (pEntropyInfo->bExact == false))
+                continue;
+
+            /* The last partial block is padded with zeros, so its entropy is 0 only
+               if it holds zeros. */
+            ulRawEnd = pSection->ulRawOffset + pSection->ulRawSize;
+            bOpen = false;
+            for (j = 0 ; j < pEntropyInfo->ulNumBlks ; j++) {
+                if (pEntropyInfo->arrEntropy[j] != 0) {
+                    bOpen = false;
+                    continue;
+                }
+                ulOstBlk = pSection->ulRawOffset + j * ENTROPY_BLK_SIZE;
+                ulOstBlkEnd = ((ulRawEnd - ulOstBlk) < ENTROPY_BLK_SIZE)? ulRawEnd : (ulOstBlk + ENTROPY_BLK_SIZE);
+                if (bOpen == false) {
+                    if (arrRun != NULL) {
+                        pRun = &(arrRun[ulNumRuns]);
+                        pRun->ulOstBgn = ulOstBlk;
+                        pRun->ulOstGrid = pSection->ulRawOffset;
+                    }
+                    ulNumRuns++;
+                    bOpen = true;
+                }
+                if (arrRun != NULL)
+                    pRun->ulOstEnd = ulOstBlkEnd;
+            }
+        }
+
+        if (ulNumRuns == 0)
+            return 0;
+        if (arrRun == NULL)
+            arrRun = (NGramRun*)Amalloc(pArena, sizeof(NGramRun) * ulNumRuns);
+    }
+
+    /* The overlapped sections may report the same bytes twice. */
+    qsort(arrRun, ulNumRuns, sizeof(NGramRun), _NGramCompareRun);
+    for (j = 1, k = 0 ; j < ulNumRuns ; j++) {
+        if (arrRun[j].ulOstEnd <= arrRun[k].ulOstEnd)
+            continue;
+        if (arrRun[j].ulOstBgn < arrRun[k].ulOstEnd)
+            arrRun[j].ulOstBgn = arrRun[k].ulOstEnd;
+        arrRun[++k] = arrRun[j];
+    }
+
+    *parrRun = arrRun;
+    return k + 1;
+}
+
+int _NGramCompareRun(const void *vpSrc, const void *vpTge) {
+    const NGramRun *pSrc, *pTge;
+
+    pSrc = (const NGramRun*)vpSrc;
+    pTge = (const NGramRun*)vpTge;
+    if (pSrc->ulOstBgn != pTge->ulOstBgn)
+        return (pSrc->ulOstBgn < pTge->ulOstBgn)? -1 : 1;
+
+    return 0;
+}
+
+void _NGramSkipRepeat(NGram *self, uchar ucValue, ulong ulNumBytes) {
+    int     k;
+    ulong   ulWindow, ulMaskWide, ulMaskToken, ulTokenVal;
+
+    ulMaskWide = (1UL << ((self->ucDimension + 1) * SHIFT_RANGE_8BIT)) - 1;
+    ulMaskToken = self->ulMaxValue - 1;
+    ulWindow = (0x0101010101010101UL * ucValue) & ulMaskWide;
+
+    for (k = 0 ; k < SHIFT_RANGE_8BIT ; k++) {
+        ulTokenVal = (ulWindow >> (SHIFT_RANGE_8BIT - k)) & ulMaskToken;
+        _NGramCountToken(self, ulTokenVal, ulNumBytes);
+    }
+    StatsCount(STATS_COUNTER_SKIPPED_BYTES, ulNumBytes);
+
+    self->window.ulValue = ulWindow;
+    self->window.ulNumBytes += ulNumBytes;
+    return;
+}
+
+static inline __attribute__((always_inline))
+void _NGramCountToken(NGram *self, ulong ulTokenVal, ulong ulCount) {
+    ulong ulMaskToken;
+
+    /* The histograms of the vector kernels and the partitions drop the dummy tokens
+       when they are merged. */
+    ulMaskToken = self->ulMaxValue - 1;
+    if (self->bPartition || self->bVectorKernel)
+        self->arrHistogram[ulTokenVal] += ulCount;
+    else if ((ulTokenVal != 0) && (ulTokenVal != ulMaskToken)) {
+        if (self->arrFrequency[ulTokenVal] == 0)
+            self->ulNumTokens++;
+        self->arrFrequency[ulTokenVal] += ulCount;
+    }
+
+    return;
+}
+
+ulong _NGramHashBlock(const uchar *uszBlock) {
+    int     i;
+    ulong   ulWord, arrLane[4];
+
+    /* Four independent lanes hide the latency of the multiplications. */
+    arrLane[0] = 0x243F6A8885A308D3UL;
+    arrLane[1] = 0x13198A2E03707344UL;
+    arrLane[2] = 0xA4093822299F31D0UL;
+    arrLane[3] = 0x082EFA98EC4E6C89UL;
+    for (i = 0 ; i < NGRAM_DEDUP_BLK_SIZE / (int)sizeof(ulong) ; i++) {
+        memcpy(&ulWord, uszBlock + i * sizeof(ulong), sizeof(ulong));
+        arrLane[i & 3] = (arrLane[i & 3] ^ ulWord) * 0x9E3779B97F4A7C15UL;
+        arrLane[i & 3] ^= arrLane[i & 3] >> 29;
+    }
+
+    return (arrLane[0] ^ (arrLane[1] >> 1) ^ (arrLane[2] << 1) ^ arrLane[3]) * 0xBF58476D1CE4E5B9UL;
+}
+
+NGramBlock* _NGramLookupBlock(NGram *self, const uchar *uszBlock) {
+    ulong       ulHash, ulIdx, ulMask;
+    NGramBlock  *pBlock;
+
+    ulHash = _NGramHashBlock(uszBlock);
+    ulMask = self->ulNumBlockSlots - 1;
+    for (ulIdx = ulHash & ulMask ; ; ulIdx = (ulIdx + 1) & ulMask) {
+        pBlock = &(self->arrBlock[ulIdx]);
+        if (pBlock->uszData == NULL)
+            break;
+        if ((pBlock->ulHash == ulHash) && (memcmp(pBlock->uszData, uszBlock, NGRAM_DEDUP_BLK_SIZE) == 0))
+            return pBlock;
+    }
+
+    /* The table keeps a quarter of the slots empty, so the probing always stops. */
+    if (self->ulNumBlocks < self->ulNumBlockSlots / 4 * 3) {
+        pBlock->uszData = self->uszBlockPool + self->ulNumBlocks * NGRAM_DEDUP_BLK_SIZE;
+        memcpy(pBlock->uszData, uszBlock, NGRAM_DEDUP_BLK_SIZE);
+        pBlock->ulHash = ulHash;
+        pBlock->ulNumRepeats = 0;
+        self->ulNumBlocks++;
+    }
+
+    return NULL;
+}
+
+void _NGramFeedBlocks(NGram *self, const uchar *buf, ulong ulOstBuf, ulong ulOstBgn, ulong ulOstEnd) {
+    ulong       ulOstBlk, ulWindow, k;
+    const uchar *uszBlock;
+    NGramBlock  *pBlock;
+
+    /* The blocks are aligned to the file offsets, so the aligned copies are found
+       regardless of the chunk boundaries. */
+    if (self->bDedupBlocks) {
+        ulOstBlk = (ulOstBgn + NGRAM_DEDUP_BLK_SIZE - 1) / NGRAM_DEDUP_BLK_SIZE * NGRAM_DEDUP_BLK_SIZE;
+        for ( ; ulOstBlk + NGRAM_DEDUP_BLK_SIZE <= ulOstEnd ; ulOstBlk += NGRAM_DEDUP_BLK_SIZE) {
+            uszBlock = buf + (ulOstBlk - ulOstBuf);
+            pBlock = _NGramLookupBlock(self, uszBlock);
+            if (pBlock == NULL)
+                continue;
+
+            self->slideWindow(self, &(self->window), buf + (ulOstBgn - ulOstBuf),
+                              ulOstBlk + self->ucDimension - ulOstBgn);
+            pBlock->ulNumRepeats++;
+            StatsCount(STATS_COUNTER_DEDUP_BYTES, NGRAM_DEDUP_BLK_SIZE);
+
+            /* Leave the window as if the whole block were slid. */
+            ulWindow = 0;
+            for (k = NGRAM_DEDUP_BLK_SIZE - self->ucDimension - 1 ; k < NGRAM_DEDUP_BLK_SIZE ; k++)
+                ulWindow = (ulWindow << SHIFT_RANGE_8BIT) | uszBlock[k];
+            self->window.ulValue = ulWindow;
+            self->window.ulNumBytes += NGRAM_DEDUP_BLK_SIZE - self->ucDimension;
+            ulOstBgn = ulOstBlk + NGRAM_DEDUP_BLK_SIZE;
+        }
+    }
+
+    if (ulOstBgn < ulOstEnd)
+        self->slideWindow(self, &(self->window), buf + (ulOstBgn - ulOstBuf), ulOstEnd - ulOstBgn);
+
+    return;
+}
+
+void _NGramFlushBlocks(NGram *self) {
+    int         k;
+    ulong       i, j, ulWindow, ulMaskWide, ulMaskToken, ulTokenVal;
+    NGramBlock  *pBlock;
+
+    ulMaskWide = (1UL << ((self->ucDimension + 1) * SHIFT_RANGE_8BIT)) - 1;
+    ulMaskToken = self->ulMaxValue - 1;
+    for (i = 0 ; i < self->ulNumBlockSlots ; i++) {
+        pBlock = &(self->arrBlock[i]);
+        if ((pBlock->uszData == NULL) || (pBlock->ulNumRepeats == 0))
+            continue;
+
+        /* The tokens ending within the block, as slid from an empty window. */
+        ulWindow = 0;
+        for (j = 0 ; j < self->ucDimension ; j++)
+            ulWindow = (ulWindow << SHIFT_RANGE_8BIT) | pBlock->uszData[j];
+        for ( ; j < NGRAM_DEDUP_BLK_SIZE ; j++) {
+            ulWindow = ((ulWindow << SHIFT_RANGE_8BIT) | pBlock->uszData[j]) & ulMaskWide;
+            for (k = 0 ; k < SHIFT_RANGE_8BIT ; k++) {
+                ulTokenVal = (ulWindow >> (SHIFT_RANGE_8BIT - k)) & ulMaskToken;
+                _NGramCountToken(self, ulTokenVal, pBlock->ulNumRepeats);
+            }
+        }
+    }
+
+    return;
+}
+
+CacheKey* _NGramFindCacheKey(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector) {
+    ushort      i;
+    ulong       j, k, ulOstBgn, ulOstEnd, ulCoverBgn, ulCoverEnd;
+    bool        bFound;
+    Span        *pSpan;
+    SectionInfo *pSection;
+
+    /* Find the only part of the spans within the model range. */
+    bFound = false;
+    ulCoverBgn = ulCoverEnd = 0;
+    for (j = 0 ; j < pRegionCollector->ulNumSpans ; j++) {
+        pSpan = &(pRegionCollector->arrSpan[j]);
+        ulOstBgn = (pSpan->ulOstBgn > self->ulOstBgn)? pSpan->ulOstBgn : self->ulOstBgn;
+        ulOstEnd = (pSpan->ulOstEnd < self->ulOstEnd)? pSpan->ulOstEnd : self->ulOstEnd;
+        if (ulOstBgn >= ulOstEnd)
+            continue;
+        if (bFound)
+            return NULL;
+        for (k = 0 ; k < pSpan->ulNumBounds ; k++) {
+            if ((pSpan->arrBound[k] > ulOstBgn) && (pSpan->arrBound[k] < ulOstEnd))
+                return NULL;
+        }
+        ulCoverBgn = ulOstBgn;
+        ulCoverEnd = ulOstEnd;
+        bFound = true;
+    }
+    if (bFound == false)
+        return NULL;
+
+    for (i = 0 ; i < pPEInfo->pPEHeader->usNumSections ; i++) {
+        pSection = pPEInfo->arrSectionInfo[i];
+        if ((pSection->pCacheKey != NULL) && (pSection->ulRawOffset == ulCoverBgn) &&
+            ((pSection->ulRawOffset + pSection->ulRawSize) == ulCoverEnd))
+            return pSection->pCacheKey;
+    }
+
+    return NULL;
+}
+
+int _NGramLoadHistogram(NGram *self) {
+    ulong   i, ulNumPairs, ulTokenVal, *arrPair;
+    size_t  nSize;
+    char    szKind[BUF_SIZE_SMALL];
+
+    /* The entry holds a pair for each token except the two dummy ones at most. */
+    snprintf(szKind, BUF_SIZE_SMALL, CACHE_KIND_NGRAM, self->ucDimension);
+    arrPair = (ulong*)CacheLoad(self->cszCacheDir, self->pCacheKey, szKind, self->pArena,
+                                sizeof(ulong) * 2 * (self->ulMaxValue - 2), &nSize);
+    if ((arrPair == NULL) || ((nSize % (2 * sizeof(ulong))) != 0))
+        return -1;
+
+    /* The entry never holds the dummy tokens. */
+    ulNumPairs = nSize / (2 * sizeof(ulong));
+    for (i = 0 ; i < ulNumPairs ; i++) {
+        ulTokenVal = arrPair[2 * i];
+        if ((ulTokenVal == 0) || (ulTokenVal >= self->ulMaxValue - 1) || (arrPair[2 * i + 1] == 0))
+            return -1;
+    }
+
+    self->arrFrequency = (ulong*)Acalloc(self->pArena, self->ulMaxValue, sizeof(ulong));
+    for (i = 0 ; i < ulNumPairs ; i++)
+        self->arrFrequency[arrPair[2 * i]] = arrPair[2 * i + 1];
+    self->ulNumTokens = ulNumPairs;
+
+    return 0;
+}
+
+void _NGramStoreHistogram(NGram *self) {
+    ulong   i, j, *arrPair;
+    char    szKind[BUF_SIZE_SMALL];
+
+    arrPair = (ulong*)Amalloc(self->pArena, sizeof(ulong) * 2 * ((self->ulNumTokens == 0)? 1 : self->ulNumTokens));
+    for (i = 0, j = 0 ; (i < self->ulMaxValue) && (j < self->ulNumTokens) ; i++) {
+        if (self->arrFrequency[i] != 0) {
+            arrPair[2 * j] = i;
+            arrPair[2 * j + 1] = self->arrFrequency[i];
+            j++;
+        }
+    }
+
+    /* A failed store only costs the next run a recomputation. */
+    snprintf(szKind, BUF_SIZE_SMALL, CACHE_KIND_NGRAM, self->ucDimension);
+    CacheStore(self->cszCacheDir, self->pCacheKey, szKind, arrPair, sizeof(ulong) * 2 * j);
+    return;
+}
+
+int _NGramProfileWindows(NGram *self, PEInfo *pPEInfo, RegionCollector *pRegionCollector) {
+    int             rc, k;
+    ulong           i, j, ulNumPieces, ulOstBgn, ulOstEnd, ulLength, ulMaxLength, ulNumProfiles;
+    ulong           *arrPiece;
+    Span            *pSpan;
+    NGramRanking    rank;
+    NGramCursor     arrCursor[4];
+
+    rc = 0;
+    self->ulNumProfiles = 0;
+    self->arrProfile = NULL;
+    try {
+        if ((pRegionCollector->ulNumSpans == 0) || (self->slideKernel == NULL))
+            goto EXIT;
+
+        /* Cut the parts of the spans within the model range at the restarts. */
+        ulNumPieces = 0;
+        for (i = 0 ; i < pRegionCollector->ulNumSpans ; i++)
+            ulNumPieces += pRegionCollector->arrSpan[i].ulNumBounds + 1;
+        arrPiece = (ulong*)Amalloc(self->pArena, sizeof(ulong) * 2 * ulNumPieces);
+        ulNumPieces = 0;
+        for (i = 0 ; i < pRegionCollector->ulNumSpans ; i++) {
+            pSpan = &(pRegionCollector->arrSpan[i]);
+            ulOstBgn = (pSpan->ulOstBgn > self->ulOstBgn)? pSpan->ulOstBgn : self->ulOstBgn;
+            ulOstEnd = (pSpan->ulOstEnd < self->ulOstEnd)? pSpan->ulOstEnd : self->ulOstEnd;
+            if (ulOstBgn >= ulOstEnd)
+                continue;
+            for (j = 0 ; j < pSpan->ulNumBounds ; j++) {
+                if ((pSpan->arrBound[j] <= ulOstBgn) || (pSpan->arrBound[j] >= ulOstEnd))
+                    continue;
+                arrPiece[2 * ulNumPieces] = ulOstBgn;
+                arrPiece[2 * ulNumPieces + 1] = pSpan->arrBound[j];
+                ulOstBgn = pSpan->arrBound[j];
+                ulNumPieces++;
+            }
+            arrPiece[2 * ulNumPieces] = ulOstBgn;
+            arrPiece[2 * ulNumPieces + 1] = ulOstEnd;
+            ulNumPieces++;
+        }
+
+        /* A piece shorter than the window is summarized as a single window. */
+        ulNumProfiles = ulMaxLength = 0;
+        for (i = 0 ; i < ulNumPieces ; i++) {
+            ulLength = arrPiece[2 * i + 1] - arrPiece[2 * i];
+            if (ulLength <= self->ulProfileSize) {
+                ulNumProfiles++;
+            } else {
+                ulNumProfiles += (ulLength - self->ulProfileSize) / self->ulProfileStep + 1;
+                ulLength = self->ulProfileSize;
+            }
+            if (ulMaxLength < ulLength)
+                ulMaxLength = ulLength;
+        }
+        if (ulNumProfiles == 0)
+            goto EXIT;
+        self->arrProfile = (NGramProfile*)Amalloc(self->pArena, sizeof(NGramProfile) * ulNumProfiles);
+
+        /* A window holds at most 8 tokens per byte, which bounds both the live tokens
+           and the count of a single token. */
+        rank.arrRank = (NGramRank*)Acalloc(self->pArena, self->ulMaxValue, sizeof(NGramRank));
+        ulLength = ulMaxLength * SHIFT_RANGE_8BIT;
+        rank.arrLive = (uint*)Amalloc(self->pArena, sizeof(uint) * ((ulLength < self->ulMaxValue)? ulLength : self->ulMaxValue));
+        rank.arrFirst = (uint*)Acalloc(self->pArena, ulLength + 2, sizeof(uint));
+        rank.ulNumLive = rank.ulNumTokens = 0;
+        for (k = 0 ; k < 4 ; k++)
+            arrCursor[k].uszBuf = (uchar*)Amalloc(self->pArena, READER_CHUNK_SIZE);
+
+        for (i = 0 ; i < ulNumPieces ; i++) {
+            rc = _NGramProfilePiece(self, pPEInfo->pReader, &rank, arrCursor, arrPiece[2 * i], arrPiece[2 * i + 1]);
+            if (rc != 0) {
+                Log0("Invalid PE file (The selected range can not be reached).\n");
+                goto EXIT;
+            }
+        }
+    } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
     } end_try;
 
 EXIT:
     return rc;
 }
+
+int _NGramProfilePiece(NGram *self, Reader *pReader, NGramRanking *pRank, NGramCursor *arrCursor,
+                       ulong ulOstBgn, ulong ulOstEnd) {
+    int     k;
+    ulong   ulOstWin, ulOstStop, ulOstAlignLow, ulOstAlignHigh, ulOstShiftLow, ulOstShiftHigh, ulDimension;
+    NGramProfile *pProfile;
+
+    for (k = 0 ; k < 4 ; k++) {
+        arrCursor[k].ulOstBuf = ulOstBgn;
+        arrCursor[k].ulOstEnd = ulOstEnd;
+        arrCursor[k].nLength = 0;
+    }
+    ulDimension = self->ucDimension;
+    ulOstAlignLow = ulOstAlignHigh = ulOstShiftLow = ulOstShiftHigh = ulOstBgn;
+
+    /* The window [w, e) holds the byte-aligned tokens starting in [w, e - d] and the
+       shifted ones starting in [w, e - d - 1], like a model of the window alone. */
+    for (ulOstWin = ulOstBgn ; ; ulOstWin += self->ulProfileStep) {
+        ulOstStop = ((ulOstEnd - ulOstWin) > self->ulProfileSize)? (ulOstWin + self->ulProfileSize) : ulOstEnd;
+        if (_NGramMoveProfile(self, pReader, pRank, &(arrCursor[0]), &(arrCursor[1]), &ulOstAlignLow, &ulOstAlignHigh,
+                              ulOstWin, (ulOstStop >= ulOstWin + ulDimension)? (ulOstStop - ulDimension + 1) : ulOstWin,
+                              false) != 0)
+            return -1;
+        if (_NGramMoveProfile(self, pReader, pRank, &(arrCursor[2]), &(arrCursor[3]), &ulOstShiftLow, &ulOstShiftHigh,
+                              ulOstWin, (ulOstStop > ulOstWin + ulDimension)? (ulOstStop - ulDimension) : ulOstWin,
+                              true) != 0)
+            return -1;
+
+        pProfile = &(self->arrProfile[self->ulNumProfiles++]);
+        pProfile->ulOstBgn = ulOstWin;
+        pProfile->ulOstEnd = ulOstStop;
+        _NGramSummarizeProfile(pRank, pProfile);
+
+        if ((ulOstEnd - ulOstWin) < self->ulProfileStep + self->ulProfileSize)
+            break;
+    }
+
+    /* Leave the ranking empty for the next piece. */
+    if ((_NGramMoveProfile(self, pReader, pRank, &(arrCursor[0]), &(arrCursor[1]), &ulOstAlignLow, &ulOstAlignHigh,
+                           ulOstEnd, ulOstEnd, false) != 0) ||
+        (_NGramMoveProfile(self, pReader, pRank, &(arrCursor[2]), &(arrCursor[3]), &ulOstShiftLow, &ulOstShiftHigh,
+                           ulOstEnd, ulOstEnd, true) != 0))
+        return -1;
+
+    return 0;
+}
+
+int _NGramMoveProfile(NGram *self, Reader *pReader, NGramRanking *pRank, NGramCursor *pHead, NGramCursor *pTail,
+                      ulong *pulOstLow, ulong *pulOstHigh, ulong ulOstBgn, ulong ulOstEnd, bool bShifted) {
+    size_t      nNeed;
+    const uchar *uszData;
+
+    /* Subtract the leaving positions before adding the entering ones. */
+    nNeed = self->ucDimension + ((bShifted)? 1 : 0);
+    for ( ; (*pulOstLow < ulOstBgn) && (*pulOstLow < *pulOstHigh) ; (*pulOstLow)++) {
+        uszData = _NGramFetchCursor(pTail, pReader, *pulOstLow, nNeed);
+        if (uszData == NULL)
+            return -1;
+        _NGramRankPosition(self, pRank, uszData, bShifted, false);
+    }
+
+    if (*pulOstLow < ulOstBgn)
+        *pulOstLow = ulOstBgn;
+    if (*pulOstHigh < *pulOstLow)
+        *pulOstHigh = *pulOstLow;
+    for ( ; *pulOstHigh < ulOstEnd ; (*pulOstHigh)++) {
+        uszData = _NGramFetchCursor(pHead, pReader, *pulOstHigh, nNeed);
+        if (uszData == NULL)
+            return -1;
+        _NGramRankPosition(self, pRank, uszData, bShifted, true);
+    }
+
+    return 0;
+}
+
+const uchar* _NGramFetchCursor(NGramCursor *pCursor, Reader *pReader, ulong ulOst, size_t nNeed) {
+    size_t  nExptRead;
+    uchar   *uszData;
+
+    if (ulOst + nNeed > pCursor->ulOstBuf + pCursor->nLength) {
+        nExptRead = pCursor->ulOstEnd - ulOst;
+        if (nExptRead > READER_CHUNK_SIZE)
+            nExptRead = READER_CHUNK_SIZE;
+        if (ReaderReadAt(pReader, ulOst, nExptRead, pCursor->uszBuf, &uszData) != (ssize_t)nExptRead)
+            return NULL;
+        pCursor->ulOstBuf = ulOst;
+        pCursor->nLength = nExptRead;
+        pCursor->uszData = uszData;
+    }
+
+    return pCursor->uszData + (ulOst - pCursor->ulOstBuf);
+}
+
+static inline __attribute__((always_inline))
+void _NGramRankPosition(NGram *self, NGramRanking *pRank, const uchar *uszData, bool bShifted, bool bEnter) {
+    int     k;
+    ulong   ulWindow, ulMaskToken;
+    uchar   i;
+
+    ulWindow = 0;
+    for (i = 0 ; i < self->ucDimension ; i++)
+        ulWindow = (ulWindow << SHIFT_RANGE_8BIT) | uszData[i];
+    if (bShifted == false) {
+        _NGramRankToken(self, pRank, ulWindow, bEnter);
+        return;
+    }
+
+    ulMaskToken = self->ulMaxValue - 1;
+    ulWindow = (ulWindow << SHIFT_RANGE_8BIT) | uszData[i];
+    for (k = 1 ; k < SHIFT_RANGE_8BIT ; k++)
+        _NGramRankToken(self, pRank, (ulWindow >> (SHIFT_RANGE_8BIT - k)) & ulMaskToken, bEnter);
+
+    return;
+}
+
+static inline __attribute__((always_inline))
+void _NGramRankToken(NGram *self, NGramRanking *pRank, ulong ulTokenVal, bool bEnter) {
+    uint    uiCount, uiEdge, uiPos, uiOther;
+
+    if ((ulTokenVal == 0) || (ulTokenVal == self->ulMaxValue - 1))
+        return;
+
+    /* Swap the token with the one at the edge of its block, and move the edge over it. */
+    uiCount = pRank->arrRank[ulTokenVal].uiCount;
+    if (bEnter) {
+        if (uiCount == 0) {
+            uiEdge = pRank->ulNumLive++;
+            pRank->arrLive[uiEdge] = ulTokenVal;
+            pRank->arrRank[ulTokenVal].uiPos = uiEdge;
+        } else {
+            uiEdge = pRank->arrFirst[uiCount]++;
+        }
+        pRank->arrRank[ulTokenVal].uiCount = uiCount + 1;
+        pRank->ulNumTokens++;
+    } else {
+        if (uiCount == 1)
+            uiEdge = --(pRank->ulNumLive);
+        else
+            uiEdge = --(pRank->arrFirst[uiCount - 1]);
+        pRank->arrRank[ulTokenVal].uiCount = uiCount - 1;
+        pRank->ulNumTokens--;
+    }
+
+    uiPos = pRank->arrRank[ulTokenVal].uiPos;
+    uiOther = pRank->arrLive[uiEdge];
+    pRank->arrLive[uiPos] = uiOther;
+    pRank->arrRank[uiOther].uiPos = uiPos;
+    pRank->arrLive[uiEdge] = ulTokenVal;
+    pRank->arrRank[ulTokenVal].uiPos = uiEdge;
+
+    return;
+}
+
+void _NGramSummarizeProfile(NGramRanking *pRank, NGramProfile *pProfile) {
+    ulong   i, j;
+    Token   token;
+
+    pProfile->ulNumTokens = pRank->ulNumTokens;
+    pProfile->ulNumDistinct = pRank->ulNumLive;
+    pProfile->ulNumTop = (pRank->ulNumLive < NGRAM_PROFILE_TOP)? pRank->ulNumLive : NGRAM_PROFILE_TOP;
+    for (i = 0 ; i < pProfile->ulNumTop ; i++) {
+        token.ulValue = pRank->arrLive[i];
+        token.ulFrequency = pRank->arrRank[token.ulValue].uiCount;
+        for (j = i ; (j > 0) && ((pProfile->arrTop[j - 1].ulFrequency < token.ulFrequency) ||
+                                 ((pProfile->arrTop[j - 1].ulFrequency == token.ulFrequency) &&
+                                  (pProfile->arrTop[j - 1].ulValue > token.ulValue))) ; j--)
+            pProfile->arrTop[j] = pProfile->arrTop[j - 1];
+        pProfile->arrTop[j] = token;
+    }
+
+    return;
+}
+
+void _NGramFlushWindow(NGram *self, NGramWindow *pWindow) {
+    ulong ulTokenVal, ulMaskToken;
+
+    /* The token aligned to the last byte is not followed by any byte. */
+    if (pWindow->ulNumBytes >= self->ucDimension) {
+        ulMaskToken = self->ulMaxValue - 1;
+        ulTokenVal = pWindow->ulValue & ulMaskToken;
+        if (self->bPartition)
+            _NGramPushPartition(self, ulTokenVal);
+        else if (self->bVectorKernel)
+            self->arrHistogram[ulTokenVal]++;
+        else if ((ulTokenVal != 0) && (ulTokenVal != ulMaskToken)) {
+            if (self->arrFrequency[ulTokenVal] == 0)
+                self->ulNumTokens++;
+            self->arrFrequency[ulTokenVal]++;
+        }
+        StatsCount(STATS_COUNTER_TOKENS, (pWindow->ulNumBytes - self->ucDimension) * SHIFT_RANGE_8BIT + 1);
+    }
+
+    pWindow->ulValue = 0;
+    pWindow->ulNumBytes = 0;
+    return;
+}
@@ -1,81 +1,285 @@
 #include "pe_info.h"
 
 
+/*===========================================================================*
+ *                  Simulation for private variables                         *
+ *===========================================================================*/
+/* The block size of each level of the entropy pyramid. */
+static const ulong _arrLevelBlkSize[ENTROPY_NUM_LEVELS] = ENTROPY_PYRAMID_BLK_SIZES;
+
+/* Structure to carry the window of the sliding entropy profile across the chunks.
+   The entropy is log(W) - S / W, where S sums c * log(c) over the window histogram,
+   so a byte entering or leaving the window changes S by the difference of two terms. */
+typedef struct _EntropySlide {
+    ulong   ulNumBytes;
+    double  dLogWindow;
+    uint    arrFreq[ENTROPY_BLK_SIZE];
+    uchar   arrRing[ENTROPY_BLK_SIZE];
+    double  arrCLogC[ENTROPY_BLK_SIZE + 1];
+} EntropySlide;
+
+
+/* Structure to describe a span of a section processed by one entropy task. The span
+   starts at a multiple of ENTROPY_TASK_SIZE within the section raw data. */
+typedef struct _EntropyTask {
+    SectionInfo *pSection;
+    ulong       ulOstBgn, ulOstEnd;
+    uint        arrFreq[ENTROPY_BLK_SIZE];
+    int         iErrno;
+    bool        bShort;
+} EntropyTask;
+
+
+/* Structure to share the task list among the entropy threads. */
+typedef struct _EntropyJob {
+    Reader      *pReader;
+    EntropyTask *arrTask;
+    ulong       ulNumTasks, ulIdxNext;
+    double      dLogBase;
+} EntropyJob;
+
+
+/* Structure to store the private state of an entropy thread. */
+typedef struct _EntropyWorker {
+    EntropyJob      *pJob;
+    uchar           *uszBuf;
+    bool            bThread;
+    pthread_t       thread;
+    EntropySlide    slide;
+} EntropyWorker;
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function extracts the sample name, the file name without its extension,
+ * from the sample path.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   cszSamplePath   The path of the sample.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the name cannot be allocated.
+ */
+void _PEInfoExtractName(PEInfo *self, const char *cszSamplePath);
+
+
+/**
+ * This function reads a little-endian integer from the header buffer.
+ *
+ * @param   uszData         The pointer to the first byte.
+ * @param   iSize           The size of the integer in bytes.
+ *
+ * @return                  The integer value.
+ */
+ulong _PEInfoReadInt(const uchar *uszData, int iSize);
+
+
+/**
+ * This function resolves the entry point, the image base, the image size and the
+ * data directories from the optional header. The fields are kept zero if the magic
+ * is unknown, and only the fields within the header are resolved.
+ *
+ * @param   pPEHeader       The pointer to the PEHeader structure.
+ * @param   uszOptHeader    The buffer of the optional header.
+ * @param   nSize           The number of bytes of the optional header in the buffer.
+ */
+void _PEInfoParseOptHeader(PEHeader *pPEHeader, const uchar *uszOptHeader, size_t nSize);
+
+
+/**
+ * This function calculates the entropy of a byte histogram.
+ *
+ * @param   arrFreq         The appearance times of each byte value.
+ * @param   ulNumBytes      The total number of bytes.
+ * @param   dLogBase        The natural logarithm of the entropy base.
+ *
+ * @return                  The entropy.
+ */
+double _PEInfoCalculateEntropy(const uint *arrFreq, ulong ulNumBytes, double dLogBase);
+
+
+/**
+ * This function slides the entropy window over a chunk of the section byte by byte,
+ * and records the entropy of each full window into the profile.
+ *
+ * @param   pEntropyInfo    The pointer to the EntropyInfo structure of the section.
+ * @param   pSlide          The pointer to the window state.
+ * @param   uszChunk        The chunk of binary.
+ * @param   nSize           The chunk size.
+ */
+void _PEInfoSlideEntropy(EntropyInfo *pEntropyInfo, EntropySlide *pSlide, const uchar *uszChunk, size_t nSize);
+
+
+/**
+ * This function measures the exact entropy data of the specified sections. The
+ * empty sections and the measured ones are skipped.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   usIdxBgn        The index of the first section.
+ * @param   usIdxEnd        The index after the last section.
+ *
+ * @return                  0: The entropy data is collected successfully.
+ *                        < 0: Exception occurs while file accessing or memory allocation.
+ */
+int _PEInfoMeasureSections(PEInfo *self, ushort usIdxBgn, ushort usIdxEnd);
+
+
+/**
+ * This function estimates the entropy of a section from ENTROPY_NUM_SAMPLES blocks
+ * spread evenly over it. The entropy arrays are not created.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   pSection        The pointer to the SectionInfo structure.
+ * @param   dLogBase        The natural logarithm of the entropy base.
+ *
+ * @return                  0: The entropy is estimated successfully.
+ *                        < 0: The section cannot be read.
+ *                          EXCEPT_MEM_ALLOC is thrown if the EntropyInfo structure
+ *                          cannot be allocated.
+ */
+int _PEInfoEstimateSection(PEInfo *self, SectionInfo *pSection, double dLogBase);
+
+
+/**
+ * This function hashes the raw data of each non-empty section into its cache key.
+ * A section which cannot be fully read is left without the key.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the keys cannot be allocated.
+ */
+void _PEInfoHashSections(PEInfo *self);
+
+
+/**
+ * This function loads the entropy pyramid of a section from the result cache. The
+ * arrays point into the loaded entry.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   pSection        The pointer to the SectionInfo structure with the cache key.
+ *
+ * @return                  0: The entropy data is loaded, and the section is exact.
+ *                        < 0: The entry does not exist or does not fit the section.
+ *                          EXCEPT_MEM_ALLOC is thrown if the entry cannot be allocated.
+ */
+int _PEInfoLoadEntropy(PEInfo *self, SectionInfo *pSection);
+
+
+/**
+ * This function stores the entropy pyramid of a measured section into the result cache.
+ * The sliding entropy profile is not stored.
+ *
+ * @param   self            The pointer to the PEInfo structure.
+ * @param   pSection        The pointer to the SectionInfo structure with the cache key.
+ *
+ * @return                  EXCEPT_MEM_ALLOC is thrown if the entry cannot be allocated.
+ */
+void _PEInfoStoreEntropy(PEInfo *self, SectionInfo *pSection);
+
+
+/**
+ * This function calculates the entropy data of a span. The blocks of the pyramid
+ * levels are written into the entropy arrays of the section, and the byte histogram
+ * of the whole span is kept in the task for the whole section level. It never throws,
+ * and the read failure is recorded in the task.
+ *
+ * @param   pWorker         The pointer to the EntropyWorker structure.
+ * @param   pTask           The pointer to the EntropyTask structure.
+ */
+void _PEInfoEntropyTask(EntropyWorker *pWorker, EntropyTask *pTask);
+
+
+/**
+ * This function is the body of an entropy thread. It takes the tasks from the shared
+ * list until the list is exhausted.
+ *
+ * @param   vpWorker        The pointer to the EntropyWorker structure.
+ *
+ * @return                  Always NULL.
+ */
+void* _PEInfoEntropyWorker(void *vpWorker);
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+
 void PEInfoInit(PEInfo *self) {
+    self->pArena = NULL;
+    self->bPrefetch = false;
+    self->bSlideEntropy = false;
+    self->bLazyEntropy = false;
+    self->cszCacheDir = NULL;
     self->szSampleName = NULL;
     self->fpSample = NULL;
+    self->pReader = NULL;
     self->pPEHeader = NULL;
     self->arrSectionInfo = NULL;
 
     /* Let the function pointers point to the corresponding functions. */
     self->openSample = PEInfoOpenSample;
+    self->openBuffer = PEInfoOpenBuffer;
     self->parseHeaders = PEInfoParseHeaders;
     self->calculateSectionEntropy = PEInfoCalculateSectionEntropy;
+    self->measureSection = PEInfoMeasureSection;
     self->dump = PEInfoDump;
 
     return;
 }
 
 void PEInfoDeinit(PEInfo *self) {
-    int  i;
-    EntropyInfo *pEntropyInfo;
-
-    if (self->szSampleName != NULL)
-        Free(self->szSampleName);
 
+    if (self->pReader != NULL)
+        ReaderDeinit(self->pReader);
     if (self->fpSample != NULL)
         Fclose(self->fpSample);
 
-    /* Free all the SectionInfo structures. */
-    if (self->arrSectionInfo != NULL) {
-        for (i = 0 ; i < self->pPEHeader->usNumSections ; i++) {
-            if (self->arrSectionInfo[i] != NULL) {
-
-                /* Free the EntropyInfo structure. */
-                pEntropyInfo = self->arrSectionInfo[i]->pEntropyInfo;
-                if (pEntropyInfo != NULL) {
-                    if (pEntropyInfo->arrEntropy != NULL)
-                        Free(pEntropyInfo->arrEntropy);
-                    Free(pEntropyInfo);
-                }
-
-                Free(self->arrSectionInfo[i]);
-            }
-        }
-        Free(self->arrSectionInfo);
-    }
-
-    /* Free the PEHeader structure. */
-    if (self->pPEHeader != NULL)
-        Free(self->pPEHeader);
+    /* The header, section and reader structures are released with the arena. */
+    self->fpSample = NULL;
+    self->pReader = NULL;
+    self->szSampleName = NULL;
+    self->pPEHeader = NULL;
+    self->arrSectionInfo = NULL;
 
     return;
 }
 
 int PEInfoOpenSample(PEInfo *self, const char *cszSamplePath) {
-    int rc, idxFront, idxTail;
+    int rc;
 
     rc = 0;
     try {
         /* Create the file pointer for the input sample. */
         self->fpSample = Fopen(cszSamplePath, "rb");
 
-        /* Extract the name of the input sample. */
-        idxTail = strlen(cszSamplePath);
-        idxFront = idxTail;
-        while ((idxTail > 0) && (cszSamplePath[idxTail - 1] != '.'))
-            idxTail--;
-        if (idxTail == 0)
-            idxTail = idxFront;
+        /* Create the reader to stream the section data. */
+        self->pReader = (Reader*)Amalloc(self->pArena, sizeof(Reader));
+        ReaderInit(self->pReader, self->pArena, self->fpSample, self->bPrefetch);
 
-        idxFront = idxTail;
-        idxTail--;
-        while ((idxFront > 0) && (cszSamplePath[idxFront - 1] != OS_PATH_SEPARATOR))
-            idxFront--;
+        _PEInfoExtractName(self, cszSamplePath);
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } catch(EXCEPT_IO_FILE_OPEN) {
+        rc = -1;
+    } end_try;
 
-        self->szSampleName = (char*)Calloc((idxTail - idxFront + 1), sizeof(char));
-        memset(self->szSampleName, 0, sizeof(char) * (idxTail - idxFront + 1));
-        strncpy(self->szSampleName, cszSamplePath + idxFront, idxTail - idxFront);
+    return rc;
+}
+
+int PEInfoOpenBuffer(PEInfo *self, const char *cszSamplePath, uchar *uszData, size_t nSize) {
+    int rc;
+
+    rc = 0;
+    try {
+        /* The headers are parsed through a memory stream over the loaded sample. */
+        self->fpSample = Fmemopen(uszData, nSize, "rb");
+
+        /* Let the reader hand out the section data without copying. */
+        self->pReader = (Reader*)Amalloc(self->pArena, sizeof(Reader));
+        ReaderInitBuffer(self->pReader, uszData, nSize);
+
+        _PEInfoExtractName(self, cszSamplePath);
     } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
     } catch(EXCEPT_IO_FILE_OPEN) {
@@ -92,12 +296,14 @@ int PEInfoParseHeaders(PEInfo *self) {
     size_t  nExptRead, nRealRead;
     uchar   *uszOriginalName;
     uchar   buf[BUF_SIZE_SMALL];
+    uchar   bufOpt[OPT_HEADER_MAX_SIZE];
 
     rc = 0;
     try {
         /* Create the PEHeader structure. */
         self->pPEHeader = NULL;
-        self->pPEHeader = (PEHeader*)Malloc(sizeof(PEHeader));
+        self->pPEHeader = (PEHeader*)Amalloc(self->pArena, sizeof(PEHeader));
+        memset(self->pPEHeader, 0, sizeof(PEHeader));
 
         /*------------------------------------------------*
          *  Examine DOS(MZ) header.                       *
@@ -150,6 +356,14 @@ int PEInfoParseHeaders(PEInfo *self) {
             ulWord += buf[PE_HEADER_OFF_SIZE_OF_OPT_HEADER + DATATYPE_SIZE_WORD - i] & 0xff;
         }
 
+        /*------------------------------------------------*
+         *  Examine PE optional header.                   *
+         *------------------------------------------------*/
+        /* The optional header follows the PE header. A truncated one is resolved as far as it goes. */
+        nExptRead = (ulWord < OPT_HEADER_MAX_SIZE)? ulWord : OPT_HEADER_MAX_SIZE;
+        nRealRead = (nExptRead > 0)? Fread(bufOpt, sizeof(uchar), nExptRead, self->fpSample) : 0;
+        _PEInfoParseOptHeader(self->pPEHeader, bufOpt, nRealRead);
+
         /* Move to the starting offset of section headers. */
         ulOffset = self->pPEHeader->ulHeaderOffset + PE_HEADER_SIZE + ulWord;
         Fseek(self->fpSample, ulOffset, SEEK_SET);
@@ -159,7 +373,7 @@ int PEInfoParseHeaders(PEInfo *self) {
          *------------------------------------------------*/
         /* Create the array to store the SectionInfo structure for each section. */
         ulWord = self->pPEHeader->usNumSections;
-        self->arrSectionInfo = (SectionInfo**)Calloc(ulWord, sizeof(SectionInfo*));
+        self->arrSectionInfo = (SectionInfo**)Acalloc(self->pArena, ulWord, sizeof(SectionInfo*));
         for (i = 0 ; i < ulWord ; i++) {
             (self->arrSectionInfo)[i] = NULL;
         }
@@ -176,8 +390,9 @@ int PEInfoParseHeaders(PEInfo *self) {
 
             /* Create the SectionInfo structure. */
             self->arrSectionInfo[i] = NULL;
-            self->arrSectionInfo[i] = (SectionInfo*)Malloc(sizeof(SectionInfo));
+            self->arrSectionInfo[i] = (SectionInfo*)Amalloc(self->pArena, sizeof(SectionInfo));
             self->arrSectionInfo[i]->pEntropyInfo = NULL;
+            self->arrSectionInfo[i]->pCacheKey = NULL;
 
             /* Record the section name. */
             memset(self->arrSectionInfo[i]->uszOriginalName, 0, SECTION_HEADER_SECTION_NAME_SIZE + 1);
@@ -215,6 +430,12 @@ int PEInfoParseHeaders(PEInfo *self) {
                 ulDword += buf[SECTION_HEADER_OFF_CHARS + DATATYPE_SIZE_DWORD - j] & 0xff;
             }
             self->arrSectionInfo[i]->ulCharacteristics = ulDword;
+
+            /* Record the mapped section range, which locates the entry point and the directories. */
+            self->arrSectionInfo[i]->ulVirtualSize = _PEInfoReadInt(buf + SECTION_HEADER_OFF_VIRTUAL_SIZE,
+                                                                    DATATYPE_SIZE_DWORD);
+            self->arrSectionInfo[i]->ulVirtualAddress = _PEInfoReadInt(buf + SECTION_HEADER_OFF_VIRTUAL_ADDRESS,
+                                                                       DATATYPE_SIZE_DWORD);
         }
     } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
@@ -230,92 +451,38 @@ EXIT:
 }
 
 int PEInfoCalculateSectionEntropy(PEInfo *self) {
-    int         rc, i, j, idxBlk;
-    ulong       ulRawSize, ulRawOffset, ulCurrRead;
-    size_t      nRealRead, nExptRead;
-    double      dEntropy, dMax, dAvg, dMin, dProb, dLogProb, dLogBase;
+    int         rc, i;
+    double      dLogBase;
     SectionInfo *pSection;
-    uchar       buf[ENTROPY_BLK_SIZE], refFreq[ENTROPY_BLK_SIZE];
 
+    /* The cache keys are shared by the entropy data and the n-gram models. */
+    if (self->cszCacheDir != NULL) {
+        rc = 0;
+        try {
+            _PEInfoHashSections(self);
+        } catch(EXCEPT_MEM_ALLOC) {
+            rc = -1;
+        } end_try;
+        if (rc != 0)
+            return rc;
+    }
+
+    if (self->bLazyEntropy == false)
+        return _PEInfoMeasureSections(self, 0, self->pPEHeader->usNumSections);
+
+    /* Only estimate each section with the sampled blocks. */
     rc = 0;
+    dLogBase = log(ENTROPY_LOG_BASE);
     try {
         for (i = 0 ; i < self->pPEHeader->usNumSections ; i++) {
             pSection = self->arrSectionInfo[i];
-
-            ulRawSize = pSection->ulRawSize;
-            ulRawOffset = pSection->ulRawOffset;
-
-            /* Skip the empty section. */
-            if (ulRawSize == 0)
+            if (pSection->ulRawSize == 0)
                 continue;
-
-            /* Move to the starting offset of the current section. */
-            Fseek(self->fpSample, ulRawOffset, SEEK_SET);
-
-            /* Create the EntropyInfo structure. */
-            pSection->pEntropyInfo = (EntropyInfo*)Malloc(sizeof(EntropyInfo));
-            pSection->pEntropyInfo->arrEntropy = NULL;
-
-            if ((ulRawSize % ENTROPY_BLK_SIZE) == 0)
-                pSection->pEntropyInfo->ulNumBlks = ulRawSize / ENTROPY_BLK_SIZE;
-            else
-                pSection->pEntropyInfo->ulNumBlks = ulRawSize / ENTROPY_BLK_SIZE + 1;
-
-            pSection->pEntropyInfo->arrEntropy = (double*)Calloc(pSection->pEntropyInfo->ulNumBlks, sizeof(double));
-
-            /*------------------------------------------------*
-             *  Main part of the entropy calculation.         *
-             *------------------------------------------------*/
-            ulCurrRead = 0;
-            idxBlk = 0;
-            dMax = -1;
-            dMin = 10;
-            dAvg = 0;
-
-            while (ulCurrRead < ulRawSize) {
-                /* Read a block of binary. */
-                nExptRead = ((ulRawSize - ulCurrRead) < ENTROPY_BLK_SIZE)? (ulRawSize - ulCurrRead) : ENTROPY_BLK_SIZE;
-                memset(buf, 0, sizeof(uchar) * ENTROPY_BLK_SIZE);
-                nRealRead = Fread(buf, sizeof(uchar), nExptRead, self->fpSample);
-                if (nExptRead != nRealRead) {
-                    Log1("Invalid PE file (Invalid section \"%s\").\n", pSection->uszNormalizedName);
-                    rc = -1;
-                    goto EXIT;
-                }
-
-                /* Record the number of appearence times of each unique byte. */
-                memset(refFreq, 0, sizeof(uchar) * ENTROPY_BLK_SIZE);
-                for (j = 0 ; j < ENTROPY_BLK_SIZE ; j++)
-                    refFreq[buf[j]]++;
-
-                /* Calculate the entropy for this block. */
-                dEntropy = 0;
-                dLogBase = log(ENTROPY_LOG_BASE);
-                for (j = 0 ; j < ENTROPY_BLK_SIZE ; j++) {
-                    dProb = (double)refFreq[j] / (double)ENTROPY_BLK_SIZE;
-                    dLogProb = (dProb > 0)? (log(dProb) / dLogBase) : 0;
-                    dEntropy += dProb * dLogProb;
-                }
-                dEntropy = -dEntropy;
-                dAvg += dEntropy;
-
-                if (dEntropy > dMax)
-                    dMax = dEntropy;
-                if (dEntropy < dMin)
-                    dMin = dEntropy;
-
-                pSection->pEntropyInfo->arrEntropy[idxBlk++] = dEntropy;
-                ulCurrRead += nRealRead;
-            }
-
-            pSection->pEntropyInfo->dMaxEntropy = dMax;
-            pSection->pEntropyInfo->dMinEntropy = dMin;
-            pSection->pEntropyInfo->dAvgEntropy = dAvg / idxBlk;
+            rc = _PEInfoEstimateSection(self, pSection, dLogBase);
+            if (rc != 0)
+                goto EXIT;
         }
-    } catch(EXCEPT_IO_FILE_READ) {
-        rc = -1;
-    } catch(EXCEPT_IO_FILE_SEEK) {
-        Log0("Invalid PE file (The target section can not be reached).\n");
+    } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
     } end_try;
 
@@ -323,13 +490,25 @@ EXIT:
     return rc;
 }
 
+int PEInfoMeasureSection(PEInfo *self, ushort usIdxSection) {
+
+    return _PEInfoMeasureSections(self, usIdxSection, usIdxSection + 1);
+}
+
 void PEInfoDump(PEInfo *self) {
-    int         i, j;
+    int         i, j, l;
     ushort      usNumSections;
     SectionInfo *pSection;
     EntropyInfo *pEntropyInfo;
 
     printf("Sample Name: %s\n", self->szSampleName);
+    printf("Optional Magic: 0x%03x\n", self->pPEHeader->usOptMagic);
+    printf("Entry    Point: 0x%08lx\n", self->pPEHeader->ulEntryPoint);
+    printf("Image     Base: 0x%016lx\n", self->pPEHeader->ulImageBase);
+    printf("Image     Size: 0x%08lx\n", self->pPEHeader->ulImageSize);
+    for (i = 0 ; i < self->pPEHeader->ulNumDataDirs ; i++)
+        printf("Directory   #%d: 0x%08lx 0x%08lx\n", i, self->pPEHeader->arrDataDir[i].ulRva,
+               self->pPEHeader->arrDataDir[i].ulSize);
     usNumSections = self->pPEHeader->usNumSections;
     printf("Total: %d sections\n\n", usNumSections);
 
@@ -341,13 +520,28 @@ void PEInfoDump(PEInfo *self) {
             printf("Characteristics: 0x%08lx\n", pSection->ulCharacteristics);
             printf("Raw      Offset: 0x%08lx\n", pSection->ulRawOffset);
             printf("Raw        Size: 0x%08lx\n", pSection->ulRawSize);
+            printf("Virtual Address: 0x%08lx\n", pSection->ulVirtualAddress);
+            printf("Virtual    Size: 0x%08lx\n", pSection->ulVirtualSize);
 
+            /* The empty section has no entropy data, and the estimated one has no arrays. */
             pEntropyInfo = pSection->pEntropyInfo;
-            printf("Max Entropy: %.3lf\n", pEntropyInfo->dMaxEntropy);
-            printf("Avg Entropy: %.3lf\n", pEntropyInfo->dAvgEntropy);
-            printf("Min Entropy: %.3lf\n", pEntropyInfo->dMinEntropy);
-            for (j = 0 ; j < pEntropyInfo->ulNumBlks ; j++)
-                printf("\t%d\t%.3lf\n", j, pEntropyInfo->arrEntropy[j]);
+            if ((pEntropyInfo != NULL) && (pEntropyInfo->bExact == false)) {
+                printf("Max Entropy: %.3lf (estimated)\n", pEntropyInfo->dMaxEntropy);
+                printf("Avg Entropy: %.3lf (estimated)\n", pEntropyInfo->dAvgEntropy);
+                printf("Min Entropy: %.3lf (estimated)\n", pEntropyInfo->dMinEntropy);
+            } else if (pEntropyInfo != NULL) {
+                printf("Max Entropy: %.3lf\n", pEntropyInfo->dMaxEntropy);
+                printf("Avg Entropy: %.3lf\n", pEntropyInfo->dAvgEntropy);
+                printf("Min Entropy: %.3lf\n", pEntropyInfo->dMinEntropy);
+                for (j = 0 ; j < pEntropyInfo->ulNumBlks ; j++)
+                    printf("\t%d\t%.3lf\n", j, pEntropyInfo->arrEntropy[j]);
+                for (l = 1 ; l < ENTROPY_NUM_LEVELS ; l++) {
+                    printf("Level #%d (%lu bytes):", l, pEntropyInfo->arrLevelBlkSize[l]);
+                    for (j = 0 ; j < pEntropyInfo->arrNumLevelBlks[l] ; j++)
+                        printf(" %.3lf", pEntropyInfo->arrLevelEntropy[l][j]);
+                    printf("\n");
+                }
+            }
 
             printf("\n");
         }
@@ -356,3 +550,607 @@ void PEInfoDump(PEInfo *self) {
     return;
 }
 
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+void _PEInfoExtractName(PEInfo *self, const char *cszSamplePath) {
+    int idxFront, idxTail;
+
+    idxTail = strlen(cszSamplePath);
+    idxFront = idxTail;
+    while ((idxTail > 0) && (cszSamplePath[idxTail - 1] != '.'))
+        idxTail--;
+    if (idxTail == 0)
+        idxTail = idxFront;
+
+    idxFront = idxTail;
+    idxTail--;
+    while ((idxFront > 0) && (cszSamplePath[idxFront - 1] != OS_PATH_SEPARATOR))
+        idxFront--;
+
+    self->szSampleName = (char*)Acalloc(self->pArena, (idxTail - idxFront + 1), sizeof(char));
+    memset(self->szSampleName, 0, sizeof(char) * (idxTail - idxFront + 1));
+    strncpy(self->szSampleName, cszSamplePath + idxFront, idxTail - idxFront);
+
+    return;
+}
+
+ulong _PEInfoReadInt(const uchar *uszData, int iSize) {
+    int     i;
+    ulong   ulValue;
+
+    ulValue = 0;
+    for (i = 1 ; i <= iSize ; i++) {
+        ulValue <<= SHIFT_RANGE_8BIT;
+        ulValue += uszData[iSize - i];
+    }
+
+    return ulValue;
+}
+
+void _PEInfoParseOptHeader(PEHeader *pPEHeader, const uchar *uszOptHeader, size_t nSize) {
+    ulong   i, ulOstBase, ulOstNumDirs, ulOstDirs, ulNumDirs;
+    int     iSizeBase;
+
+    if (nSize < DATATYPE_SIZE_WORD)
+        return;
+    pPEHeader->usOptMagic = _PEInfoReadInt(uszOptHeader + OPT_HEADER_OFF_MAGIC, DATATYPE_SIZE_WORD);
+    if (pPEHeader->usOptMagic == OPT_HEADER_MAGIC_PE32) {
+        ulOstBase = OPT_HEADER_OFF_IMAGE_BASE_PE32;
+        iSizeBase = DATATYPE_SIZE_DWORD;
+        ulOstNumDirs = OPT_HEADER_OFF_NUM_DIRS_PE32;
+        ulOstDirs = OPT_HEADER_OFF_DIRS_PE32;
+    } else if (pPEHeader->usOptMagic == OPT_HEADER_MAGIC_PE32_PLUS) {
+        ulOstBase = OPT_HEADER_OFF_IMAGE_BASE_PE32_PLUS;
+        iSizeBase = DATATYPE_SIZE_QWORD;
+        ulOstNumDirs = OPT_HEADER_OFF_NUM_DIRS_PE32_PLUS;
+        ulOstDirs = OPT_HEADER_OFF_DIRS_PE32_PLUS;
+    } else
+        return;
+
+    if (nSize >= OPT_HEADER_OFF_ENTRY_POINT + DATATYPE_SIZE_DWORD)
+        pPEHeader->ulEntryPoint = _PEInfoReadInt(uszOptHeader + OPT_HEADER_OFF_ENTRY_POINT, DATATYPE_SIZE_DWORD);
+    if (nSize >= ulOstBase + iSizeBase)
+        pPEHeader->ulImageBase = _PEInfoReadInt(uszOptHeader + ulOstBase, iSizeBase);
+    if (nSize >= OPT_HEADER_OFF_SIZE_OF_IMAGE + DATATYPE_SIZE_DWORD)
+        pPEHeader->ulImageSize = _PEInfoReadInt(uszOptHeader + OPT_HEADER_OFF_SIZE_OF_IMAGE, DATATYPE_SIZE_DWORD);
+    if (nSize < ulOstNumDirs + DATATYPE_SIZE_DWORD)
+        return;
+
+    /* The declared directory count is bounded by the defined ones and the header size. */
+    ulNumDirs = _PEInfoReadInt(uszOptHeader + ulOstNumDirs, DATATYPE_SIZE_DWORD);
+    if (ulNumDirs > DATA_DIR_MAX_ENTRIES)
+        ulNumDirs = DATA_DIR_MAX_ENTRIES;
+    if (ulNumDirs > (nSize - ulOstDirs) / DATA_DIR_PER_ENTRY_SIZE)
+        ulNumDirs = (nSize - ulOstDirs) / DATA_DIR_PER_ENTRY_SIZE;
+    for (i = 0 ; i < ulNumDirs ; i++) {
+        pPEHeader->arrDataDir[i].ulRva = _PEInfoReadInt(uszOptHeader + ulOstDirs + i * DATA_DIR_PER_ENTRY_SIZE,
+                                                        DATATYPE_SIZE_DWORD);
+        pPEHeader->arrDataDir[i].ulSize = _PEInfoReadInt(uszOptHeader + ulOstDirs + i * DATA_DIR_PER_ENTRY_SIZE +
+                                                         DATATYPE_SIZE_DWORD, DATATYPE_SIZE_DWORD);
+    }
+    pPEHeader->ulNumDataDirs = ulNumDirs;
+
+    return;
+}
+
+double _PEInfoCalculateEntropy(const uint *arrFreq, ulong ulNumBytes, double dLogBase) {
+    int     i;
+    double  dEntropy, dProb, dLogProb;
+
+    dEntropy = 0;
+    for (i = 0 ; i < ENTROPY_BLK_SIZE ; i++) {
+        dProb = (double)arrFreq[i] / (double)ulNumBytes;
+        dLogProb = (dProb > 0)? (log(dProb) / dLogBase) : 0;
+        dEntropy += dProb * dLogProb;
+    }
+
+    return -dEntropy;
+}
+
+void _PEInfoSlideEntropy(EntropyInfo *pEntropyInfo, EntropySlide *pSlide, const uchar *uszChunk, size_t nSize) {
+    int     i;
+    size_t  j;
+    ulong   ulNumBytes;
+    uint    uiPos;
+    uchar   ucIn, ucOut;
+    uint    *arrFreq;
+    double  dSum, *arrCLogC;
+    float   *arrSlideEntropy;
+
+    arrFreq = pSlide->arrFreq;
+    arrCLogC = pSlide->arrCLogC;
+    arrSlideEntropy = pEntropyInfo->arrSlideEntropy;
+    ulNumBytes = pSlide->ulNumBytes;
+
+    /* Recompute the sum once per chunk, so the rounding errors do not accumulate. */
+    dSum = 0;
+    for (i = 0 ; i < ENTROPY_BLK_SIZE ; i++)
+        dSum += arrCLogC[arrFreq[i]];
+
+    for (j = 0 ; j < nSize ; j++) {
+        ucIn = uszChunk[j];
+        uiPos = ulNumBytes % ENTROPY_BLK_SIZE;
+        if (ulNumBytes >= ENTROPY_BLK_SIZE) {
+            ucOut = pSlide->arrRing[uiPos];
+            dSum -= arrCLogC[arrFreq[ucOut]] - arrCLogC[arrFreq[ucOut] - 1];
+            arrFreq[ucOut]--;
+        }
+        pSlide->arrRing[uiPos] = ucIn;
+        dSum += arrCLogC[arrFreq[ucIn] + 1] - arrCLogC[arrFreq[ucIn]];
+        arrFreq[ucIn]++;
+        ulNumBytes++;
+
+        if (ulNumBytes >= ENTROPY_BLK_SIZE)
+            arrSlideEntropy[ulNumBytes - ENTROPY_BLK_SIZE] =
+                (float)(pSlide->dLogWindow - dSum / ENTROPY_BLK_SIZE);
+    }
+
+    pSlide->ulNumBytes = ulNumBytes;
+    return;
+}
+
+int _PEInfoMeasureSections(PEInfo *self, ushort usIdxBgn, ushort usIdxEnd) {
+    int         rc, i, j, l;
+    uint        uiNumWorkers, w;
+    long        lNumCpus;
+    ulong       k, ulRawSize, ulBlkSize, ulTotalSize, ulOst;
+    double      dEntropy, dMax, dAvg, dMin;
+    SectionInfo *pSection;
+    EntropyInfo *pEntropyInfo;
+    EntropyTask *pTask;
+    EntropyWorker *arrWorker;
+    EntropyJob  job;
+    EntropySlide slide;
+    uint        arrFreq[ENTROPY_BLK_SIZE];
+
+    rc = 0;
+    pSection = NULL;
+    job.pReader = self->pReader;
+    job.dLogBase = log(ENTROPY_LOG_BASE);
+    job.ulNumTasks = 0;
+    job.ulIdxNext = 0;
+    arrWorker = NULL;
+    uiNumWorkers = 0;
+    if (self->bSlideEntropy == true) {
+        slide.dLogWindow = log(ENTROPY_BLK_SIZE) / job.dLogBase;
+        slide.arrCLogC[0] = 0;
+        for (j = 1 ; j <= ENTROPY_BLK_SIZE ; j++)
+            slide.arrCLogC[j] = j * log(j) / job.dLogBase;
+    }
+
+    try {
+        /* Prepare the entropy arrays of each section, and count the tasks. */
+        ulTotalSize = 0;
+        for (i = usIdxBgn ; i < usIdxEnd ; i++) {
+            pSection = self->arrSectionInfo[i];
+
+            /* Skip the empty section and the measured one. The sliding entropy profile
+               is not cached, so the cached pyramid is useless without it. */
+            ulRawSize = pSection->ulRawSize;
+            if ((ulRawSize == 0) || ((pSection->pEntropyInfo != NULL) && (pSection->pEntropyInfo->bExact == true)))
+                continue;
+            if ((pSection->pCacheKey != NULL) && (self->bSlideEntropy == false) &&
+                (_PEInfoLoadEntropy(self, pSection) == 0))
+                continue;
+            ReaderAdvise(self->pReader, pSection->ulRawOffset, pSection->ulRawOffset + ulRawSize);
+
+            /* Create the EntropyInfo structure unless the section is estimated. */
+            if (pSection->pEntropyInfo == NULL)
+                pSection->pEntropyInfo = (EntropyInfo*)Amalloc(self->pArena, sizeof(EntropyInfo));
+            pEntropyInfo = pSection->pEntropyInfo;
+            pEntropyInfo->bExact = false;
+            pEntropyInfo->arrEntropy = NULL;
+
+            /* Prepare the levels of the entropy pyramid. The level 0 is the block array. */
+            for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++) {
+                ulBlkSize = (_arrLevelBlkSize[l] == 0)? ulRawSize : _arrLevelBlkSize[l];
+                pEntropyInfo->arrLevelBlkSize[l] = ulBlkSize;
+                pEntropyInfo->arrNumLevelBlks[l] = ulRawSize / ulBlkSize + (((ulRawSize % ulBlkSize) == 0)? 0 : 1);
+                pEntropyInfo->arrLevelEntropy[l] = (double*)Acalloc(self->pArena, pEntropyInfo->arrNumLevelBlks[l],
+                                                                   sizeof(double));
+            }
+            pEntropyInfo->ulNumBlks = pEntropyInfo->arrNumLevelBlks[0];
+            pEntropyInfo->arrEntropy = pEntropyInfo->arrLevelEntropy[0];
+
+            /* Prepare the sliding entropy profile of the full windows. */
+            pEntropyInfo->ulNumSlides = 0;
+            pEntropyInfo->arrSlideEntropy = NULL;
+            if ((self->bSlideEntropy == true) && (ulRawSize >= ENTROPY_BLK_SIZE)) {
+                pEntropyInfo->ulNumSlides = ulRawSize - ENTROPY_BLK_SIZE + 1;
+                pEntropyInfo->arrSlideEntropy = (float*)Amalloc(self->pArena,
+                                                                sizeof(float) * pEntropyInfo->ulNumSlides);
+            }
+
+            job.ulNumTasks += ulRawSize / ENTROPY_TASK_SIZE + (((ulRawSize % ENTROPY_TASK_SIZE) == 0)? 0 : 1);
+            ulTotalSize += ulRawSize;
+        }
+        if (job.ulNumTasks == 0)
+            goto EXIT;
+
+        /* Split the sections into the task spans. */
+        job.arrTask = (EntropyTask*)Acalloc(self->pArena, job.ulNumTasks, sizeof(EntropyTask));
+        pTask = job.arrTask;
+        for (i = usIdxBgn ; i < usIdxEnd ; i++) {
+            pSection = self->arrSectionInfo[i];
+            if ((pSection->ulRawSize == 0) || (pSection->pEntropyInfo->bExact == true))
+                continue;
+            for (ulOst = 0 ; ulOst < pSection->ulRawSize ; ulOst += ENTROPY_TASK_SIZE) {
+                pTask->pSection = pSection;
+                pTask->ulOstBgn = ulOst;
+                pTask->ulOstEnd = ((pSection->ulRawSize - ulOst) < ENTROPY_TASK_SIZE)?
+                                  pSection->ulRawSize : (ulOst + ENTROPY_TASK_SIZE);
+                pTask++;
+            }
+        }
+
+        /* The small samples are processed by the calling thread only. */
+        uiNumWorkers = 1;
+        if (ulTotalSize >= ENTROPY_PARALLEL_MIN_SIZE) {
+            lNumCpus = sysconf(_SC_NPROCESSORS_ONLN);
+            if (lNumCpus > ENTROPY_MAX_WORKERS)
+                lNumCpus = ENTROPY_MAX_WORKERS;
+            if (lNumCpus > (long)job.ulNumTasks)
+                lNumCpus = job.ulNumTasks;
+            if (lNumCpus > 1)
+                uiNumWorkers = lNumCpus;
+        }
+
+        /* The chunk buffers are needed only if the sample is not loaded in memory. */
+        arrWorker = (EntropyWorker*)Acalloc(self->pArena, uiNumWorkers, sizeof(EntropyWorker));
+        for (w = 0 ; w < uiNumWorkers ; w++) {
+            arrWorker[w].pJob = &job;
+            arrWorker[w].bThread = false;
+            if (self->bSlideEntropy == true)
+                arrWorker[w].slide = slide;
+            arrWorker[w].uszBuf = NULL;
+            if (self->pReader->uszData == NULL)
+                arrWorker[w].uszBuf = (uchar*)Amalloc(self->pArena, ENTROPY_TASK_SIZE + ENTROPY_BLK_SIZE);
+        }
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+        goto EXIT;
+    } end_try;
+
+    /*------------------------------------------------*
+     *  Main part of the entropy calculation.         *
+     *------------------------------------------------*/
+    /* The calling thread works as the first worker. If a thread cannot be created,
+       its share is taken by the others. */
+    for (w = 1 ; w < uiNumWorkers ; w++) {
+        if (pthread_create(&(arrWorker[w].thread), NULL, _PEInfoEntropyWorker, &(arrWorker[w])) != 0) {
+            Log1("The entropy thread cannot be created (%s).\n", strerror(errno));
+            break;
+        }
+        arrWorker[w].bThread = true;
+    }
+    _PEInfoEntropyWorker(&(arrWorker[0]));
+    for (w = 1 ; w < uiNumWorkers ; w++) {
+        if (arrWorker[w].bThread)
+            pthread_join(arrWorker[w].thread, NULL);
+    }
+
+    /* Reduce the results of the tasks of each section. */
+    pTask = job.arrTask;
+    for (k = 0 ; k < job.ulNumTasks ; ) {
+        pSection = pTask[k].pSection;
+        pEntropyInfo = pSection->pEntropyInfo;
+        memset(arrFreq, 0, sizeof(uint) * ENTROPY_BLK_SIZE);
+        for ( ; (k < job.ulNumTasks) && (pTask[k].pSection == pSection) ; k++) {
+            if (pTask[k].iErrno != 0) {
+                Log2("Invalid PE file (Section \"%s\" can not be read: %s).\n",
+                     pSection->uszNormalizedName, strerror(pTask[k].iErrno));
+                rc = -1;
+                goto EXIT;
+            }
+            if (pTask[k].bShort) {
+                Log1("Invalid PE file (Invalid section \"%s\").\n", pSection->uszNormalizedName);
+                rc = -1;
+                goto EXIT;
+            }
+            for (j = 0 ; j < ENTROPY_BLK_SIZE ; j++)
+                arrFreq[j] += pTask[k].arrFreq[j];
+        }
+
+        for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++) {
+            if (_arrLevelBlkSize[l] == 0)
+                pEntropyInfo->arrLevelEntropy[l][0] = _PEInfoCalculateEntropy(arrFreq, pSection->ulRawSize,
+                                                                              job.dLogBase);
+        }
+
+        dMax = -1;
+        dMin = 10;
+        dAvg = 0;
+        for (ulOst = 0 ; ulOst < pEntropyInfo->ulNumBlks ; ulOst++) {
+            dEntropy = pEntropyInfo->arrEntropy[ulOst];
+            dAvg += dEntropy;
+            if (dEntropy > dMax)
+                dMax = dEntropy;
+            if (dEntropy < dMin)
+                dMin = dEntropy;
+        }
+        pEntropyInfo->dMaxEntropy = dMax;
+        pEntropyInfo->dMinEntropy = dMin;
+        pEntropyInfo->dAvgEntropy = dAvg / pEntropyInfo->ulNumBlks;
+        pEntropyInfo->bExact = true;
+
+        if (pSection->pCacheKey != NULL) {
+            try {
+                _PEInfoStoreEntropy(self, pSection);
+            } catch(EXCEPT_MEM_ALLOC) {
+                rc = -1;
+            } end_try;
+            if (rc != 0)
+                goto EXIT;
+        }
+    }
+
+EXIT:
+    return rc;
+}
+
+int _PEInfoEstimateSection(PEInfo *self, SectionInfo *pSection, double dLogBase) {
+    int         j;
+    ulong       k, ulRawSize, ulNumSamples, ulOst;
+    size_t      nBlkSize;
+    ssize_t     nRealRead;
+    double      dEntropy, dMax, dAvg, dMin;
+    EntropyInfo *pEntropyInfo;
+    uchar       *uszBlk;
+    uchar       uszBuf[ENTROPY_BLK_SIZE];
+    uint        arrFreq[ENTROPY_BLK_SIZE];
+
+    ulRawSize = pSection->ulRawSize;
+    pSection->pEntropyInfo = (EntropyInfo*)Amalloc(self->pArena, sizeof(EntropyInfo));
+    pEntropyInfo = pSection->pEntropyInfo;
+    memset(pEntropyInfo, 0, sizeof(EntropyInfo));
+    pEntropyInfo->bExact = false;
+    pEntropyInfo->ulNumBlks = ulRawSize / ENTROPY_BLK_SIZE + (((ulRawSize % ENTROPY_BLK_SIZE) == 0)? 0 : 1);
+
+    /* Sample the blocks evenly including the first and the last ones, so the truncated
+       section is still detected. */
+    ulNumSamples = (pEntropyInfo->ulNumBlks < ENTROPY_NUM_SAMPLES)? pEntropyInfo->ulNumBlks : ENTROPY_NUM_SAMPLES;
+    dMax = -1;
+    dMin = 10;
+    dAvg = 0;
+    for (k = 0 ; k < ulNumSamples ; k++) {
+        ulOst = (ulNumSamples == 1)? 0 : (k * (pEntropyInfo->ulNumBlks - 1) / (ulNumSamples - 1));
+        ulOst *= ENTROPY_BLK_SIZE;
+        nBlkSize = ((ulRawSize - ulOst) < ENTROPY_BLK_SIZE)? (ulRawSize - ulOst) : ENTROPY_BLK_SIZE;
+        nRealRead = ReaderReadAt(self->pReader, pSection->ulRawOffset + ulOst, nBlkSize, uszBuf, &uszBlk);
+        if (nRealRead < 0) {
+            Log2("Invalid PE file (Section \"%s\" can not be read: %s).\n",
+                 pSection->uszNormalizedName, strerror(errno));
+            return -1;
+        }
+        if (nRealRead != (ssize_t)nBlkSize) {
+            Log1("Invalid PE file (Invalid section \"%s\").\n", pSection->uszNormalizedName);
+            return -1;
+        }
+
+        /* The last partial block is padded with zeros as the exact measurement. */
+        memset(arrFreq, 0, sizeof(uint) * ENTROPY_BLK_SIZE);
+        for (j = 0 ; j < nBlkSize ; j++)
+            arrFreq[uszBlk[j]]++;
+        arrFreq[0] += ENTROPY_BLK_SIZE - nBlkSize;
+        dEntropy = _PEInfoCalculateEntropy(arrFreq, ENTROPY_BLK_SIZE, dLogBase);
+
+        dAvg += dEntropy;
+        if (dEntropy > dMax)
+            dMax = dEntropy;
+        if (dEntropy < dMin)
+            dMin = dEntropy;
+    }
+    pEntropyInfo->dMaxEntropy = dMax;
+    pEntropyInfo->dMinEntropy = dMin;
+    pEntropyInfo->dAvgEntropy = dAvg / ulNumSamples;
+
+    return 0;
+}
+
+void _PEInfoHashSections(PEInfo *self) {
+    int         i;
+    uchar       *uszBuf;
+    SectionInfo *pSection;
+
+    uszBuf = NULL;
+    if (self->pReader->uszData == NULL)
+        uszBuf = (uchar*)Amalloc(self->pArena, CACHE_HASH_CHUNK_SIZE);
+
+    for (i = 0 ; i < self->pPEHeader->usNumSections ; i++) {
+        pSection = self->arrSectionInfo[i];
+        if ((pSection->ulRawSize == 0) || (pSection->pCacheKey != NULL))
+            continue;
+        pSection->pCacheKey = (CacheKey*)Amalloc(self->pArena, sizeof(CacheKey));
+        if (CacheHashRange(pSection->pCacheKey, self->pReader, pSection->ulRawOffset, pSection->ulRawSize, uszBuf) != 0)
+            pSection->pCacheKey = NULL;
+    }
+
+    return;
+}
+
+int _PEInfoLoadEntropy(PEInfo *self, SectionInfo *pSection) {
+    int         l;
+    ulong       ulRawSize, ulBlkSize, ulNumDoubles;
+    ulong       arrNumLevelBlks[ENTROPY_NUM_LEVELS], arrLevelBlkSize[ENTROPY_NUM_LEVELS];
+    size_t      nSize;
+    double      *arrData;
+    EntropyInfo *pEntropyInfo;
+
+    /* The entry holds the max, average and min entropies followed by the levels. */
+    ulRawSize = pSection->ulRawSize;
+    ulNumDoubles = 3;
+    for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++) {
+        ulBlkSize = (_arrLevelBlkSize[l] == 0)? ulRawSize : _arrLevelBlkSize[l];
+        arrLevelBlkSize[l] = ulBlkSize;
+        arrNumLevelBlks[l] = ulRawSize / ulBlkSize + (((ulRawSize % ulBlkSize) == 0)? 0 : 1);
+        ulNumDoubles += arrNumLevelBlks[l];
+    }
+
+    arrData = (double*)CacheLoad(self->cszCacheDir, pSection->pCacheKey, CACHE_KIND_ENTROPY, self->pArena,
+                                 sizeof(double) * ulNumDoubles, &nSize);
+    if ((arrData == NULL) || (nSize != sizeof(double) * ulNumDoubles))
+        return -1;
+
+    /* Reuse the EntropyInfo structure of the estimated section. */
+    if (pSection->pEntropyInfo == NULL)
+        pSection->pEntropyInfo = (EntropyInfo*)Amalloc(self->pArena, sizeof(EntropyInfo));
+    pEntropyInfo = pSection->pEntropyInfo;
+    pEntropyInfo->dMaxEntropy = arrData[0];
+    pEntropyInfo->dAvgEntropy = arrData[1];
+    pEntropyInfo->dMinEntropy = arrData[2];
+    arrData += 3;
+    for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++) {
+        pEntropyInfo->arrLevelBlkSize[l] = arrLevelBlkSize[l];
+        pEntropyInfo->arrNumLevelBlks[l] = arrNumLevelBlks[l];
+        pEntropyInfo->arrLevelEntropy[l] = arrData;
+        arrData += arrNumLevelBlks[l];
+    }
+    pEntropyInfo->ulNumBlks = pEntropyInfo->arrNumLevelBlks[0];
+    pEntropyInfo->arrEntropy = pEntropyInfo->arrLevelEntropy[0];
+    pEntropyInfo->ulNumSlides = 0;
+    pEntropyInfo->arrSlideEntropy = NULL;
+    pEntropyInfo->bExact = true;
+
+    return 0;
+}
+
+void _PEInfoStoreEntropy(PEInfo *self, SectionInfo *pSection) {
+    int         l;
+    ulong       ulNumDoubles, ulIdx;
+    double      *arrData;
+    EntropyInfo *pEntropyInfo;
+
+    pEntropyInfo = pSection->pEntropyInfo;
+    ulNumDoubles = 3;
+    for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++)
+        ulNumDoubles += pEntropyInfo->arrNumLevelBlks[l];
+
+    arrData = (double*)Amalloc(self->pArena, sizeof(double) * ulNumDoubles);
+    arrData[0] = pEntropyInfo->dMaxEntropy;
+    arrData[1] = pEntropyInfo->dAvgEntropy;
+    arrData[2] = pEntropyInfo->dMinEntropy;
+    ulIdx = 3;
+    for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++) {
+        memcpy(arrData + ulIdx, pEntropyInfo->arrLevelEntropy[l], sizeof(double) * pEntropyInfo->arrNumLevelBlks[l]);
+        ulIdx += pEntropyInfo->arrNumLevelBlks[l];
+    }
+
+    /* A failed store only costs the next run a recomputation. */
+    CacheStore(self->cszCacheDir, pSection->pCacheKey, CACHE_KIND_ENTROPY, arrData, sizeof(double) * ulNumDoubles);
+    return;
+}
+
+void _PEInfoEntropyTask(EntropyWorker *pWorker, EntropyTask *pTask) {
+    int         j, l;
+    bool        bLastBlk;
+    ulong       ulPrelude, ulBlkRead;
+    size_t      nLength, nBlkSize;
+    ssize_t     nRealRead;
+    double      dLogBase;
+    uchar       *uszData, *uszBlk;
+    SectionInfo *pSection;
+    EntropyInfo *pEntropyInfo;
+    EntropySlide *pSlide;
+    ulong       arrLevelBytes[ENTROPY_NUM_LEVELS], arrLevelIdx[ENTROPY_NUM_LEVELS];
+    uint        arrLevelFreq[ENTROPY_NUM_LEVELS][ENTROPY_BLK_SIZE];
+
+    pSection = pTask->pSection;
+    pEntropyInfo = pSection->pEntropyInfo;
+    dLogBase = pWorker->pJob->dLogBase;
+
+    /* The window of the sliding profile also needs the block before the span. */
+    ulPrelude = ((pEntropyInfo->arrSlideEntropy != NULL) && (pTask->ulOstBgn > 0))? ENTROPY_BLK_SIZE : 0;
+    nLength = pTask->ulOstEnd - pTask->ulOstBgn + ulPrelude;
+    nRealRead = ReaderReadAt(pWorker->pJob->pReader, pSection->ulRawOffset + pTask->ulOstBgn - ulPrelude,
+                             nLength, pWorker->uszBuf, &uszData);
+    if (nRealRead < 0) {
+        pTask->iErrno = errno;
+        return;
+    }
+    if (nRealRead != (ssize_t)nLength) {
+        pTask->bShort = true;
+        return;
+    }
+
+    if (pEntropyInfo->arrSlideEntropy != NULL) {
+        pSlide = &(pWorker->slide);
+        memset(pSlide->arrFreq, 0, sizeof(uint) * ENTROPY_BLK_SIZE);
+        for (j = 0 ; j < ulPrelude ; j++) {
+            pSlide->arrRing[j] = uszData[j];
+            pSlide->arrFreq[uszData[j]]++;
+        }
+        pSlide->ulNumBytes = pTask->ulOstBgn;
+        _PEInfoSlideEntropy(pEntropyInfo, pSlide, uszData + ulPrelude, nLength - ulPrelude);
+    }
+    uszData += ulPrelude;
+    nLength -= ulPrelude;
+
+    for (l = 0 ; l < ENTROPY_NUM_LEVELS ; l++) {
+        arrLevelBytes[l] = 0;
+        arrLevelIdx[l] = pTask->ulOstBgn / pEntropyInfo->arrLevelBlkSize[l];
+    }
+    memset(arrLevelFreq, 0, sizeof(uint) * ENTROPY_NUM_LEVELS * ENTROPY_BLK_SIZE);
+
+    for (ulBlkRead = 0 ; ulBlkRead < nLength ; ulBlkRead += nBlkSize) {
+        nBlkSize = ((nLength - ulBlkRead) < ENTROPY_BLK_SIZE)? (nLength - ulBlkRead) : ENTROPY_BLK_SIZE;
+        uszBlk = uszData + ulBlkRead;
+        bLastBlk = (ulBlkRead + nBlkSize) == nLength;
+
+        /* Record the number of appearence times of each unique byte. */
+        for (j = 0 ; j < nBlkSize ; j++)
+            arrLevelFreq[0][uszBlk[j]]++;
+        arrLevelBytes[0] = nBlkSize;
+
+        /* Calculate the entropy for this block. The last partial block is
+           padded with zeros. */
+        arrLevelFreq[0][0] += ENTROPY_BLK_SIZE - nBlkSize;
+        pEntropyInfo->arrLevelEntropy[0][arrLevelIdx[0]++] =
+            _PEInfoCalculateEntropy(arrLevelFreq[0], ENTROPY_BLK_SIZE, dLogBase);
+        arrLevelFreq[0][0] -= ENTROPY_BLK_SIZE - nBlkSize;
+
+        /* Merge the histogram of the closed block into its parent, and close the
+           parent if it is complete or the span ends. Since the span is aligned to
+           the blocks, only the last span of the section closes a partial block.
+           The whole section level is left to the reduction. */
+        for (l = 1 ; l < ENTROPY_NUM_LEVELS ; l++) {
+            for (j = 0 ; j < ENTROPY_BLK_SIZE ; j++)
+                arrLevelFreq[l][j] += arrLevelFreq[l - 1][j];
+            arrLevelBytes[l] += arrLevelBytes[l - 1];
+            memset(arrLevelFreq[l - 1], 0, sizeof(uint) * ENTROPY_BLK_SIZE);
+            arrLevelBytes[l - 1] = 0;
+
+            if (_arrLevelBlkSize[l] == 0)
+                break;
+            if ((bLastBlk == false) && (arrLevelBytes[l] < pEntropyInfo->arrLevelBlkSize[l]))
+                break;
+            pEntropyInfo->arrLevelEntropy[l][arrLevelIdx[l]++] =
+                _PEInfoCalculateEntropy(arrLevelFreq[l], arrLevelBytes[l], dLogBase);
+        }
+    }
+
+    /* The whole section level accumulates the histogram of the span. */
+    memcpy(pTask->arrFreq, arrLevelFreq[ENTROPY_NUM_LEVELS - 1], sizeof(uint) * ENTROPY_BLK_SIZE);
+    return;
+}
+
+void* _PEInfoEntropyWorker(void *vpWorker) {
+    ulong           ulIdxTask;
+    EntropyWorker   *pWorker;
+    EntropyJob      *pJob;
+
+    pWorker = (EntropyWorker*)vpWorker;
+    pJob = pWorker->pJob;
+    while (true) {
+        ulIdxTask = __atomic_fetch_add(&(pJob->ulIdxNext), 1, __ATOMIC_RELAXED);
+        if (ulIdxTask >= pJob->ulNumTasks)
+            break;
+
+        TraceBegin("entropy_task");
+        _PEInfoEntropyTask(pWorker, &(pJob->arrTask[ulIdxTask]));
+        TraceEnd("entropy_task");
+    }
+
+    return NULL;
+}
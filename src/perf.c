@@ -0,0 +1,214 @@
+#include "perf.h"
+
+#if defined(__linux__)
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+
+
+/* The switch to activate the sampling. It is set only if the events can be opened. */
+bool _bPerfOn = false;
+
+
+/*===========================================================================*
+ *                  Simulation for private variables                         *
+ *===========================================================================*/
+/* The file descriptors of the opened events and the accumulators. */
+int _arrPerfFd[PERF_COUNTER_COUNT] = {-1, -1, -1, -1, -1};
+PerfSample _perfSample;
+
+/* The names of the events shown in the JSON dump. */
+static const char *_arrPerfCounterName[PERF_COUNTER_COUNT] = {
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+};
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function reads the raw value of the specified event.
+ *
+ * @param   idxCounter      The index of the event.
+ * @param   pReading        The pointer to the reading to be filled.
+ *
+ * @return                  0: The event is read successfully.
+ *                        < 0: The read fails.
+ */
+int _PerfRead(int idxCounter, PerfReading *pReading);
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+int PerfOpen() {
+    int     i, iNumOpened, iErrno;
+    #if defined(__linux__)
+        struct perf_event_attr attr;
+        static const uint arrType[PERF_COUNTER_COUNT] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        };
+        static const ulong arrConfig[PERF_COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+    #endif
+
+    memset(&_perfSample, 0, sizeof(PerfSample));
+    iNumOpened = 0;
+    iErrno = 0;
+
+    /* The events are sampled by the phase hooks, which are compiled out without the statistics. */
+    #if !defined(ENABLE_STATS)
+        Log0("The hardware performance counters require the engine built with ENABLE_STATS.\n");
+        return -1;
+    #endif
+
+    #if defined(__linux__)
+        for (i = 0 ; i < PERF_COUNTER_COUNT ; i++) {
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = arrType[i];
+            attr.config = arrConfig[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            /* Count the events of the calling thread and of the threads it creates later on
+               any cpu. The counts of a child are folded in when it exits, so the entropy
+               workers joined within a phase are attributed to that phase. */
+            attr.inherit = 1;
+            _arrPerfFd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            if (_arrPerfFd[i] < 0) {
+                iErrno = errno;
+                continue;
+            }
+            _perfSample.arrValid[i] = true;
+            iNumOpened++;
+        }
+    #endif
+
+    if (iNumOpened == 0) {
+        Log1("The hardware performance counters are unavailable (%s).\n", strerror(iErrno));
+        return -1;
+    }
+
+    _bPerfOn = true;
+    return 0;
+}
+
+void PerfBeginPhase() {
+    int i;
+
+    for (i = 0 ; i < PERF_COUNTER_COUNT ; i++) {
+        if (_perfSample.arrValid[i] && (_PerfRead(i, &(_perfSample.arrBgn[i])) != 0))
+            _perfSample.arrValid[i] = false;
+    }
+
+    return;
+}
+
+void PerfEndPhase(int idxPhase) {
+    int         i;
+    ulong       ulValue, ulTimeEnabled, ulTimeRunning;
+    PerfReading readEnd, *pBgn;
+
+    for (i = 0 ; i < PERF_COUNTER_COUNT ; i++) {
+        if (_perfSample.arrValid[i] == false)
+            continue;
+        if (_PerfRead(i, &readEnd) != 0) {
+            _perfSample.arrValid[i] = false;
+            continue;
+        }
+
+        /* The raw counts are monotonic, so the deltas are scaled by the ratio within the phase. */
+        pBgn = &(_perfSample.arrBgn[i]);
+        if ((readEnd.ulValue < pBgn->ulValue) || (readEnd.ulTimeRunning <= pBgn->ulTimeRunning))
+            continue;
+        ulValue = readEnd.ulValue - pBgn->ulValue;
+        ulTimeEnabled = readEnd.ulTimeEnabled - pBgn->ulTimeEnabled;
+        ulTimeRunning = readEnd.ulTimeRunning - pBgn->ulTimeRunning;
+        if (ulTimeRunning < ulTimeEnabled)
+            ulValue = (ulong)((double)ulValue * (double)ulTimeEnabled / (double)ulTimeRunning);
+        _perfSample.arrValue[idxPhase][i] += ulValue;
+    }
+
+    return;
+}
+
+void PerfDumpSample(FILE *fp, const char *cszSampleName) {
+    int     i, j;
+    ulong   *arrValue;
+
+    fprintf(fp, "{\"sample\": \"%s\", \"perf\": ", (cszSampleName != NULL)? cszSampleName : "");
+    if (_bPerfOn == false) {
+        fprintf(fp, "\"unavailable\"}\n");
+        return;
+    }
+
+    fprintf(fp, "{");
+    for (i = 0 ; i < STATS_PHASE_COUNT ; i++) {
+        arrValue = _perfSample.arrValue[i];
+        fprintf(fp, "%s\"%s\": {", (i == 0)? "" : ", ", _arrStatsPhaseName[i]);
+        for (j = 0 ; j < PERF_COUNTER_COUNT ; j++) {
+            if (_perfSample.arrValid[j])
+                fprintf(fp, "\"%s\": %lu, ", _arrPerfCounterName[j], arrValue[j]);
+            else
+                fprintf(fp, "\"%s\": null, ", _arrPerfCounterName[j]);
+        }
+        if (_perfSample.arrValid[PERF_COUNTER_CYCLES] && _perfSample.arrValid[PERF_COUNTER_INSTRUCTIONS] &&
+            (arrValue[PERF_COUNTER_CYCLES] != 0))
+            fprintf(fp, "\"ipc\": %.3lf}", (double)arrValue[PERF_COUNTER_INSTRUCTIONS] /
+                                           (double)arrValue[PERF_COUNTER_CYCLES]);
+        else
+            fprintf(fp, "\"ipc\": null}");
+    }
+    fprintf(fp, "}}\n");
+
+    /* Reset the accumulators for the next sample. */
+    memset(_perfSample.arrValue, 0, sizeof(_perfSample.arrValue));
+
+    return;
+}
+
+void PerfClose() {
+    int i;
+
+    for (i = 0 ; i < PERF_COUNTER_COUNT ; i++) {
+        if (_arrPerfFd[i] >= 0)
+            close(_arrPerfFd[i]);
+        _arrPerfFd[i] = -1;
+        _perfSample.arrValid[i] = false;
+    }
+    _bPerfOn = false;
+
+    return;
+}
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+int _PerfRead(int idxCounter, PerfReading *pReading) {
+    ssize_t nRead;
+    ulong   arrRead[3];
+
+    /* The layout is {value, time_enabled, time_running}. */
+    nRead = read(_arrPerfFd[idxCounter], arrRead, sizeof(arrRead));
+    if (nRead != sizeof(arrRead))
+        return -1;
+    pReading->ulValue = arrRead[0];
+    pReading->ulTimeEnabled = arrRead[1];
+    pReading->ulTimeRunning = arrRead[2];
+
+    return 0;
+}
@@ -14,40 +14,27 @@
  *===========================================================================*/
 /**
  * This function hints the qsort() library to sort the n-gram tokens by their appearance frequency
- * in descending order.
+ * in descending order. The tokens with the same frequency are sorted by their values in ascending
+ * order, so the model is deterministic.
  *
- * @param   ppSrc        The pointer to the pointer indexing to the source token.
- * @param   ppDst        The pointer to the pointer indexing to the target token.
+ * @param   pSrc         The pointer to the source token.
+ * @param   pTge         The pointer to the target token.
  *
  * @return             < 0: The source token must go before the target one.
  *                       0: The source and target tokens do not need to change their order.
  *                     > 0: The source token must go after the target one. 
  */
-int _CompTokenFreqDescOrder(const void *ppSrc, const void *ppTge) {
-    Token *pSrc, *pTge;
+int _CompTokenFreqDescOrder(const void *pSrc, const void *pTge) {
+    const Token *pTokSrc, *pTokTge;
 
-    pSrc = *(Token**)ppSrc;
-    pTge = *(Token**)ppTge;
+    pTokSrc = (const Token*)pSrc;
+    pTokTge = (const Token*)pTge;
 
-    if (pSrc == NULL) {
-        if (pTge == NULL)
-            return 0;
-        else
-            return 1;
-    } else {
-        if (pTge == NULL)
-            return -1;
-        else {
-            if (pSrc->ulFrequency == pTge->ulFrequency)
-                return 0;
-            else {
-                if (pSrc->ulFrequency < pTge->ulFrequency)
-                    return 1;
-                else
-                    return -1;
-            }
-        }
-    }
+    if (pTokSrc->ulFrequency != pTokTge->ulFrequency)
+        return (pTokSrc->ulFrequency < pTokTge->ulFrequency)? 1 : -1;
+    if (pTokSrc->ulValue != pTokTge->ulValue)
+        return (pTokSrc->ulValue < pTokTge->ulValue)? -1 : 1;
+    return 0;
 }
 
 
@@ -60,54 +47,55 @@ int _CompTokenFreqDescOrder(const void *ppSrc, const void *ppTge) {
  * @param   pNGram              The pointer to the NGram structure.
  *                              The plugin can reference the n-gram tokens from
  *                              this structure and then put the model into it.
+ *                              The model should be allocated from its arena with Amalloc().
  * @param   ulMaxValue          The maximum n-gram value. 
  * 
  * @return                      0: The model is generated successfully.
  *                            < 0: Exception occurs while memory allocation.
  */
 int model_run(NGram *pNGram, ulong ulMaxValue) {
-    int     rc, i, j;
-    double  dScore;
-    Token   *pToken, *pDenominator, *pNumerator;
+    int     rc;
+    ulong   i, j, ulNumTokens;
+    double  dDenominator;
+    Token   *arrToken;
 
     rc = 0;
     try {
-        /* Sort the tokens. */
-        qsort(pNGram->arrToken, ulMaxValue, sizeof(Token*), _CompTokenFreqDescOrder);
-
-        pNGram->ulNumSlices = pNGram->ulNumTokens;
-        pNGram->arrSlice = NULL;
-        pNGram->arrSlice = (Slice**)Calloc(pNGram->ulNumSlices, sizeof(Slice*));
-        for (i = 0 ; i < pNGram->ulNumSlices ; i++)
-            pNGram->arrSlice[i] = NULL; 
-    
-        /* Choose the most frequently appearing token as the denominator. */
-        pDenominator = pNGram->arrToken[0];
+        pNGram->ulNumSlices = 0;
+        ulNumTokens = pNGram->ulNumTokens;
+        if (ulNumTokens == 0)
+            goto EXIT;
 
-        /* Collect the slices. */
-        for (i = 0, j = 0; i < pNGram->ulNumTokens ; i++) {
-            pToken = pNGram->arrToken[i];
-            
-            if (pToken == NULL) {
-                break;
+        /* Pack the non-zero histogram entries into a dense token array and sort it. */
+        arrToken = (Token*)Amalloc(pNGram->pArena, sizeof(Token) * ulNumTokens);
+        for (i = 0, j = 0 ; (i < ulMaxValue) && (j < ulNumTokens) ; i++) {
+            if (pNGram->arrFrequency[i] != 0) {
+                arrToken[j].ulValue = i;
+                arrToken[j].ulFrequency = pNGram->arrFrequency[i];
+                j++;
             }
+        }
+        qsort(arrToken, ulNumTokens, sizeof(Token), _CompTokenFreqDescOrder);
 
-            if ((pToken->ulValue != 0) && (pToken->ulValue != (ulMaxValue - 1))) {
-                pNumerator = pToken;
-                
-                pNGram->arrSlice[j] = (Slice*)Malloc(sizeof(Slice));
-                pNGram->arrSlice[j]->pDenominator = pDenominator;
-                pNGram->arrSlice[j]->pNumerator = pNumerator;
+        pNGram->arrSliceValue = (ulong*)Amalloc(pNGram->pArena, sizeof(ulong) * ulNumTokens);
+        pNGram->arrSliceFrequency = (ulong*)Amalloc(pNGram->pArena, sizeof(ulong) * ulNumTokens);
+        pNGram->arrSliceScore = (double*)Amalloc(pNGram->pArena, sizeof(double) * ulNumTokens);
 
-                dScore = (double)pNumerator->ulFrequency / (double)pDenominator->ulFrequency;
-                pNGram->arrSlice[j]->dScore = dScore;                
+        /* Choose the most frequently appearing token as the denominator. */
+        pNGram->tokDenominator = arrToken[0];
+        dDenominator = (double)arrToken[0].ulFrequency;
 
-                j++;
-            }
+        /* Collect the slices. */
+        for (i = 0 ; i < ulNumTokens ; i++) {
+            pNGram->arrSliceValue[i] = arrToken[i].ulValue;
+            pNGram->arrSliceFrequency[i] = arrToken[i].ulFrequency;
+            pNGram->arrSliceScore[i] = (double)arrToken[i].ulFrequency / dDenominator;
         }
+        pNGram->ulNumSlices = ulNumTokens;
     } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
     } end_try;
-    
+
+EXIT:
     return rc;
 }
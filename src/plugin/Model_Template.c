@@ -17,6 +17,7 @@
  * @param   pNGram              The pointer to the NGram structure.
  *                              The plugin can reference the n-gram tokens from
  *                              this structure and then put the model into it.
+ *                              The model should be allocated from its arena with Amalloc().
  * @param   ulMaxValue          The maximum n-gram value.
  *
  * @return                      0: The model is generated successfully.
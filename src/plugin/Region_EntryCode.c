@@ -0,0 +1,200 @@
+#include "region.h"
+
+/*---------------------------------------------------------------------------*
+ *                          Plugin Objective                                 *
+ *                                                                           *
+ *  This plugin selects the code which actually runs: the section holding    *
+ *  the entry point, which is the unpacking stub of a packed sample, and     *
+ *  the sections flagged as executable or as containing code. Each of them   *
+ *  is chosen entirely for n-gram model generation. The entry point is       *
+ *  located by the virtual range of each section, so no entropy is needed    *
+ *  and the sections stay estimated with --lazy-entropy. If no section is    *
+ *  selected, the entire section with maximum average entropy is selected    *
+ *  instead.                                                                 *
+ *                                                                           *
+ *  The plugin argument can restrict the selection with the format:          *
+ *      scope=entry    (Only the section holding the entry point.)           *
+ *      scope=code     (The entry and the executable sections, default.)     *
+ *---------------------------------------------------------------------------*/
+
+
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define ENTRY_KEY_SCOPE             "scope"
+#define ENTRY_SCOPE_ENTRY           "entry"
+#define ENTRY_SCOPE_CODE            "code"
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+/**
+ * This function parses the plugin argument.
+ *
+ * @param   cszArg          The plugin argument string. It can be NULL.
+ * @param   pbEntryOnly     The pointer to the flag which will be overridden.
+ */
+void _EntryParseArg(const char *cszArg, bool *pbEntryOnly) {
+    char    *szToken, *szSave, *szValue;
+    char    buf[BUF_SIZE_SMALL];
+
+    if (cszArg == NULL)
+        return;
+
+    memset(buf, 0, sizeof(char) * BUF_SIZE_SMALL);
+    strncpy(buf, cszArg, BUF_SIZE_SMALL - 1);
+    for (szToken = strtok_r(buf, ",", &szSave) ; szToken != NULL ; szToken = strtok_r(NULL, ",", &szSave)) {
+        szValue = strchr(szToken, '=');
+        if (szValue == NULL)
+            continue;
+        *szValue++ = 0;
+        if (strcmp(szToken, ENTRY_KEY_SCOPE) == 0) {
+            if (strcmp(szValue, ENTRY_SCOPE_ENTRY) == 0)
+                *pbEntryOnly = true;
+            else if (strcmp(szValue, ENTRY_SCOPE_CODE) == 0)
+                *pbEntryOnly = false;
+        }
+    }
+
+    return;
+}
+
+
+/**
+ * This function checks whether a section should be modeled.
+ *
+ * @param   pSection        The pointer to the SectionInfo structure.
+ * @param   ulEntryPoint    The RVA of the entry point, or 0 if the image has none.
+ * @param   bEntryOnly      Whether only the section holding the entry point is selected.
+ *
+ * @return                  true if the section is selected, false otherwise.
+ */
+bool _EntrySelectSection(SectionInfo *pSection, ulong ulEntryPoint, bool bEntryOnly) {
+    ulong   ulSpan;
+
+    if ((pSection == NULL) || (pSection->ulRawSize == 0))
+        return false;
+
+    /* The loader maps at least the raw data even if the virtual size is smaller. */
+    ulSpan = (pSection->ulVirtualSize > pSection->ulRawSize)? pSection->ulVirtualSize : pSection->ulRawSize;
+    if ((ulEntryPoint != 0) && (ulEntryPoint >= pSection->ulVirtualAddress) &&
+        (ulEntryPoint - pSection->ulVirtualAddress < ulSpan))
+        return true;
+    if (bEntryOnly == true)
+        return false;
+
+    return (pSection->ulCharacteristics & (SECTION_CHARS_MEM_EXECUTE | SECTION_CHARS_CNT_CODE))? true : false;
+}
+
+
+/**
+ * This function records an entire section as a region.
+ *
+ * @param   pRegionCollector    The pointer to the RegionCollector structure.
+ * @param   pPEInfo             The pointer to the PEInfo structure.
+ * @param   usIdxSection        The index of the section.
+ *
+ * @return                      EXCEPT_MEM_ALLOC is thrown if the region cannot be allocated.
+ */
+void _EntryRecordSection(RegionCollector *pRegionCollector, PEInfo *pPEInfo, ushort usIdxSection) {
+    Region  *pRegion;
+    Arena   *pArena;
+
+    pArena = pRegionCollector->pArena;
+    pRegion = (Region*)Amalloc(pArena, sizeof(Region));
+    pRegion->usIdxSection = usIdxSection;
+    pRegion->ulNumPairs = 1;
+    pRegion->arrRangePair = (RangePair**)Amalloc(pArena, sizeof(RangePair*));
+    pRegion->arrRangePair[0] = (RangePair*)Amalloc(pArena, sizeof(RangePair));
+    pRegion->arrRangePair[0]->ulIdxBgn = 0;
+    pRegion->arrRangePair[0]->ulIdxEnd = pPEInfo->arrSectionInfo[usIdxSection]->pEntropyInfo->ulNumBlks;
+    pRegion->arrRangePair[0]->ulOstBgn = 0;
+    pRegion->arrRangePair[0]->ulOstEnd = 0;
+
+    pRegionCollector->arrRegion[pRegionCollector->usNumRegions++] = pRegion;
+    return;
+}
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+/**
+ * This function is the entry point of the plugin.
+ *
+ * @param   pRegionCollector    The pointer to the RegionCollector structure.
+ *                              The plugin should put the data into this structure.
+ *                              The data should be allocated from its arena with Amalloc().
+ * @param   pPEInfo             The pointer to the PEInfo structure.
+ *                              The plugin can refer to this structure to determine
+ *                              the binary regions for n-gram generation.
+ *
+ * @return                      0: The binary regions are collected successfully.
+ *                            < 0: Exception occurs while memory allocation.
+ */
+int region_run(RegionCollector *pRegionCollector, PEInfo *pPEInfo) {
+    int         rc, i;
+    bool        bEntryOnly;
+    ushort      usNumSections, usNumRegions, usIdxSection;
+    ulong       ulEntryPoint;
+    double      dMax;
+    SectionInfo *pSection;
+
+    usNumSections = pPEInfo->pPEHeader->usNumSections;
+    ulEntryPoint = pPEInfo->pPEHeader->ulEntryPoint;
+    bEntryOnly = false;
+    _EntryParseArg(pRegionCollector->cszPlugArg, &bEntryOnly);
+
+    /* Count the selected sections. */
+    usNumRegions = 0;
+    for (i = 0 ; i < usNumSections ; i++) {
+        if (_EntrySelectSection(pPEInfo->arrSectionInfo[i], ulEntryPoint, bEntryOnly) == true)
+            usNumRegions++;
+    }
+
+    /* Fall back to the entire section with maximum average entropy. The estimated
+       sections are measured first, so the sampling does not decide it. The
+       measurement runs its own try block, which does not restore the handler, so
+       it must finish before the try block below opens. */
+    usIdxSection = usNumSections;
+    if (usNumRegions == 0) {
+        dMax = -1;
+        for (i = 0 ; i < usNumSections ; i++) {
+            pSection = pPEInfo->arrSectionInfo[i];
+            if ((pSection == NULL) || (pSection->ulRawSize == 0))
+                continue;
+            rc = pPEInfo->measureSection(pPEInfo, i);
+            if (rc != 0)
+                return rc;
+            if (dMax < pSection->pEntropyInfo->dAvgEntropy) {
+                dMax = pSection->pEntropyInfo->dAvgEntropy;
+                usIdxSection = i;
+            }
+        }
+    }
+
+    pRegionCollector->usNumRegions = 0;
+    pRegionCollector->arrRegion = NULL;
+    if ((usNumRegions == 0) && (usIdxSection == usNumSections))
+        return 0;
+
+    rc = 0;
+    try {
+        if (usNumRegions == 0) {
+            pRegionCollector->arrRegion = (Region**)Amalloc(pRegionCollector->pArena, sizeof(Region*));
+            _EntryRecordSection(pRegionCollector, pPEInfo, usIdxSection);
+        } else {
+            /* Record each selected section as a region. */
+            pRegionCollector->arrRegion = (Region**)Acalloc(pRegionCollector->pArena, usNumRegions, sizeof(Region*));
+            for (i = 0 ; i < usNumSections ; i++) {
+                if (_EntrySelectSection(pPEInfo->arrSectionInfo[i], ulEntryPoint, bEntryOnly) == true)
+                    _EntryRecordSection(pRegionCollector, pPEInfo, i);
+            }
+        }
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } end_try;
+
+    return rc;
+}
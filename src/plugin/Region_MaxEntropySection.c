@@ -4,7 +4,9 @@
  *                          Plugin Objective                                 *
  *                                                                           *
  * This plugin selects the section with maximum average entropy, and it      *
- * chooses the entire binary of this section for n-gram model generation     *
+ * chooses the entire binary of this section for n-gram model generation.    *
+ * If the sections are only estimated, the ones close to the best estimate   *
+ * are measured, so the sampling does not decide a near tie.                 *
  *---------------------------------------------------------------------------*/
 
 
@@ -25,11 +27,38 @@
  */
 int region_run(RegionCollector *pRegionCollector, PEInfo *pPEInfo) {
     int         rc, i;
-    ushort      usNumRegions, usIdxSection;
+    ushort      usNumRegions, usIdxSection, usNumCandidates;
     double      dMax;
     SectionInfo *pSection;
     Region      *pRegion;
 
+    /* Measure the estimated sections which may beat the best estimate. A single
+       candidate wins anyway. The measurement runs its own try block, which does not
+       restore the handler, so it must finish before the try block below opens. */
+    dMax = -1;
+    for (i = 0 ; i < pPEInfo->pPEHeader->usNumSections ; i++) {
+        pSection = pPEInfo->arrSectionInfo[i];
+        if ((pSection != NULL) && (pSection->ulRawSize != 0) && (dMax < pSection->pEntropyInfo->dAvgEntropy))
+            dMax = pSection->pEntropyInfo->dAvgEntropy;
+    }
+    usNumCandidates = 0;
+    for (i = 0 ; i < pPEInfo->pPEHeader->usNumSections ; i++) {
+        pSection = pPEInfo->arrSectionInfo[i];
+        if ((pSection != NULL) && (pSection->ulRawSize != 0) &&
+            (pSection->pEntropyInfo->dAvgEntropy >= dMax - ENTROPY_RANK_MARGIN))
+            usNumCandidates++;
+    }
+    for (i = 0 ; (usNumCandidates > 1) && (i < pPEInfo->pPEHeader->usNumSections) ; i++) {
+        pSection = pPEInfo->arrSectionInfo[i];
+        if ((pSection == NULL) || (pSection->ulRawSize == 0) || (pSection->pEntropyInfo->bExact == true))
+            continue;
+        if (pSection->pEntropyInfo->dAvgEntropy >= dMax - ENTROPY_RANK_MARGIN) {
+            rc = pPEInfo->measureSection(pPEInfo, i);
+            if (rc != 0)
+                return rc;
+        }
+    }
+
     rc = 0;
     try {
         /* Select the section with maximum average entropy. */
@@ -47,23 +76,25 @@ int region_run(RegionCollector *pRegionCollector, PEInfo *pPEInfo) {
         /* Record the region information. */
         pRegionCollector->usNumRegions = 0;
         pRegionCollector->arrRegion = NULL;
-        pRegionCollector->arrRegion = (Region**)Malloc(sizeof(Region*));
+        pRegionCollector->arrRegion = (Region**)Amalloc(pRegionCollector->pArena, sizeof(Region*));
         pRegionCollector->usNumRegions++;
 
         pRegionCollector->arrRegion[0] = NULL;
-        pRegionCollector->arrRegion[0] = (Region*)Malloc(sizeof(Region));
+        pRegionCollector->arrRegion[0] = (Region*)Amalloc(pRegionCollector->pArena, sizeof(Region));
         pRegion = pRegionCollector->arrRegion[0];
 
         pRegion->usIdxSection = usIdxSection;
         pRegion->ulNumPairs = 0;
         pRegion->arrRangePair = NULL;
-        pRegion->arrRangePair = (RangePair**)Malloc(sizeof(RangePair*));
+        pRegion->arrRangePair = (RangePair**)Amalloc(pRegionCollector->pArena, sizeof(RangePair*));
         pRegion->ulNumPairs++;
 
         pRegion->arrRangePair[0] = NULL;
-        pRegion->arrRangePair[0] = (RangePair*)Malloc(sizeof(RangePair));
+        pRegion->arrRangePair[0] = (RangePair*)Amalloc(pRegionCollector->pArena, sizeof(RangePair));
         pRegion->arrRangePair[0]->ulIdxBgn = 0;
         pRegion->arrRangePair[0]->ulIdxEnd = pPEInfo->arrSectionInfo[usIdxSection]->pEntropyInfo->ulNumBlks;
+        pRegion->arrRangePair[0]->ulOstBgn = 0;
+        pRegion->arrRangePair[0]->ulOstEnd = 0;
 
     } catch(EXCEPT_MEM_ALLOC) {
         rc = -1;
@@ -3,12 +3,207 @@
 /*---------------------------------------------------------------------------*
  *                          Plugin Objective                                 *
  *                                                                           *
- *  This plugin collects the binary blocks having the entropy values higher  *
- *  than the predefined threshold from the section with maximum average      *
- *  entropy.                                                                 *
+ *  This plugin collects the high-entropy plateaus, the sustained runs of    *
+ *  binary blocks whose entropy stays above the threshold, from all the      *
+ *  sections. A sliding window of the minimum run length scans the entropy   *
+ *  distribution in linear time, and each window with the average entropy   *
+ *  not less than the threshold is merged into the current plateau. If no    *
+ *  plateau is found, the entire section with maximum average entropy is     *
+ *  selected instead.                                                        *
+ *                                                                           *
+ *  If the sliding entropy profile is available, the edges of each plateau   *
+ *  are moved from the block boundaries to the exact byte offsets where the  *
+ *  entropy of the window after the edge rises the most over the window     *
+ *  before it.                                                               *
+ *                                                                           *
+ *  The plugin argument can override the defaults with the format:           *
+ *      threshold=<entropy>,run=<number of blocks>                           *
  *---------------------------------------------------------------------------*/
 
 
+/*===========================================================================*
+ *                       Definition of constants                             *
+ *===========================================================================*/
+#define PLATEAU_DEFAULT_THRESHOLD   (6.5)   /* The minimum average entropy of a plateau window. */
+#define PLATEAU_DEFAULT_RUN         (4)     /* The minimum number of blocks of a plateau. */
+#define PLATEAU_KEY_THRESHOLD       "threshold"
+#define PLATEAU_KEY_RUN             "run"
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+/**
+ * This function parses the plugin argument.
+ *
+ * @param   cszArg          The plugin argument string. It can be NULL.
+ * @param   pdThreshold     The pointer to the threshold which will be overridden.
+ * @param   pulMinRun       The pointer to the minimum run length which will be overridden.
+ */
+void _PlateauParseArg(const char *cszArg, double *pdThreshold, ulong *pulMinRun) {
+    char    *szToken, *szSave, *szValue;
+    char    buf[BUF_SIZE_SMALL];
+
+    if (cszArg == NULL)
+        return;
+
+    memset(buf, 0, sizeof(char) * BUF_SIZE_SMALL);
+    strncpy(buf, cszArg, BUF_SIZE_SMALL - 1);
+    for (szToken = strtok_r(buf, ",", &szSave) ; szToken != NULL ; szToken = strtok_r(NULL, ",", &szSave)) {
+        szValue = strchr(szToken, '=');
+        if (szValue == NULL)
+            continue;
+        *szValue++ = 0;
+        if (strcmp(szToken, PLATEAU_KEY_THRESHOLD) == 0)
+            *pdThreshold = atof(szValue);
+        else if (strcmp(szToken, PLATEAU_KEY_RUN) == 0) {
+            if (atol(szValue) > 0)
+                *pulMinRun = atol(szValue);
+        }
+    }
+
+    return;
+}
+
+
+/**
+ * This function moves the edges of a plateau to byte offsets with the sliding entropy
+ * profile. Each edge is searched within a block around its block boundary for the
+ * offset with the maximum contrast between the windows after and before it. The
+ * edges at the section boundaries are kept.
+ *
+ * @param   pEntropyInfo    The pointer to the EntropyInfo structure of the section.
+ * @param   ulRawSize       The raw size of the section.
+ * @param   pPair           The pointer to the RangePair structure of the plateau.
+ */
+void _PlateauRefineRun(EntropyInfo *pEntropyInfo, ulong ulRawSize, RangePair *pPair) {
+    ulong   i, ulOstBgn, ulOstEnd, ulLow, ulHigh;
+    float   fContrast, fMax;
+    float   *arrSlide;
+
+    pPair->ulOstBgn = 0;
+    pPair->ulOstEnd = 0;
+    arrSlide = pEntropyInfo->arrSlideEntropy;
+    if ((arrSlide == NULL) || (ulRawSize < 2 * ENTROPY_BLK_SIZE))
+        return;
+
+    /* The windows before and after the offset x start at x - W and x. */
+    ulOstBgn = pPair->ulIdxBgn * ENTROPY_BLK_SIZE;
+    if (ulOstBgn > 0) {
+        ulLow = (ulOstBgn > 2 * ENTROPY_BLK_SIZE)? (ulOstBgn - ENTROPY_BLK_SIZE) : ENTROPY_BLK_SIZE;
+        ulHigh = ulOstBgn + ENTROPY_BLK_SIZE;
+        if (ulHigh > ulRawSize - ENTROPY_BLK_SIZE)
+            ulHigh = ulRawSize - ENTROPY_BLK_SIZE;
+        fMax = 0;
+        for (i = ulLow ; i <= ulHigh ; i++) {
+            fContrast = arrSlide[i] - arrSlide[i - ENTROPY_BLK_SIZE];
+            if (fContrast > fMax) {
+                fMax = fContrast;
+                ulOstBgn = i;
+            }
+        }
+    }
+
+    ulOstEnd = pPair->ulIdxEnd * ENTROPY_BLK_SIZE;
+    if (ulOstEnd < ulRawSize) {
+        ulLow = (ulOstEnd > 2 * ENTROPY_BLK_SIZE)? (ulOstEnd - ENTROPY_BLK_SIZE) : ENTROPY_BLK_SIZE;
+        ulHigh = ulOstEnd + ENTROPY_BLK_SIZE;
+        if (ulHigh > ulRawSize - ENTROPY_BLK_SIZE)
+            ulHigh = ulRawSize - ENTROPY_BLK_SIZE;
+        fMax = 0;
+        for (i = ulLow ; i <= ulHigh ; i++) {
+            fContrast = arrSlide[i - ENTROPY_BLK_SIZE] - arrSlide[i];
+            if (fContrast > fMax) {
+                fMax = fContrast;
+                ulOstEnd = i;
+            }
+        }
+    } else
+        ulOstEnd = ulRawSize;
+
+    if (ulOstBgn < ulOstEnd) {
+        pPair->ulOstBgn = ulOstBgn;
+        pPair->ulOstEnd = ulOstEnd;
+    }
+    return;
+}
+
+
+/**
+ * This function scans the entropy distribution of a section for plateaus.
+ *
+ * @param   pEntropyInfo    The pointer to the EntropyInfo structure of the section.
+ * @param   ulRawSize       The raw size of the section.
+ * @param   dThreshold      The minimum average entropy of a plateau window.
+ * @param   ulMinRun        The minimum number of blocks of a plateau.
+ * @param   arrRangePair    The array to store the plateaus. It can be NULL for counting only.
+ * @param   pArena          The arena to allocate the RangePair structures.
+ *
+ * @return                  The number of plateaus.
+ */
+ulong _PlateauScan(EntropyInfo *pEntropyInfo, ulong ulRawSize, double dThreshold, ulong ulMinRun,
+                   RangePair **arrRangePair, Arena *pArena) {
+    ulong   i, j, ulNumBlks, ulNumRuns, ulRunBgn, ulRunEnd;
+    double  dSum, dSumLimit;
+    double  *arrEntropy;
+
+    ulNumRuns = 0;
+    ulNumBlks = pEntropyInfo->ulNumBlks;
+    arrEntropy = pEntropyInfo->arrEntropy;
+    if (ulNumBlks < ulMinRun)
+        return 0;
+
+    /* Compare the window sum instead of the average to avoid the division. */
+    dSumLimit = dThreshold * ulMinRun;
+    dSum = 0;
+
+    ulRunBgn = ulRunEnd = 0;
+    for (i = 0 ; i + ulMinRun <= ulNumBlks ; i++) {
+        /* Sum every disjoint window from scratch, so the rounding error of the sliding
+           updates is bounded by the run length instead of growing with the section.
+           Each block is still added at most twice. */
+        if ((i % ulMinRun) == 0) {
+            dSum = 0;
+            for (j = i ; j < i + ulMinRun ; j++)
+                dSum += arrEntropy[j];
+        } else
+            dSum += arrEntropy[i + ulMinRun - 1] - arrEntropy[i - 1];
+
+        if (dSum < dSumLimit)
+            continue;
+
+        /* Extend the current plateau or flush it and start a new one. */
+        if ((ulRunEnd > ulRunBgn) && (i <= ulRunEnd))
+            ulRunEnd = i + ulMinRun;
+        else {
+            if (ulRunEnd > ulRunBgn) {
+                if (arrRangePair != NULL) {
+                    arrRangePair[ulNumRuns] = (RangePair*)Amalloc(pArena, sizeof(RangePair));
+                    arrRangePair[ulNumRuns]->ulIdxBgn = ulRunBgn;
+                    arrRangePair[ulNumRuns]->ulIdxEnd = ulRunEnd;
+                    _PlateauRefineRun(pEntropyInfo, ulRawSize, arrRangePair[ulNumRuns]);
+                }
+                ulNumRuns++;
+            }
+            ulRunBgn = i;
+            ulRunEnd = i + ulMinRun;
+        }
+    }
+
+    if (ulRunEnd > ulRunBgn) {
+        if (arrRangePair != NULL) {
+            arrRangePair[ulNumRuns] = (RangePair*)Amalloc(pArena, sizeof(RangePair));
+            arrRangePair[ulNumRuns]->ulIdxBgn = ulRunBgn;
+            arrRangePair[ulNumRuns]->ulIdxEnd = ulRunEnd;
+            _PlateauRefineRun(pEntropyInfo, ulRawSize, arrRangePair[ulNumRuns]);
+        }
+        ulNumRuns++;
+    }
+
+    return ulNumRuns;
+}
+
+
 /*===========================================================================*
  *                Implementation for exported functions                      *
  *===========================================================================*/
@@ -17,6 +212,7 @@
  *
  * @param   pRegionCollector    The pointer to the RegionCollector structure.
  *                              The plugin should put the data into this structure.
+ *                              The data should be allocated from its arena with Amalloc().
  * @param   pPEInfo             The pointer to the PEInfo structure.
  *                              The plugin can refer to this structure to determine
  *                              the binary regions for n-gram generation.
@@ -24,7 +220,95 @@
  * @return                      0: The binary regions are collected successfully.
  *                            < 0: Exception occurs while memory allocation.
  */
-int run(RegionCollector *pRegionCollector, PEInfo *pPEInfo) {
-	return 0;
-}
+int region_run(RegionCollector *pRegionCollector, PEInfo *pPEInfo) {
+    int         rc, i;
+    ushort      usNumSections, usNumRegions, usIdxSection;
+    ulong       ulMinRun, ulNumRuns;
+    double      dThreshold, dMax;
+    SectionInfo *pSection;
+    Region      *pRegion;
+    Arena       *pArena;
+
+    pArena = pRegionCollector->pArena;
+    usNumSections = pPEInfo->pPEHeader->usNumSections;
+    dThreshold = PLATEAU_DEFAULT_THRESHOLD;
+    ulMinRun = PLATEAU_DEFAULT_RUN;
+    _PlateauParseArg(pRegionCollector->cszPlugArg, &dThreshold, &ulMinRun);
+
+    /* Count the sections containing plateaus. The block entropy of the estimated
+       sections is measured first, before the try block below opens, because the
+       measurement runs its own try block which does not restore the handler. */
+    usNumRegions = 0;
+    for (i = 0 ; i < usNumSections ; i++) {
+        pSection = pPEInfo->arrSectionInfo[i];
+        if ((pSection == NULL) || (pSection->ulRawSize == 0))
+            continue;
+        rc = pPEInfo->measureSection(pPEInfo, i);
+        if (rc != 0)
+            return rc;
+        if (_PlateauScan(pSection->pEntropyInfo, pSection->ulRawSize, dThreshold, ulMinRun, NULL, NULL) > 0)
+            usNumRegions++;
+    }
+
+    rc = 0;
+    try {
+        pRegionCollector->usNumRegions = 0;
+        pRegionCollector->arrRegion = NULL;
+
+        /* Fall back to the entire section with maximum average entropy. */
+        if (usNumRegions == 0) {
+            dMax = -1;
+            usIdxSection = usNumSections;
+            for (i = 0 ; i < usNumSections ; i++) {
+                pSection = pPEInfo->arrSectionInfo[i];
+                if ((pSection != NULL) && (pSection->ulRawSize != 0)) {
+                    if (dMax < pSection->pEntropyInfo->dAvgEntropy) {
+                        dMax = pSection->pEntropyInfo->dAvgEntropy;
+                        usIdxSection = i;
+                    }
+                }
+            }
+            if (usIdxSection == usNumSections)
+                goto EXIT;
 
+            pRegionCollector->arrRegion = (Region**)Amalloc(pArena, sizeof(Region*));
+            pRegion = (Region*)Amalloc(pArena, sizeof(Region));
+            pRegionCollector->arrRegion[0] = pRegion;
+            pRegionCollector->usNumRegions = 1;
+
+            pRegion->usIdxSection = usIdxSection;
+            pRegion->ulNumPairs = 1;
+            pRegion->arrRangePair = (RangePair**)Amalloc(pArena, sizeof(RangePair*));
+            pRegion->arrRangePair[0] = (RangePair*)Amalloc(pArena, sizeof(RangePair));
+            pRegion->arrRangePair[0]->ulIdxBgn = 0;
+            pRegion->arrRangePair[0]->ulIdxEnd = pPEInfo->arrSectionInfo[usIdxSection]->pEntropyInfo->ulNumBlks;
+            pRegion->arrRangePair[0]->ulOstBgn = 0;
+            pRegion->arrRangePair[0]->ulOstEnd = 0;
+            goto EXIT;
+        }
+
+        /* Record the plateaus of each section as a region. */
+        pRegionCollector->arrRegion = (Region**)Acalloc(pArena, usNumRegions, sizeof(Region*));
+        for (i = 0 ; i < usNumSections ; i++) {
+            pSection = pPEInfo->arrSectionInfo[i];
+            if ((pSection == NULL) || (pSection->ulRawSize == 0))
+                continue;
+            ulNumRuns = _PlateauScan(pSection->pEntropyInfo, pSection->ulRawSize, dThreshold, ulMinRun, NULL, NULL);
+            if (ulNumRuns == 0)
+                continue;
+
+            pRegion = (Region*)Amalloc(pArena, sizeof(Region));
+            pRegion->usIdxSection = i;
+            pRegion->ulNumPairs = ulNumRuns;
+            pRegion->arrRangePair = (RangePair**)Acalloc(pArena, ulNumRuns, sizeof(RangePair*));
+            _PlateauScan(pSection->pEntropyInfo, pSection->ulRawSize, dThreshold, ulMinRun, pRegion->arrRangePair, pArena);
+
+            pRegionCollector->arrRegion[pRegionCollector->usNumRegions++] = pRegion;
+        }
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } end_try;
+
+EXIT:
+    return rc;
+}
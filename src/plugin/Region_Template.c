@@ -15,9 +15,15 @@
  *
  * @param   pRegionCollector    The pointer to the RegionCollector structure.
  *                              The plugin should put the data into this structure.
+ *                              The data should be allocated from its arena with Amalloc().
+ *                              The ulOstEnd of a RangePair must be zero unless the range
+ *                              is given by the byte offsets.
  * @param   pPEInfo             The pointer to the PEInfo structure.
  *                              The plugin can refer to this structure to determine
- *                              the binary regions for n-gram generation.
+ *                              the binary regions for n-gram generation. The entropy
+ *                              pyramid of each section can be scanned coarse-to-fine.
+ *                              Call measureSection() before referring to the entropy
+ *                              arrays, since the section may be only estimated.
  *
  * @return                      0: The binary regions are collected successfully.
  *                            < 0: Exception occurs while memory allocation.
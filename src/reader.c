@@ -0,0 +1,315 @@
+#include "reader.h"
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function fills a buffer with the specified range of the sample.
+ *
+ * @param   self            The pointer to the Reader structure.
+ * @param   idxBuf          The index of the buffer.
+ * @param   ulOstBgn        The starting file offset.
+ * @param   nLength         The number of bytes to read.
+ *
+ * @return                  The number of bytes read, or -1 if the read fails.
+ */
+ssize_t _ReaderFill(Reader *self, int idxBuf, ulong ulOstBgn, size_t nLength);
+
+
+/**
+ * This function requests the next chunk of the current range into the idle buffer.
+ *
+ * @param   self            The pointer to the Reader structure.
+ */
+void _ReaderRequest(Reader *self);
+
+
+/**
+ * This function waits until the pending request is served.
+ *
+ * @param   self            The pointer to the Reader structure.
+ */
+void _ReaderWait(Reader *self);
+
+
+/**
+ * This function is the body of the helper thread. It serves one request at a time.
+ *
+ * @param   vpReader        The pointer to the Reader structure.
+ *
+ * @return                  Always NULL.
+ */
+void* _ReaderPrefetch(void *vpReader);
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+void ReaderInit(Reader *self, Arena *pArena, FILE *fp, bool bPrefetch) {
+    int i;
+
+    self->fd = fileno(fp);
+    self->uszData = NULL;
+    self->ulSize = 0;
+    self->ulOstEnd = 0;
+    self->ulOstCur = 0;
+    self->ulOstFill = 0;
+    self->idxCur = 0;
+    self->idxFill = 0;
+    self->iErrno = 0;
+    self->bThread = false;
+    self->bPending = false;
+    self->bStop = false;
+    for (i = 0 ; i < READER_NUM_BUFFERS ; i++) {
+        self->arrBuf[i] = NULL;
+        self->arrLen[i] = 0;
+    }
+
+    #if defined(__linux__)
+        posix_fadvise(self->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    #endif
+
+    /* Only the synchronous mode is needed without prefetching. */
+    self->arrBuf[0] = (uchar*)Amalloc(pArena, READER_CHUNK_SIZE);
+    if (bPrefetch == false)
+        return;
+    for (i = 1 ; i < READER_NUM_BUFFERS ; i++)
+        self->arrBuf[i] = (uchar*)Amalloc(pArena, READER_CHUNK_SIZE);
+
+    pthread_mutex_init(&(self->mutex), NULL);
+    pthread_cond_init(&(self->cond), NULL);
+    if (pthread_create(&(self->thread), NULL, _ReaderPrefetch, self) != 0) {
+        Log1("The prefetching thread cannot be created (%s).\n", strerror(errno));
+        pthread_cond_destroy(&(self->cond));
+        pthread_mutex_destroy(&(self->mutex));
+        return;
+    }
+    self->bThread = true;
+
+    return;
+}
+
+void ReaderInitBuffer(Reader *self, uchar *uszData, ulong ulSize) {
+    int i;
+
+    self->fd = -1;
+    self->uszData = uszData;
+    self->ulSize = ulSize;
+    self->ulOstEnd = 0;
+    self->ulOstCur = 0;
+    self->ulOstFill = 0;
+    self->idxCur = 0;
+    self->idxFill = 0;
+    self->iErrno = 0;
+    self->bThread = false;
+    self->bPending = false;
+    self->bStop = false;
+    for (i = 0 ; i < READER_NUM_BUFFERS ; i++) {
+        self->arrBuf[i] = NULL;
+        self->arrLen[i] = 0;
+    }
+
+    return;
+}
+
+void ReaderDeinit(Reader *self) {
+
+    if (self->bThread == false)
+        return;
+
+    pthread_mutex_lock(&(self->mutex));
+    self->bStop = true;
+    pthread_cond_broadcast(&(self->cond));
+    pthread_mutex_unlock(&(self->mutex));
+
+    pthread_join(self->thread, NULL);
+    pthread_cond_destroy(&(self->cond));
+    pthread_mutex_destroy(&(self->mutex));
+    self->bThread = false;
+
+    return;
+}
+
+void ReaderAdvise(Reader *self, ulong ulOstBgn, ulong ulOstEnd) {
+
+    #if defined(__linux__)
+        if ((self->fd >= 0) && (ulOstEnd > ulOstBgn))
+            posix_fadvise(self->fd, ulOstBgn, ulOstEnd - ulOstBgn, POSIX_FADV_WILLNEED);
+    #endif
+
+    return;
+}
+
+void ReaderOpenRange(Reader *self, ulong ulOstBgn, ulong ulOstEnd) {
+
+    if (self->bThread)
+        _ReaderWait(self);
+
+    self->ulOstCur = ulOstBgn;
+    self->ulOstFill = ulOstBgn;
+    self->ulOstEnd = ulOstEnd;
+    ReaderAdvise(self, ulOstBgn, ulOstEnd);
+
+    /* Start filling the first chunk immediately. */
+    if (self->bThread) {
+        self->idxFill = self->idxCur;
+        _ReaderRequest(self);
+    }
+
+    return;
+}
+
+size_t ReaderNext(Reader *self, uchar **ppBuf, const char *cszPathSrc, const int iLineNo, const char *cszFunc) {
+    int     idxBuf;
+    size_t  nLength;
+    ssize_t nRead;
+
+    if (self->ulOstCur >= self->ulOstEnd)
+        return 0;
+
+    nLength = self->ulOstEnd - self->ulOstCur;
+    if (nLength > READER_CHUNK_SIZE)
+        nLength = READER_CHUNK_SIZE;
+
+    /* Emulate the short read at the end of the loaded sample. */
+    if (self->uszData != NULL) {
+        nRead = (self->ulOstCur < self->ulSize)? (self->ulSize - self->ulOstCur) : 0;
+        if (nRead > (ssize_t)nLength)
+            nRead = nLength;
+        *ppBuf = self->uszData + self->ulOstCur;
+        self->ulOstCur += nLength;
+        return nRead;
+    }
+
+    idxBuf = self->idxCur;
+    if (self->bThread) {
+        _ReaderWait(self);
+        nRead = self->arrLen[idxBuf];
+
+        /* Let the helper fill the idle buffer while the caller consumes this one. After
+           a short read nothing is requested, so mark the idle buffer as the end of file
+           instead of letting the next call return its stale content. */
+        self->idxCur = (idxBuf + 1) % READER_NUM_BUFFERS;
+        self->idxFill = self->idxCur;
+        if (nRead == (ssize_t)nLength)
+            _ReaderRequest(self);
+        else
+            self->arrLen[self->idxCur] = 0;
+    } else
+        nRead = _ReaderFill(self, idxBuf, self->ulOstCur, nLength);
+
+    if (nRead < 0) {
+        errno = self->iErrno;
+        throw(EXCEPT_IO_FILE_READ);
+    }
+
+    self->ulOstCur += nLength;
+    *ppBuf = self->arrBuf[idxBuf];
+    return nRead;
+}
+
+ssize_t ReaderReadAt(Reader *self, ulong ulOstBgn, size_t nLength, uchar *uszBuf, uchar **ppBuf) {
+    ssize_t nRead, nTotal;
+
+    if (self->uszData != NULL) {
+        nTotal = (ulOstBgn < self->ulSize)? (self->ulSize - ulOstBgn) : 0;
+        if (nTotal > (ssize_t)nLength)
+            nTotal = nLength;
+        *ppBuf = self->uszData + ulOstBgn;
+        return nTotal;
+    }
+
+    nTotal = 0;
+    while (nTotal < (ssize_t)nLength) {
+        nRead = pread(self->fd, uszBuf + nTotal, nLength - nTotal, ulOstBgn + nTotal);
+        StatsCount(STATS_COUNTER_READ_CALLS, 1);
+        if (nRead < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (nRead == 0)
+            break;
+        nTotal += nRead;
+    }
+    StatsCount(STATS_COUNTER_BYTES_READ, nTotal);
+
+    *ppBuf = uszBuf;
+    return nTotal;
+}
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+ssize_t _ReaderFill(Reader *self, int idxBuf, ulong ulOstBgn, size_t nLength) {
+    ssize_t nRead;
+    uchar   *uszBuf;
+
+    nRead = ReaderReadAt(self, ulOstBgn, nLength, self->arrBuf[idxBuf], &uszBuf);
+    if (nRead < 0)
+        self->iErrno = errno;
+
+    return nRead;
+}
+
+void _ReaderRequest(Reader *self) {
+
+    if (self->ulOstFill >= self->ulOstEnd)
+        return;
+
+    pthread_mutex_lock(&(self->mutex));
+    self->bPending = true;
+    pthread_cond_broadcast(&(self->cond));
+    pthread_mutex_unlock(&(self->mutex));
+
+    return;
+}
+
+void _ReaderWait(Reader *self) {
+
+    pthread_mutex_lock(&(self->mutex));
+    while (self->bPending)
+        pthread_cond_wait(&(self->cond), &(self->mutex));
+    pthread_mutex_unlock(&(self->mutex));
+
+    return;
+}
+
+void* _ReaderPrefetch(void *vpReader) {
+    int     idxBuf;
+    ulong   ulOstBgn;
+    size_t  nLength;
+    ssize_t nRead;
+    Reader  *self;
+
+    self = (Reader*)vpReader;
+    pthread_mutex_lock(&(self->mutex));
+    while (true) {
+        while ((self->bPending == false) && (self->bStop == false))
+            pthread_cond_wait(&(self->cond), &(self->mutex));
+        if (self->bStop)
+            break;
+
+        idxBuf = self->idxFill;
+        ulOstBgn = self->ulOstFill;
+        nLength = self->ulOstEnd - ulOstBgn;
+        if (nLength > READER_CHUNK_SIZE)
+            nLength = READER_CHUNK_SIZE;
+        pthread_mutex_unlock(&(self->mutex));
+
+        TraceBegin("prefetch");
+        nRead = _ReaderFill(self, idxBuf, ulOstBgn, nLength);
+        TraceEnd("prefetch");
+
+        pthread_mutex_lock(&(self->mutex));
+        self->arrLen[idxBuf] = nRead;
+        self->ulOstFill = ulOstBgn + nLength;
+        self->bPending = false;
+        pthread_cond_broadcast(&(self->cond));
+    }
+    pthread_mutex_unlock(&(self->mutex));
+
+    return NULL;
+}
@@ -1,13 +1,32 @@
 #include "region.h"
 
 
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+/**
+ * This function compares two spans by their starting and ending offsets.
+ *
+ * @param   vpSrc       The pointer to the source span.
+ * @param   vpTge       The pointer to the target span.
+ *
+ * @return              The comparison result for qsort().
+ */
+int _RCCompareSpan(const void *vpSrc, const void *vpTge);
+
+
 /*===========================================================================*
  *                Implementation for exported functions                      *
  *===========================================================================*/
 void RCInit(RegionCollector *self) {
     /* Initialize member variables. */
+    self->pArena = NULL;
+    self->cszPlugArg = NULL;
     self->usNumRegions = 0;
     self->arrRegion = NULL;
+    self->bSpanRanges = false;
+    self->ulNumSpans = 0;
+    self->arrSpan = NULL;
     self->hdlePlug = NULL;
     self->entryPlug = NULL;
 
@@ -15,35 +34,20 @@ void RCInit(RegionCollector *self) {
     self->loadPlugin = RCLoadPlugin;
     self->unloadPlugin = RCUnloadPlugin;
     self->selectFeatures = RCSelectFeatures;
+    self->selectSections = RCSelectSections;
+    self->normalizeRanges = RCNormalizeRanges;
 
     return;
 }
 
 
 void RCDeinit(RegionCollector *self) {
-    int     i, j;
-    Region  *pRegion;
-
-    if (self->arrRegion != NULL) {
-        for (i = 0 ; i < self->usNumRegions ; i++) {
 
-            /* Free the Range structure. */
-            pRegion = self->arrRegion[i];
-            if (pRegion != NULL) {
-
-                /* Free the array of RangePair structures. */
-                if (pRegion->arrRangePair != NULL) {
-                    for (j = 0 ; j < pRegion->ulNumPairs ; j++) {
-                        if (pRegion->arrRangePair[j] != NULL)
-                            Free(pRegion->arrRangePair[j]);
-                    }
-                    Free(pRegion->arrRangePair);
-                }
-                Free(pRegion);
-            }
-        }
-        Free(self->arrRegion);
-    }
+    /* The Region, RangePair and Span structures are released with the arena. */
+    self->usNumRegions = 0;
+    self->arrRegion = NULL;
+    self->ulNumSpans = 0;
+    self->arrSpan = NULL;
 
     return;
 }
@@ -80,3 +84,141 @@ int RCUnloadPlugin(RegionCollector *self) {
 int RCSelectFeatures(RegionCollector *self, PEInfo *pPEInfo) {
     return self->entryPlug(self, pPEInfo);
 }
+
+int RCSelectSections(RegionCollector *self, PEInfo *pPEInfo) {
+    int         rc, i;
+    ushort      usNumSections;
+    SectionInfo *pSection;
+    Region      *pRegion;
+
+    rc = 0;
+    try {
+        self->usNumRegions = 0;
+        self->arrRegion = NULL;
+        usNumSections = pPEInfo->pPEHeader->usNumSections;
+        if (usNumSections == 0)
+            goto EXIT;
+        self->arrRegion = (Region**)Amalloc(self->pArena, sizeof(Region*) * usNumSections);
+
+        for (i = 0 ; i < usNumSections ; i++) {
+            pSection = pPEInfo->arrSectionInfo[i];
+            if ((pSection == NULL) || (pSection->ulRawSize == 0))
+                continue;
+
+            pRegion = (Region*)Amalloc(self->pArena, sizeof(Region));
+            pRegion->usIdxSection = i;
+            pRegion->ulNumPairs = 1;
+            pRegion->arrRangePair = (RangePair**)Amalloc(self->pArena, sizeof(RangePair*));
+            pRegion->arrRangePair[0] = (RangePair*)Amalloc(self->pArena, sizeof(RangePair));
+            pRegion->arrRangePair[0]->ulIdxBgn = 0;
+            pRegion->arrRangePair[0]->ulIdxEnd = pSection->pEntropyInfo->ulNumBlks;
+            pRegion->arrRangePair[0]->ulOstBgn = 0;
+            pRegion->arrRangePair[0]->ulOstEnd = 0;
+            self->arrRegion[self->usNumRegions++] = pRegion;
+        }
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } end_try;
+
+EXIT:
+    return rc;
+}
+
+int RCNormalizeRanges(RegionCollector *self, PEInfo *pPEInfo) {
+    int         rc, i, j;
+    ulong       ulNumRanges, ulNumSpans, ulSecRawEnd, ulOstBgn, ulOstEnd;
+    ulong       *arrBound;
+    Region      *pRegion;
+    RangePair   *pPair;
+    SectionInfo *pSection;
+    Span        *arrRange, *pSpan;
+
+    rc = 0;
+    try {
+        self->ulNumSpans = 0;
+        self->arrSpan = NULL;
+
+        ulNumRanges = 0;
+        for (i = 0 ; i < self->usNumRegions ; i++)
+            ulNumRanges += self->arrRegion[i]->ulNumPairs;
+        if (ulNumRanges == 0)
+            goto EXIT;
+
+        /* Transform the block indices or the byte offsets to the file offsets within the
+           section raw data. */
+        arrRange = (Span*)Acalloc(self->pArena, ulNumRanges, sizeof(Span));
+        ulNumRanges = 0;
+        for (i = 0 ; i < self->usNumRegions ; i++) {
+            pRegion = self->arrRegion[i];
+            pSection = pPEInfo->arrSectionInfo[pRegion->usIdxSection];
+            ulSecRawEnd = pSection->ulRawOffset + pSection->ulRawSize;
+            for (j = 0 ; j < pRegion->ulNumPairs ; j++) {
+                pPair = pRegion->arrRangePair[j];
+                if (pPair->ulOstEnd != 0) {
+                    ulOstBgn = pSection->ulRawOffset + pPair->ulOstBgn;
+                    ulOstEnd = pSection->ulRawOffset + pPair->ulOstEnd;
+                } else {
+                    ulOstBgn = pSection->ulRawOffset + pPair->ulIdxBgn * ENTROPY_BLK_SIZE;
+                    ulOstEnd = pSection->ulRawOffset + pPair->ulIdxEnd * ENTROPY_BLK_SIZE;
+                }
+                if (ulOstEnd > ulSecRawEnd)
+                    ulOstEnd = ulSecRawEnd;
+                if (ulOstBgn >= ulOstEnd)
+                    continue;
+                arrRange[ulNumRanges].ulOstBgn = ulOstBgn;
+                arrRange[ulNumRanges].ulOstEnd = ulOstEnd;
+                ulNumRanges++;
+            }
+        }
+        if (ulNumRanges == 0)
+            goto EXIT;
+        qsort(arrRange, ulNumRanges, sizeof(Span), _RCCompareSpan);
+
+        /* Merge the overlapping and adjacent ranges. Each span has at most
+           (ulNumRanges - 1) boundaries, so the boundary storage is shared. */
+        self->arrSpan = (Span*)Acalloc(self->pArena, ulNumRanges, sizeof(Span));
+        arrBound = (ulong*)Acalloc(self->pArena, ulNumRanges, sizeof(ulong));
+        ulNumSpans = 0;
+        pSpan = NULL;
+        for (i = 0 ; i < ulNumRanges ; i++) {
+            ulOstBgn = arrRange[i].ulOstBgn;
+            ulOstEnd = arrRange[i].ulOstEnd;
+            if ((pSpan != NULL) && (ulOstBgn <= pSpan->ulOstEnd)) {
+                if ((ulOstBgn == pSpan->ulOstEnd) && (self->bSpanRanges == false))
+                    pSpan->arrBound[pSpan->ulNumBounds++] = ulOstBgn;
+                if (ulOstEnd > pSpan->ulOstEnd)
+                    pSpan->ulOstEnd = ulOstEnd;
+                continue;
+            }
+
+            pSpan = &(self->arrSpan[ulNumSpans++]);
+            pSpan->ulOstBgn = ulOstBgn;
+            pSpan->ulOstEnd = ulOstEnd;
+            pSpan->ulNumBounds = 0;
+            pSpan->arrBound = arrBound + i;
+        }
+        self->ulNumSpans = ulNumSpans;
+    } catch(EXCEPT_MEM_ALLOC) {
+        rc = -1;
+    } end_try;
+
+EXIT:
+    return rc;
+}
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+int _RCCompareSpan(const void *vpSrc, const void *vpTge) {
+    const Span *pSrc, *pTge;
+
+    pSrc = (const Span*)vpSrc;
+    pTge = (const Span*)vpTge;
+    if (pSrc->ulOstBgn != pTge->ulOstBgn)
+        return (pSrc->ulOstBgn < pTge->ulOstBgn)? -1 : 1;
+    if (pSrc->ulOstEnd != pTge->ulOstEnd)
+        return (pSrc->ulOstEnd < pTge->ulOstEnd)? -1 : 1;
+
+    return 0;
+}
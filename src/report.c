@@ -8,6 +8,7 @@ void ReportInit(Report *self) {
     self->logEntropyDistribution = ReportLogEntropyDistribution;
     self->logNGramModel = ReportLogNGramModel;
     self->plotNGramModel = ReportPlotNGramModel;
+    self->logNGramWindows = ReportLogNGramWindows;
 
     return;
 }
@@ -184,7 +185,8 @@ int ReportLogNGramModel(Report *self, NGram *pNGram, const char *cszDirPath, con
     bool    bHasSep;
     int     rc, i, iLenPath, iLenBuf, iCountBatch;
     FILE    *fpReport;
-    Slice   **arrSlice;
+    ulong   *arrSliceValue, *arrSliceFrequency;
+    double  *arrSliceScore;
     char    buf[BUF_SIZE_LARGE + 1], szPathReport[BUF_SIZE_MID + 1];
 
     rc = 0;
@@ -216,23 +218,24 @@ int ReportLogNGramModel(Report *self, NGram *pNGram, const char *cszDirPath, con
         fpReport = Fopen(szPathReport, "w");
 
         /* Log each piece of n-gram model slice. */
-        arrSlice = pNGram->arrSlice;
+        arrSliceValue = pNGram->arrSliceValue;
+        arrSliceFrequency = pNGram->arrSliceFrequency;
+        arrSliceScore = pNGram->arrSliceScore;
 
         iLenBuf = iCountBatch = 0;
         memset(buf, 0, sizeof(char) * BUF_SIZE_LARGE);
         for (i = 0 ; i < pNGram->ulNumSlices ; i++) {
-            sprintf(buf + iLenBuf, "%d\t%.3lf\t#(0x%08lx:%lu)\t(0x%08lx:%lu)\n", i, arrSlice[i]->dScore,
-                    arrSlice[i]->pNumerator->ulValue,
-                    arrSlice[i]->pNumerator->ulFrequency,
-                    arrSlice[i]->pDenominator->ulValue,
-                    arrSlice[i]->pDenominator->ulFrequency);
+            sprintf(buf + iLenBuf, "%d\t%.3lf\t#(0x%08lx:%lu)\t(0x%08lx:%lu)\n", i, arrSliceScore[i],
+                    arrSliceValue[i], arrSliceFrequency[i],
+                    pNGram->tokDenominator.ulValue, pNGram->tokDenominator.ulFrequency);
             iLenBuf = strlen(buf);
             iCountBatch++;
 
-            if (arrSlice[i]->dScore < TRUNCATE_THRESHOLD)
+            if (arrSliceScore[i] < TRUNCATE_THRESHOLD)
                 break;
 
-            if (iCountBatch == BATCH_WRITE_LINE_COUNT) {
+            /* The lines of large frequencies may fill the buffer before the batch is full. */
+            if ((iCountBatch == BATCH_WRITE_LINE_COUNT) || ((BUF_SIZE_LARGE - iLenBuf) < BUF_SIZE_SMALL)) {
                 Fwrite(buf, sizeof(char), iLenBuf, fpReport);
                 iLenBuf = iCountBatch = 0;
                 memset(buf, 0, sizeof(char) * BUF_SIZE_LARGE);
@@ -396,4 +399,77 @@ int ReportPlotNGramModel(Report *self, NGram *pNGram, const char *cszDirPath, co
 
 EXIT:
     return rc;
-}
\ No newline at end of file
+}
+
+int ReportLogNGramWindows(Report *self, NGram *pNGram, const char *cszDirPath, const char *cszSampleName) {
+    bool            bHasSep;
+    int             rc, iLenPath, iLenBuf, iCountBatch;
+    ulong           i, j;
+    FILE            *fpReport;
+    NGramProfile    *pProfile;
+    char            buf[BUF_SIZE_LARGE + 1], szPathReport[BUF_SIZE_MID + 1];
+
+    rc = 0;
+    try {
+        /* Generate the report path string. */
+        bHasSep = false;
+        iLenPath = strlen(cszDirPath);
+        if (cszDirPath[iLenPath - 1] == OS_PATH_SEPARATOR) {
+            iLenPath++;
+            bHasSep = true;
+        }
+        iLenPath += strlen(cszSampleName);
+        iLenPath += strlen(REPORT_POSTFIX_TXT_NGRAM_WINDOWS);
+
+        if (iLenPath > BUF_SIZE_MID) {
+            Log1("The file path is too long (Maximum allowed length is %d bytes).\n", BUF_SIZE_MID);
+            rc = -1;
+            goto EXIT;
+        }
+
+        memset(szPathReport, 0, sizeof(char) * (BUF_SIZE_MID + 1));
+        if (bHasSep == true)
+            sprintf(szPathReport, "%s%s%s", cszDirPath, cszSampleName, REPORT_POSTFIX_TXT_NGRAM_WINDOWS);
+        else
+            sprintf(szPathReport, "%s%c%s%s", cszDirPath, OS_PATH_SEPARATOR, cszSampleName,
+                    REPORT_POSTFIX_TXT_NGRAM_WINDOWS);
+
+        /* Prepare the file pointer for the report. */
+        fpReport = Fopen(szPathReport, "w");
+
+        /* Log the file offsets, the token counts and the top tokens of each window. */
+        iLenBuf = iCountBatch = 0;
+        memset(buf, 0, sizeof(char) * BUF_SIZE_LARGE);
+        for (i = 0 ; i < pNGram->ulNumProfiles ; i++) {
+            pProfile = &(pNGram->arrProfile[i]);
+            iLenBuf += sprintf(buf + iLenBuf, "%lu\t0x%08lx\t0x%08lx\t%lu\t%lu", i, pProfile->ulOstBgn,
+                               pProfile->ulOstEnd, pProfile->ulNumTokens, pProfile->ulNumDistinct);
+            for (j = 0 ; j < pProfile->ulNumTop ; j++)
+                iLenBuf += sprintf(buf + iLenBuf, "%c#(0x%08lx:%lu)", (j == 0)? '\t' : ' ',
+                                   pProfile->arrTop[j].ulValue, pProfile->arrTop[j].ulFrequency);
+            iLenBuf += sprintf(buf + iLenBuf, "\n");
+            iCountBatch++;
+
+            if ((iCountBatch == BATCH_WRITE_LINE_COUNT) || ((BUF_SIZE_LARGE - iLenBuf) < BUF_SIZE_MID)) {
+                Fwrite(buf, sizeof(char), iLenBuf, fpReport);
+                iLenBuf = iCountBatch = 0;
+                memset(buf, 0, sizeof(char) * BUF_SIZE_LARGE);
+            }
+        }
+        Fwrite(buf, sizeof(char), iLenBuf, fpReport);
+
+        /* Release the file pointer. */
+        Fclose(fpReport);
+
+    } catch(EXCEPT_IO_DIR_MAKE) {
+        rc = -1;
+    } catch(EXCEPT_IO_FILE_OPEN) {
+        rc = -1;
+    } catch(EXCEPT_IO_FILE_WRITE) {
+        Fclose(fpReport);
+        rc = -1;
+    } end_try;
+
+EXIT:
+    return rc;
+}
@@ -0,0 +1,95 @@
+#include "stats.h"
+#include "perf.h"
+
+
+/* The global statistics shared by the engine and the plugins. */
+Stats _statsGlobal;
+
+
+/* The beginning of the running phases. Each thread times its own samples. */
+static __thread ulong _arrPhaseBgn[STATS_PHASE_COUNT];
+
+
+/* The names of the phases and the counters shown in the JSON dump. */
+const char *_arrStatsPhaseName[STATS_PHASE_COUNT] = {
+    "parse_headers",
+    "section_entropy",
+    "select_features",
+    "collect_tokens",
+    "generate_model",
+    "generate_report",
+};
+
+#if defined(ENABLE_STATS)
+
+static const char *_arrCounterName[STATS_COUNTER_COUNT] = {
+    "bytes_read",
+    "read_calls",
+    "seek_calls",
+    "tokens",
+    "distinct_tokens",
+    "allocs",
+    "skipped_bytes",
+    "dedup_bytes",
+    "cache_hits",
+    "cache_misses",
+};
+
+#endif
+
+
+ulong StatsNow() {
+    struct timespec tsNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &tsNow);
+    return (ulong)tsNow.tv_sec * 1000000000UL + (ulong)tsNow.tv_nsec;
+}
+
+void StatsBeginPhase(int idxPhase) {
+
+    if (_bPerfOn)
+        PerfBeginPhase();
+    _arrPhaseBgn[idxPhase] = StatsNow();
+    return;
+}
+
+void StatsEndPhase(int idxPhase) {
+
+    __atomic_fetch_add(&(_statsGlobal.arrPhaseNsec[idxPhase]), StatsNow() - _arrPhaseBgn[idxPhase], __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(_statsGlobal.arrPhaseCalls[idxPhase]), 1, __ATOMIC_RELAXED);
+    if (_bPerfOn)
+        PerfEndPhase(idxPhase);
+    return;
+}
+
+void StatsFinishSample() {
+
+    __atomic_fetch_add(&(_statsGlobal.ulNumSamples), 1, __ATOMIC_RELAXED);
+    return;
+}
+
+void StatsDump(FILE *fp) {
+
+    #if defined(ENABLE_STATS)
+        int i;
+
+        fprintf(fp, "{\"samples\": %lu, \"phases\": {", _statsGlobal.ulNumSamples);
+        for (i = 0 ; i < STATS_PHASE_COUNT ; i++) {
+            fprintf(fp, "%s\"%s\": {\"calls\": %lu, \"msec\": %.3lf}", (i == 0)? "" : ", ",
+                    _arrStatsPhaseName[i], _statsGlobal.arrPhaseCalls[i],
+                    (double)_statsGlobal.arrPhaseNsec[i] / 1000000.0);
+        }
+        fprintf(fp, "}, \"counters\": {");
+        for (i = 0 ; i < STATS_COUNTER_COUNT ; i++) {
+            fprintf(fp, "%s\"%s\": %lu", (i == 0)? "" : ", ",
+                    _arrCounterName[i], _statsGlobal.arrCounter[i]);
+        }
+        fprintf(fp, "}, \"memory\": ");
+        MemAccountDump(fp);
+        fprintf(fp, "}\n");
+    #else
+        fprintf(fp, "{\"samples\": 0, \"error\": \"built without ENABLE_STATS\"}\n");
+    #endif
+
+    return;
+}
@@ -0,0 +1,121 @@
+#include "trace.h"
+
+
+/* The switch to activate the recorder. */
+bool _bTraceOn = false;
+
+
+/*===========================================================================*
+ *                  Simulation for private variables                         *
+ *===========================================================================*/
+/* The list of registered ring buffers. New buffers are pushed lock-free. */
+TraceBuffer *_pTraceList = NULL;
+
+/* The ring buffer owned by the calling thread. */
+__thread TraceBuffer *_pTraceLocal = NULL;
+
+/* The thread id generator and the timestamp base. */
+ulong _ulTraceNextTid = 0;
+ulong _ulTraceBase = 0;
+
+
+/*===========================================================================*
+ *                Implementation for exported functions                      *
+ *===========================================================================*/
+void TraceStart() {
+
+    _ulTraceBase = StatsNow();
+    _bTraceOn = true;
+    return;
+}
+
+void TraceRecord(const char *cszName, char cType) {
+    TraceBuffer *pBuf;
+    TraceEvent  *pEvent;
+
+    pBuf = _pTraceLocal;
+    if (pBuf == NULL) {
+        /* The hook must not raise exceptions, so the plain allocator is used. */
+        pBuf = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+        if (pBuf == NULL)
+            return;
+        pBuf->arrEvent = (TraceEvent*)calloc(TRACE_RING_SIZE, sizeof(TraceEvent));
+        if (pBuf->arrEvent == NULL) {
+            free(pBuf);
+            return;
+        }
+        pBuf->ulTid = __atomic_fetch_add(&_ulTraceNextTid, 1, __ATOMIC_RELAXED) + 1;
+
+        /* Push the buffer to the global list. */
+        pBuf->pNext = __atomic_load_n(&_pTraceList, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&_pTraceList, &pBuf->pNext, pBuf, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        _pTraceLocal = pBuf;
+    }
+
+    /* The oldest events are overwritten when the ring is full. */
+    pEvent = &(pBuf->arrEvent[pBuf->ulNumEvents & (TRACE_RING_SIZE - 1)]);
+    pEvent->cszName = cszName;
+    pEvent->ulTimestamp = StatsNow();
+    pEvent->cType = cType;
+    pBuf->ulNumEvents++;
+
+    return;
+}
+
+int TraceDump(const char *cszPath) {
+    int         rc;
+    bool        bFirst;
+    ulong       i, ulBgn;
+    FILE        *fpTrace;
+    TraceBuffer *pBuf;
+    TraceEvent  *pEvent;
+
+    rc = 0;
+    fpTrace = fopen(cszPath, "w");
+    if (fpTrace == NULL) {
+        Log1("The trace file %s cannot be created.\n", cszPath);
+        return -1;
+    }
+
+    bFirst = true;
+    fprintf(fpTrace, "{\"traceEvents\": [\n");
+    pBuf = __atomic_load_n(&_pTraceList, __ATOMIC_ACQUIRE);
+    while (pBuf != NULL) {
+        fprintf(fpTrace, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu, "
+                         "\"args\": {\"name\": \"%s #%lu\"}}",
+                (bFirst)? "" : ",\n", pBuf->ulTid, (pBuf->ulTid == 1)? "main" : "worker", pBuf->ulTid);
+        bFirst = false;
+
+        ulBgn = (pBuf->ulNumEvents > TRACE_RING_SIZE)? (pBuf->ulNumEvents - TRACE_RING_SIZE) : 0;
+        for (i = ulBgn ; i < pBuf->ulNumEvents ; i++) {
+            pEvent = &(pBuf->arrEvent[i & (TRACE_RING_SIZE - 1)]);
+            fprintf(fpTrace, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3lf, \"pid\": 1, \"tid\": %lu}",
+                    pEvent->cszName, pEvent->cType,
+                    (double)(pEvent->ulTimestamp - _ulTraceBase) / 1000.0, pBuf->ulTid);
+        }
+        pBuf = pBuf->pNext;
+    }
+    fprintf(fpTrace, "\n]}\n");
+
+    if (fclose(fpTrace) != 0)
+        rc = -1;
+
+    return rc;
+}
+
+void TraceStop() {
+    TraceBuffer *pBuf, *pNext;
+
+    _bTraceOn = false;
+    pBuf = __atomic_exchange_n(&_pTraceList, NULL, __ATOMIC_ACQ_REL);
+    while (pBuf != NULL) {
+        pNext = pBuf->pNext;
+        free(pBuf->arrEvent);
+        free(pBuf);
+        pBuf = pNext;
+    }
+    _pTraceLocal = NULL;
+
+    return;
+}
@@ -1,5 +1,71 @@
 #include "util.h"
 #include "except.h"
+#include "stats.h"
+
+
+/*===========================================================================*
+ *                  Simulation for private variables                         *
+ *===========================================================================*/
+#if defined(ENABLE_MEM_ACCOUNT)
+    /* Structure to record the allocation history of a call site. The names are copied
+       since the plugins which own the original strings may be unloaded before exit. */
+    typedef struct _MemSite {
+        char        szPathSrc[BUF_SIZE_SMALL], szFunc[BUF_SIZE_SMALL];
+        int         iLineNo;
+        ulong       ulNumAllocs, ulNumFrees, ulLiveBytes, ulPeakBytes;
+    } MemSite;
+
+    /* Structure to prefix each accounted block. */
+    typedef struct _MemHeader {
+        size_t  nLength;
+        ulong   ulIdxSite;
+    } MemHeader;
+
+    #define MEM_HEADER_SIZE     (sizeof(MemHeader))
+
+    /* The name of the reserved last slot which collects the sites beyond the table. */
+    #define MEM_SITE_OTHER      "<other>"
+
+    /* The call site table and the global accumulators guarded by the mutex. */
+    MemSite         _arrMemSite[MEM_ACCOUNT_SITE_COUNT];
+    ulong           _ulMemNumSites = 0;
+    ulong           _ulMemLiveBytes = 0, _ulMemPeakBytes = 0, _ulMemNumAllocs = 0, _ulMemNumFrees = 0;
+    bool            _bMemAtExit = false;
+    pthread_mutex_t _mtxMem = PTHREAD_MUTEX_INITIALIZER;
+#else
+    #define MEM_HEADER_SIZE     (0)
+#endif
+
+
+/*===========================================================================*
+ *                  Definition for internal functions                        *
+ *===========================================================================*/
+#if defined(ENABLE_MEM_ACCOUNT)
+/**
+ * This function charges the newly allocated block to its call site.
+ *
+ * @param   pRaw            The pointer to the raw block including the header.
+ * @param   nLength         The requested size in bytes.
+ *
+ * @return                  The pointer to the payload.
+ */
+void* _MemAccountAttach(void *pRaw, size_t nLength, const char *cszPathSrc, const int iLineNo,
+                        const char *cszFunc);
+
+/**
+ * This function refunds the block to its call site.
+ *
+ * @param   ptr             The pointer to the payload.
+ *
+ * @return                  The pointer to the raw block including the header.
+ */
+void* _MemAccountDetach(void *ptr);
+
+/**
+ * This function prints the accounting summary at program exit.
+ */
+void _MemAccountAtExit();
+#endif
 
 
 void WriteLog(const char* cszPathSrc, int iLineNo, const char* cszFunc, const char* cszFormat, ...) {
@@ -7,8 +73,8 @@ void WriteLog(const char* cszPathSrc, int iLineNo, const char* cszFunc, const ch
     int       iLen;
     time_t    nTime;
     va_list   varArgument;
-    char      *szTime;
-    struct tm *tmTime;
+    char      szTime[BUF_SIZE_SMALL];
+    struct tm tmTime;
 
     memset(szLogBuf, 0, sizeof(char) * BUF_SIZE_MID);
     va_start(varArgument, cszFormat);
@@ -23,9 +89,10 @@ void WriteLog(const char* cszPathSrc, int iLineNo, const char* cszFunc, const ch
 	    szLogBuf[0] = 0;
     }
 
+    /* The reentrant versions let the carving workers log at the same time. */
     time(&nTime);
-    tmTime = localtime(&nTime);
-    szTime = asctime(tmTime);
+    localtime_r(&nTime, &tmTime);
+    asctime_r(&tmTime, szTime);
 
     printf("[%s, %d, %s] %s%s", cszPathSrc, iLineNo, cszFunc, szTime, szLogBuf);
 
@@ -36,9 +103,14 @@ void* MemAlloc(size_t nLength, const char *cszPathSrc, const int iLineNo, const
     void *ptr;
 
     assert(nLength > 0);
-	ptr = malloc(nLength);
+	ptr = malloc(MEM_HEADER_SIZE + nLength);
     if (ptr == NULL)
         throw(EXCEPT_MEM_ALLOC);
+    StatsCount(STATS_COUNTER_ALLOCS, 1);
+
+    #if defined(ENABLE_MEM_ACCOUNT)
+        ptr = _MemAccountAttach(ptr, nLength, cszPathSrc, iLineNo, cszFunc);
+    #endif
 
     return ptr;
 }
@@ -47,9 +119,21 @@ void* MemCalloc(size_t nLength, size_t nSize, const char *cszPathSrc, const int
     void *ptr;
 
     assert(nLength > 0);
-    ptr = calloc(nLength, nSize);
+    #if defined(ENABLE_MEM_ACCOUNT)
+        /* The header is added here, so the wrapped size must be rejected before calloc() sees it. */
+        if ((nSize != 0) && (nLength > (SIZE_MAX - MEM_HEADER_SIZE) / nSize))
+            throw(EXCEPT_MEM_ALLOC);
+        ptr = calloc(MEM_HEADER_SIZE + nLength * nSize, 1);
+    #else
+        ptr = calloc(nLength, nSize);
+    #endif
     if (ptr == NULL)
         throw(EXCEPT_MEM_ALLOC);
+    StatsCount(STATS_COUNTER_ALLOCS, 1);
+
+    #if defined(ENABLE_MEM_ACCOUNT)
+        ptr = _MemAccountAttach(ptr, nLength * nSize, cszPathSrc, iLineNo, cszFunc);
+    #endif
 
     return ptr;
 }
@@ -58,17 +142,59 @@ void* MemRealloc(void *pOld, size_t nLength, const char *cszPathSrc, const int i
     void *pNew;
 
     assert(nLength > 0);
-    pNew = realloc(pOld, nLength);
+    #if defined(ENABLE_MEM_ACCOUNT)
+        /* The old block stays charged until realloc() succeeds, since the caller
+           still owns and frees it if the exception is thrown. */
+        if (pOld != NULL)
+            pOld = (uchar*)pOld - MEM_HEADER_SIZE;
+    #endif
+    pNew = realloc(pOld, MEM_HEADER_SIZE + nLength);
     if (pNew == NULL)
         throw(EXCEPT_MEM_ALLOC);
+    StatsCount(STATS_COUNTER_ALLOCS, 1);
+
+    #if defined(ENABLE_MEM_ACCOUNT)
+        /* The header is carried over by realloc(), so the old charge is refunded through the new block. */
+        if (pOld != NULL)
+            pNew = _MemAccountDetach((uchar*)pNew + MEM_HEADER_SIZE);
+        pNew = _MemAccountAttach(pNew, nLength, cszPathSrc, iLineNo, cszFunc);
+    #endif
 
     return pNew;
 }
 
 void MemFree(void *ptr) {
 
-    if (ptr != NULL)
+    if (ptr != NULL) {
+        #if defined(ENABLE_MEM_ACCOUNT)
+            ptr = _MemAccountDetach(ptr);
+        #endif
         free(ptr);
+    }
+}
+
+void MemAccountDump(FILE *fp) {
+    #if defined(ENABLE_MEM_ACCOUNT)
+        ulong   i;
+        MemSite *pSite;
+
+        pthread_mutex_lock(&_mtxMem);
+        fprintf(fp, "{\"live_bytes\": %lu, \"peak_bytes\": %lu, \"allocs\": %lu, \"frees\": %lu, \"sites\": [",
+                _ulMemLiveBytes, _ulMemPeakBytes, _ulMemNumAllocs, _ulMemNumFrees);
+        for (i = 0 ; i < _ulMemNumSites ; i++) {
+            pSite = &(_arrMemSite[i]);
+            fprintf(fp, "%s{\"site\": \"%s:%d\", \"func\": \"%s\", \"allocs\": %lu, \"frees\": %lu, "
+                        "\"live_bytes\": %lu, \"peak_bytes\": %lu}",
+                    (i == 0)? "" : ", ", pSite->szPathSrc, pSite->iLineNo, pSite->szFunc,
+                    pSite->ulNumAllocs, pSite->ulNumFrees, pSite->ulLiveBytes, pSite->ulPeakBytes);
+        }
+        fprintf(fp, "]}");
+        pthread_mutex_unlock(&_mtxMem);
+    #else
+        fprintf(fp, "null");
+    #endif
+
+    return;
 }
 
 FILE* FileOpen(const char *cszPath, const char *cszMode, const char *cszPathSrc, const int iLineNo, const char* cszFunc) {
@@ -81,11 +207,23 @@ FILE* FileOpen(const char *cszPath, const char *cszMode, const char *cszPathSrc,
     return fptr;
 }
 
+FILE* FileMemOpen(void *ptr, size_t nSize, const char *cszMode, const char *cszPathSrc, const int iLineNo, const char* cszFunc) {
+    FILE *fptr;
+
+    fptr = fmemopen(ptr, nSize, cszMode);
+    if (fptr == NULL)
+        throw(EXCEPT_IO_FILE_OPEN);
+
+    return fptr;
+}
+
 size_t FileRead(void *ptr, size_t nSize, size_t nLength, FILE *fptr, const char *cszPathSrc, const int iLineNo, const char *cszFunc) {
     size_t  nRead;
     int     rc;
 
     nRead = fread(ptr, nSize, nLength, fptr);
+    StatsCount(STATS_COUNTER_READ_CALLS, 1);
+    StatsCount(STATS_COUNTER_BYTES_READ, nRead * nSize);
     if (nRead != (nSize * nLength)) {
         rc = ferror(fptr);
         if (rc != 0)
@@ -113,6 +251,7 @@ int FileSeek(FILE *fptr, long iOffset, int iOrigin, const char *cszPathSrc, cons
     int rc;
 
     rc = fseek(fptr, iOffset, iOrigin);
+    StatsCount(STATS_COUNTER_SEEK_CALLS, 1);
     if(rc != 0)
         throw(EXCEPT_IO_FILE_SEEK);
 
@@ -241,3 +380,98 @@ void* DLFree(void *hdle, const char *cszPathSrc, const int iLineNo, const char *
 }
 
 #endif
+
+
+/*===========================================================================*
+ *                Implementation for internal functions                      *
+ *===========================================================================*/
+#if defined(ENABLE_MEM_ACCOUNT)
+void* _MemAccountAttach(void *pRaw, size_t nLength, const char *cszPathSrc, const int iLineNo,
+                        const char *cszFunc) {
+    ulong       i;
+    MemSite     *pSite;
+    MemHeader   *pHeader;
+
+    pthread_mutex_lock(&_mtxMem);
+    if (_bMemAtExit == false) {
+        atexit(_MemAccountAtExit);
+        _bMemAtExit = true;
+    }
+
+    /* Look up the call site. The last slot is reserved to collect the overflowed sites. */
+    for (i = 0 ; i < _ulMemNumSites ; i++) {
+        pSite = &(_arrMemSite[i]);
+        if ((pSite->iLineNo == iLineNo) && (strncmp(pSite->szPathSrc, cszPathSrc, BUF_SIZE_SMALL - 1) == 0))
+            break;
+    }
+    if (i == _ulMemNumSites) {
+        if (_ulMemNumSites < MEM_ACCOUNT_SITE_COUNT - 1) {
+            _ulMemNumSites++;
+            pSite = &(_arrMemSite[i]);
+            strncpy(pSite->szPathSrc, cszPathSrc, BUF_SIZE_SMALL - 1);
+            strncpy(pSite->szFunc, cszFunc, BUF_SIZE_SMALL - 1);
+            pSite->iLineNo = iLineNo;
+        } else {
+            i = MEM_ACCOUNT_SITE_COUNT - 1;
+            if (_ulMemNumSites < MEM_ACCOUNT_SITE_COUNT) {
+                _ulMemNumSites++;
+                pSite = &(_arrMemSite[i]);
+                strncpy(pSite->szPathSrc, MEM_SITE_OTHER, BUF_SIZE_SMALL - 1);
+                strncpy(pSite->szFunc, MEM_SITE_OTHER, BUF_SIZE_SMALL - 1);
+                pSite->iLineNo = 0;
+            }
+        }
+    }
+
+    pSite = &(_arrMemSite[i]);
+    pSite->ulNumAllocs++;
+    pSite->ulLiveBytes += nLength;
+    if (pSite->ulLiveBytes > pSite->ulPeakBytes)
+        pSite->ulPeakBytes = pSite->ulLiveBytes;
+
+    _ulMemNumAllocs++;
+    _ulMemLiveBytes += nLength;
+    if (_ulMemLiveBytes > _ulMemPeakBytes)
+        _ulMemPeakBytes = _ulMemLiveBytes;
+    pthread_mutex_unlock(&_mtxMem);
+
+    pHeader = (MemHeader*)pRaw;
+    pHeader->nLength = nLength;
+    pHeader->ulIdxSite = i;
+
+    return (uchar*)pRaw + MEM_HEADER_SIZE;
+}
+
+void* _MemAccountDetach(void *ptr) {
+    MemSite     *pSite;
+    MemHeader   *pHeader;
+
+    pHeader = (MemHeader*)((uchar*)ptr - MEM_HEADER_SIZE);
+
+    pthread_mutex_lock(&_mtxMem);
+    pSite = &(_arrMemSite[pHeader->ulIdxSite]);
+    pSite->ulNumFrees++;
+    pSite->ulLiveBytes -= pHeader->nLength;
+    _ulMemNumFrees++;
+    _ulMemLiveBytes -= pHeader->nLength;
+    pthread_mutex_unlock(&_mtxMem);
+
+    return pHeader;
+}
+
+void _MemAccountAtExit() {
+    ulong   i;
+    MemSite *pSite;
+
+    fprintf(stderr, "[Memory] Peak: %lu bytes, Live at exit: %lu bytes, Allocs: %lu, Frees: %lu\n",
+            _ulMemPeakBytes, _ulMemLiveBytes, _ulMemNumAllocs, _ulMemNumFrees);
+    for (i = 0 ; i < _ulMemNumSites ; i++) {
+        pSite = &(_arrMemSite[i]);
+        fprintf(stderr, "[Memory] %s:%d (%s) Allocs: %lu, Peak: %lu bytes, Live: %lu bytes%s\n",
+                pSite->szPathSrc, pSite->iLineNo, pSite->szFunc, pSite->ulNumAllocs,
+                pSite->ulPeakBytes, pSite->ulLiveBytes, (pSite->ulLiveBytes != 0)? " (Leaked)" : "");
+    }
+
+    return;
+}
+#endif
@@ -5,6 +5,9 @@ import tarfile;
 import sys;
 import shutil;
 import subprocess;
+import json;
+import tempfile;
+import filecmp;
 
 
 #-------- Constants for coverage testing --------
@@ -21,6 +24,236 @@ VALGRIND_ON_LEAK_CHECK = "--leak-check=yes";
 VALGRIND_ON_TRACK_ORIGINS = "--track-origins=yes";
 
 
+#-------- Constants for regression testing --------
+KEY_STATS       = "-s"
+KEY_DEDUP_BLOCKS = "-u"
+KEY_LAZY_ENTROPY = "-z"
+KEY_CACHE        = "-k"
+KEY_WINDOW       = "-w"
+KEY_STEP         = "-j"
+
+VALUE_CHECK_REPORT_TYPE = "et";
+VALUE_WINDOW_SIZE = "4096";
+VALUE_WINDOW_STEP = "1024";
+
+# The number of top tokens summarized for each window.
+NUM_PROFILE_TOP = 8;
+
+# The text reports are compared, since the plot script embeds the output path.
+SUFFIX_TEXT_REPORT = ".txt";
+SUFFIX_ENTROPY_REPORT = "_entropy.txt";
+SUFFIX_WINDOWS_REPORT = "_ngram_windows.txt";
+
+# The bit shifts between two tokens sliding by a byte.
+SHIFT_RANGE_8BIT = 8;
+
+
+def run_engine(path_exec, path_input, path_output, list_option):
+
+    if not os.path.exists(path_output):
+        os.makedirs(path_output);
+
+    command = list();
+    command.append(path_exec);
+    command.append(KEY_PATH_INPUT);
+    command.append(path_input);
+    command.append(KEY_PATH_OUTPUT);
+    command.append(path_output);
+    command.append(KEY_DIMENSION);
+    command.append(VALUE_DIMENSION);
+    command.append(KEY_REPORT_TYPE);
+    command.append(VALUE_CHECK_REPORT_TYPE);
+    command.extend(list_option);
+
+    proc = subprocess.Popen(command, stdout = subprocess.PIPE, shell = False);
+    result = proc.communicate()[0];
+    return proc.returncode, result;
+
+
+def list_sections(path_report):
+
+    # Collect the raw range and the average entropy of each section from the
+    # entropy report.
+    list_section = list();
+    for line in open(path_report).read().splitlines():
+        if ":" not in line:
+            continue;
+        key, value = line.split(":", 1);
+        key = " ".join(key.split());
+        if key == "Raw Offset":
+            offset_raw = int(value, 16);
+        elif key == "Raw Size":
+            size_raw = int(value, 16);
+        elif key == "Avg Entropy":
+            list_section.append((float(value), offset_raw, size_raw));
+
+    return list_section;
+
+
+def count_tokens(data, offset_bgn, offset_end, dimension):
+
+    # Count the tokens starting at each bit of the range, dropping the all-zero
+    # and the all-one tokens like the engine does.
+    mask = (1 << (SHIFT_RANGE_8BIT * dimension)) - 1;
+    histogram = dict();
+    for offset in range(offset_bgn, offset_end - dimension + 1):
+        value = 0;
+        for byte in data[offset : offset + dimension]:
+            value = (value << SHIFT_RANGE_8BIT) | byte;
+        list_token = [value];
+        if offset + dimension < offset_end:
+            value = (value << SHIFT_RANGE_8BIT) | data[offset + dimension];
+            for shift in range(1, SHIFT_RANGE_8BIT):
+                list_token.append((value >> (SHIFT_RANGE_8BIT - shift)) & mask);
+        for token in list_token:
+            histogram[token] = histogram.get(token, 0) + 1;
+
+    histogram.pop(0, None);
+    histogram.pop(mask, None);
+    return histogram;
+
+
+def check_token_count(path_exec, list_sample, path_work):
+
+    # The default model is bounded by the section with the maximum average entropy,
+    # so the number of its tokens is known exactly. The count must not leak over
+    # the section edges.
+    dimension = int(VALUE_DIMENSION);
+    num_failures = 0;
+    for path_input in list_sample:
+        path_output = os.path.join(path_work, "count", os.path.basename(path_input));
+        rc, result = run_engine(path_exec, path_input, path_output, [KEY_STATS]);
+        stats = json.loads(result.strip().splitlines()[-1]);
+        if "error" in stats:
+            print "Skip the token count check (%s)." % stats["error"];
+            return 0;
+
+        list_report = [name for name in os.listdir(path_output) if name.endswith(SUFFIX_ENTROPY_REPORT)];
+        if (rc != 0) or (len(list_report) != 1):
+            print "The token count run fails: %s" % path_input;
+            num_failures += 1;
+            continue;
+
+        # The first section reaching the maximum is selected.
+        data = bytearray(open(path_input, "rb").read());
+        num_tokens = 0;
+        num_distinct = 0;
+        list_section = [item for item in list_sections(os.path.join(path_output, list_report[0])) if item[2] != 0];
+        if len(list_section) != 0:
+            entropy, offset_raw, size_raw = max(list_section, key = lambda item: item[0]);
+            offset_end = min(offset_raw + size_raw, len(data));
+            if offset_end - offset_raw >= dimension:
+                num_tokens = (offset_end - offset_raw - dimension) * SHIFT_RANGE_8BIT + 1;
+                num_distinct = len(count_tokens(data, offset_raw, offset_end, dimension));
+
+        counters = stats["counters"];
+        if (counters["tokens"] != num_tokens) or (counters["distinct_tokens"] != num_distinct):
+            print "Token count mismatch: %s (tokens %d/%d, distinct %d/%d)" % \
+                (path_input, counters["tokens"], num_tokens, counters["distinct_tokens"], num_distinct);
+            num_failures += 1;
+
+    return num_failures;
+
+
+def list_variants(path_cache):
+
+    # The options which only change how the models are computed, so the reports
+    # must be identical to the ones of the plain run. The cache of the case is
+    # filled by the cold run and then served to the warm one.
+    list_variant = list();
+    list_variant.append(("dedup_blocks", [KEY_DEDUP_BLOCKS]));
+    list_variant.append(("lazy_entropy", [KEY_LAZY_ENTROPY]));
+    list_variant.append(("cache_cold", [KEY_CACHE, path_cache]));
+    list_variant.append(("cache_warm", [KEY_CACHE, path_cache]));
+    list_variant.append(("window", [KEY_WINDOW, VALUE_WINDOW_SIZE, KEY_STEP, VALUE_WINDOW_STEP]));
+    return list_variant;
+
+
+def compare_reports(path_base, path_variant):
+
+    list_mismatch = list();
+    for name_file in sorted(os.listdir(path_base)):
+        if not name_file.endswith(SUFFIX_TEXT_REPORT):
+            continue;
+        path_other = os.path.join(path_variant, name_file);
+        if (not os.path.exists(path_other)) or \
+           (not filecmp.cmp(os.path.join(path_base, name_file), path_other, shallow = False)):
+            list_mismatch.append(name_file);
+
+    return list_mismatch;
+
+
+def check_model_equivalence(path_exec, list_sample, path_work):
+
+    num_failures = 0;
+    for path_input in list_sample:
+        name_sample = os.path.basename(path_input);
+        path_base = os.path.join(path_work, "base", name_sample);
+        rc, result = run_engine(path_exec, path_input, path_base, []);
+        if rc != 0:
+            print "The plain run fails: %s" % path_input;
+            num_failures += 1;
+            continue;
+
+        path_cache = os.path.join(path_work, "cache", name_sample);
+        os.makedirs(path_cache);
+        for name_variant, list_option in list_variants(path_cache):
+            path_variant = os.path.join(path_work, name_variant, name_sample);
+            rc, result = run_engine(path_exec, path_input, path_variant, list_option);
+            list_mismatch = compare_reports(path_base, path_variant);
+            if (rc != 0) or (len(list_mismatch) != 0):
+                print "Report mismatch: %s with %s (%s)" % (path_input, name_variant, ", ".join(list_mismatch));
+                num_failures += 1;
+
+    return num_failures;
+
+
+def check_window_profile(path_exec, list_sample, path_work):
+
+    # Recount the middle window of each case by brute force. Its tokens, distinct
+    # tokens and top tokens must match the ones kept by the running histogram.
+    dimension = int(VALUE_DIMENSION);
+    num_failures = 0;
+    for path_input in list_sample:
+        path_output = os.path.join(path_work, "profile", os.path.basename(path_input));
+        rc, result = run_engine(path_exec, path_input, path_output,
+                                [KEY_WINDOW, VALUE_WINDOW_SIZE, KEY_STEP, VALUE_WINDOW_STEP]);
+        list_report = [name for name in os.listdir(path_output) if name.endswith(SUFFIX_WINDOWS_REPORT)];
+        if (rc != 0) or (len(list_report) != 1):
+            print "The window profile fails: %s" % path_input;
+            num_failures += 1;
+            continue;
+
+        # The fields are the index, the range, the tokens, the distinct tokens and the top tokens.
+        list_line = open(os.path.join(path_output, list_report[0])).read().splitlines();
+        if len(list_line) == 0:
+            continue;
+        list_field = list_line[len(list_line) // 2].split("\t");
+        offset_bgn = int(list_field[1], 16);
+        offset_end = int(list_field[2], 16);
+        list_top = list();
+        if len(list_field) > 5:
+            for item in list_field[5].split(" "):
+                value, count = item.strip("#()").split(":");
+                list_top.append((int(value, 16), int(count)));
+
+        data = bytearray(open(path_input, "rb").read());
+        histogram = count_tokens(data, offset_bgn, offset_end, dimension);
+
+        # The top tokens must carry the largest counts in the descending order. The
+        # tokens tied with the last one may be picked in any order.
+        list_count = sorted(histogram.values(), reverse = True)[:NUM_PROFILE_TOP];
+        correct = (int(list_field[3]) == sum(histogram.values())) and (int(list_field[4]) == len(histogram));
+        correct = correct and ([count for value, count in list_top] == list_count);
+        correct = correct and all(histogram.get(value) == count for value, count in list_top);
+        correct = correct and (list_top == sorted(list_top, key = lambda item: (-item[1], item[0])));
+        if not correct:
+            print "Window profile mismatch: %s (window %s)" % (path_input, list_field[0]);
+            num_failures += 1;
+
+    return num_failures;
+
+
 def main():
 
     path_cur_dir = os.getcwd();
@@ -39,10 +272,12 @@ def main():
     tar_ball.extractall(path_case);    
     
     # Iterative testing for each case.
+    list_sample = list();
     for path_dir, list_name_dir, list_name_file in os.walk(path_case):
         for name_file in list_name_file:
             # Generate the path string for input data.
             path_input = os.path.join(path_dir, name_file);
+            list_sample.append(path_input);
 
             # Generate the path string for output folder (ignoring .exe extension).
             path_output = path_input[:-4];
@@ -72,9 +307,21 @@ def main():
                 print result;
             proc.wait();
 
+    # Check the models against the exact results.
+    path_work = tempfile.mkdtemp();
+    num_failures = 0;
+    num_failures += check_token_count(path_exec, list_sample, path_work);
+    num_failures += check_model_equivalence(path_exec, list_sample, path_work);
+    num_failures += check_window_profile(path_exec, list_sample, path_work);
+    shutil.rmtree(path_work);
+
     # Clean the folder.
     #shutil.rmtree(path_case);
 
+    if num_failures != 0:
+        print "%d regression checks failed." % num_failures;
+        sys.exit(1);
+
     return;
 
 